@@ -0,0 +1,779 @@
+// Benchmark of evaluation latency and throughput.
+//
+// Runs every combination of the given models, thread counts, counts of offloaded layers, logits options, eval modes, sequence lengths
+// and, for chunked evaluation, chunk sizes, or, for batched evaluation, batch sizes.
+// Each case evaluates a sequence of pseudo-random tokens from the initial state several times:
+// - serial: one token at a time with rwkv_eval, passing the state from each token to the next;
+// - sequence: the whole sequence at once with rwkv_eval_sequence;
+// - chunked: the sequence in chunks with rwkv_eval_sequence_in_chunks; chunk size 0 is the automatic one;
+// - batch: batch size independent sequences at once, one token of each per rwkv_eval_batch call.
+// Latency is the time to evaluate the whole sequence, or all sequences of the batch; p50 and p99 are taken over iterations after warmup.
+// Throughput counts tokens of all sequences of the batch.
+//
+// Results are written as JSON, with one result per line. If a baseline file written by an earlier run is given,
+// cases are matched by all their parameters, and the run fails if any case got slower than the baseline by more than the tolerance.
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <rwkv.h>
+
+#if defined(_WIN32)
+#include <windows.h>
+
+static double time_ms(void) {
+    LARGE_INTEGER frequency, counter;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    return (double) counter.QuadPart * 1000.0 / (double) frequency.QuadPart;
+}
+#else
+#include <time.h>
+
+static double time_ms(void) {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (double) time.tv_sec * 1000.0 + (double) time.tv_nsec / 1000000.0;
+}
+#endif
+
+#define MAX_MODELS 16
+#define MAX_VALUES 32
+#define MAX_PATH_LENGTH 1024
+
+enum bench_mode {
+    BENCH_SERIAL,
+    BENCH_SEQUENCE,
+    BENCH_CHUNKED,
+    BENCH_BATCH,
+    BENCH_MODE_COUNT
+};
+
+static const char * mode_names[BENCH_MODE_COUNT] = { "serial", "sequence", "chunked", "batch" };
+
+// A list of values of a parameter, from a comma-separated argument.
+struct value_list {
+    size_t values[MAX_VALUES];
+    size_t count;
+};
+
+struct bench_params {
+    const char * model_paths[MAX_MODELS];
+    size_t model_count;
+    struct value_list threads;
+    struct value_list gpu_layers;
+    struct value_list chunk_sizes;
+    struct value_list batch_sizes;
+    struct value_list sequence_lengths;
+    struct value_list logits;
+    struct value_list modes;
+    size_t iterations;
+    size_t warmup;
+    const char * output_path;
+    const char * baseline_path;
+    double tolerance;
+};
+
+// Parameters and measurements of a case. chunk_size and batch_size are also 0 for modes which do not use them.
+struct bench_result {
+    char model[MAX_PATH_LENGTH];
+    size_t mode;
+    size_t threads;
+    size_t gpu_layers;
+    size_t chunk_size;
+    size_t batch_size;
+    size_t sequence_length;
+    size_t logits;
+    double p50_ms;
+    double p99_ms;
+    double tokens_per_second;
+};
+
+static bool parse_list(const char * string, struct value_list * list) {
+    list->count = 0;
+
+    while (*string) {
+        char * end;
+        const unsigned long value = strtoul(string, &end, 10);
+
+        if (end == string || (*end != ',' && *end != '\0') || list->count >= MAX_VALUES) {
+            return false;
+        }
+
+        list->values[list->count++] = (size_t) value;
+        string = *end == ',' ? end + 1 : end;
+    }
+
+    return list->count > 0;
+}
+
+static bool parse_modes(const char * string, struct value_list * list) {
+    list->count = 0;
+
+    while (*string) {
+        const size_t length = strcspn(string, ",");
+        size_t mode = 0;
+
+        while (mode < BENCH_MODE_COUNT && (strlen(mode_names[mode]) != length || strncmp(string, mode_names[mode], length) != 0)) {
+            mode++;
+        }
+
+        if (mode == BENCH_MODE_COUNT || list->count >= MAX_VALUES) {
+            return false;
+        }
+
+        list->values[list->count++] = mode;
+        string += length;
+        string += *string == ',' ? 1 : 0;
+    }
+
+    return list->count > 0;
+}
+
+static void set_list(struct value_list * list, const size_t * values, const size_t count) {
+    memcpy(list->values, values, count * sizeof(size_t));
+    list->count = count;
+}
+
+static int compare_doubles(const void * a, const void * b) {
+    const double x = *(const double *) a;
+    const double y = *(const double *) b;
+    return (x > y) - (x < y);
+}
+
+// Nearest-rank percentile of sorted values.
+static double percentile(const double * sorted, const size_t count, const double p) {
+    size_t rank = (size_t) (p * (double) count + 0.999999);
+    rank = rank < 1 ? 1 : rank;
+    return sorted[(rank > count ? count : rank) - 1];
+}
+
+static void write_json_string(FILE * file, const char * string) {
+    fputc('"', file);
+
+    for (; *string; string++) {
+        if (*string == '"' || *string == '\\') {
+            fputc('\\', file);
+            fputc(*string, file);
+        } else if ((unsigned char) *string < 0x20) {
+            fprintf(file, "\\u%04x", (unsigned int) (unsigned char) *string);
+        } else {
+            fputc(*string, file);
+        }
+    }
+
+    fputc('"', file);
+}
+
+// Finds the value of a key in a result line; values are never nested, so this does not need a JSON parser.
+static const char * find_value(const char * line, const char * key) {
+    char pattern[64];
+    snprintf(pattern, sizeof(pattern), "\"%s\": ", key);
+
+    const char * value = strstr(line, pattern);
+
+    return value ? value + strlen(pattern) : NULL;
+}
+
+static bool read_string_value(const char * line, const char * key, char * out, const size_t capacity) {
+    const char * value = find_value(line, key);
+
+    if (!value || *value != '"') {
+        return false;
+    }
+
+    size_t length = 0;
+
+    for (value++; *value && *value != '"'; value++) {
+        if (*value == '\\' && value[1]) {
+            value++;
+        }
+
+        if (length + 1 >= capacity) {
+            return false;
+        }
+
+        out[length++] = *value;
+    }
+
+    out[length] = '\0';
+
+    return *value == '"';
+}
+
+static bool read_number_value(const char * line, const char * key, double * out) {
+    const char * value = find_value(line, key);
+    char * end;
+
+    if (!value) {
+        return false;
+    }
+
+    *out = strtod(value, &end);
+
+    return end != value;
+}
+
+static bool read_size_value(const char * line, const char * key, size_t * out) {
+    double value;
+
+    if (!read_number_value(line, key, &value)) {
+        return false;
+    }
+
+    *out = (size_t) value;
+
+    return true;
+}
+
+// Reads results from a file written by write_results. Lines which are not results are skipped.
+// Results written before batch mode was added have no batch_size, which is read as 0.
+static bool read_baseline(const char * path, struct bench_result ** results, size_t * count) {
+    FILE * file = fopen(path, "rb");
+
+    if (!file) {
+        fprintf(stderr, "Failed to open %s\n", path);
+
+        return false;
+    }
+
+    size_t capacity = 64;
+    *results = (struct bench_result *) malloc(capacity * sizeof(struct bench_result));
+    *count = 0;
+
+    char line[4096];
+
+    while (*results && fgets(line, sizeof(line), file)) {
+        struct bench_result result;
+        char mode[16];
+        struct value_list modes;
+
+        if (
+            !read_string_value(line, "model", result.model, sizeof(result.model)) ||
+            !read_string_value(line, "mode", mode, sizeof(mode)) ||
+            !read_size_value(line, "threads", &result.threads) ||
+            !read_size_value(line, "gpu_layers", &result.gpu_layers) ||
+            !read_size_value(line, "chunk_size", &result.chunk_size) ||
+            !read_size_value(line, "sequence_length", &result.sequence_length) ||
+            !read_size_value(line, "logits", &result.logits) ||
+            !read_number_value(line, "p50_ms", &result.p50_ms) ||
+            !read_number_value(line, "p99_ms", &result.p99_ms) ||
+            !read_number_value(line, "tokens_per_second", &result.tokens_per_second) ||
+            !parse_modes(mode, &modes) ||
+            modes.count != 1
+        ) {
+            continue;
+        }
+
+        result.mode = modes.values[0];
+
+        if (!read_size_value(line, "batch_size", &result.batch_size)) {
+            result.batch_size = 0;
+        }
+
+        if (*count == capacity) {
+            capacity *= 2;
+            struct bench_result * grown = (struct bench_result *) realloc(*results, capacity * sizeof(struct bench_result));
+
+            if (!grown) {
+                free(*results);
+                *results = NULL;
+                break;
+            }
+
+            *results = grown;
+        }
+
+        (*results)[(*count)++] = result;
+    }
+
+    fclose(file);
+
+    if (!*results) {
+        fprintf(stderr, "Failed to allocate baseline results\n");
+
+        return false;
+    }
+
+    return true;
+}
+
+static const struct bench_result * find_baseline(const struct bench_result * baseline, const size_t count, const struct bench_result * result) {
+    for (size_t i = 0; i < count; i++) {
+        const struct bench_result * entry = &baseline[i];
+
+        if (
+            strcmp(entry->model, result->model) == 0 &&
+            entry->mode == result->mode &&
+            entry->threads == result->threads &&
+            entry->gpu_layers == result->gpu_layers &&
+            entry->chunk_size == result->chunk_size &&
+            entry->batch_size == result->batch_size &&
+            entry->sequence_length == result->sequence_length &&
+            entry->logits == result->logits
+        ) {
+            return entry;
+        }
+    }
+
+    return NULL;
+}
+
+// Buffers of batch mode: a state and logits for each sequence of the batch.
+struct bench_batch {
+    float ** states;
+    float ** logits;
+};
+
+// Evaluates the sequence, or in batch mode the sequences, from the initial state once in the mode of the case.
+// In batch mode, tokens of step i of all sequences are at tokens[i * batch_size].
+static bool eval_case(struct rwkv_context * ctx, const struct bench_result * result, const uint32_t * tokens, float * state, float * logits, const struct bench_batch * batch) {
+    float * logits_out = result->logits ? logits : NULL;
+
+    switch (result->mode) {
+        case BENCH_SERIAL:
+            for (size_t i = 0; i < result->sequence_length; i++) {
+                if (!rwkv_eval(ctx, tokens[i], i == 0 ? NULL : state, state, logits_out)) {
+                    return false;
+                }
+            }
+
+            return true;
+        case BENCH_SEQUENCE:
+            return rwkv_eval_sequence(ctx, tokens, result->sequence_length, NULL, state, logits_out);
+        case BENCH_BATCH:
+            for (size_t i = 0; i < result->sequence_length; i++) {
+                const float * const * states_in = i == 0 ? NULL : (const float * const *) batch->states;
+                float * const * batch_logits = result->logits ? batch->logits : NULL;
+
+                if (!rwkv_eval_batch(ctx, tokens + i * result->batch_size, result->batch_size, states_in, batch->states, batch_logits)) {
+                    return false;
+                }
+            }
+
+            return true;
+        default:
+            return rwkv_eval_sequence_in_chunks(ctx, tokens, result->sequence_length, result->chunk_size, NULL, state, logits_out);
+    }
+}
+
+static void free_batch(struct bench_batch * batch, const size_t batch_size) {
+    for (size_t i = 0; i < batch_size; i++) {
+        free(batch->states ? batch->states[i] : NULL);
+        free(batch->logits ? batch->logits[i] : NULL);
+    }
+
+    free(batch->states);
+    free(batch->logits);
+}
+
+static bool alloc_batch(struct rwkv_context * ctx, struct bench_batch * batch, const size_t batch_size) {
+    batch->states = (float **) calloc(batch_size, sizeof(float *));
+    batch->logits = (float **) calloc(batch_size, sizeof(float *));
+    bool ok = batch->states && batch->logits;
+
+    for (size_t i = 0; ok && i < batch_size; i++) {
+        batch->states[i] = (float *) malloc(rwkv_get_state_len(ctx) * sizeof(float));
+        batch->logits[i] = (float *) malloc(rwkv_get_logits_len(ctx) * sizeof(float));
+        ok = batch->states[i] && batch->logits[i];
+    }
+
+    return ok;
+}
+
+static bool run_case(const struct bench_params * params, struct rwkv_context * ctx, struct bench_result * result, float * state, float * logits) {
+    const size_t n_vocab = rwkv_get_n_vocab(ctx);
+    const size_t sequence_count = result->mode == BENCH_BATCH ? result->batch_size : 1;
+    const size_t token_count = result->sequence_length * sequence_count;
+
+    struct bench_batch batch = { NULL, NULL };
+    uint32_t * tokens = (uint32_t *) malloc(token_count * sizeof(uint32_t));
+    double * latencies = (double *) malloc(params->iterations * sizeof(double));
+
+    if (!tokens || !latencies || (result->mode == BENCH_BATCH && !alloc_batch(ctx, &batch, sequence_count))) {
+        fprintf(stderr, "Failed to allocate tokens\n");
+        free(tokens);
+        free(latencies);
+        free_batch(&batch, sequence_count);
+
+        return false;
+    }
+
+    // The same tokens for every run, so that results are comparable.
+    uint32_t seed = 42;
+
+    for (size_t i = 0; i < token_count; i++) {
+        seed = seed * 1664525 + 1013904223;
+        tokens[i] = (seed >> 8) % n_vocab;
+    }
+
+    double total_ms = 0.0;
+    bool ok = true;
+
+    for (size_t i = 0; ok && i < params->warmup + params->iterations; i++) {
+        const double start = time_ms();
+
+        ok = eval_case(ctx, result, tokens, state, logits, &batch);
+
+        if (i >= params->warmup) {
+            latencies[i - params->warmup] = time_ms() - start;
+            total_ms += latencies[i - params->warmup];
+        }
+    }
+
+    if (ok) {
+        qsort(latencies, params->iterations, sizeof(double), compare_doubles);
+
+        result->p50_ms = percentile(latencies, params->iterations, 0.50);
+        result->p99_ms = percentile(latencies, params->iterations, 0.99);
+        result->tokens_per_second = (double) (token_count * params->iterations) * 1000.0 / total_ms;
+    } else {
+        fprintf(stderr, "Failed to evaluate %s case: 0x%.8X\n", mode_names[result->mode], rwkv_get_last_error(ctx));
+    }
+
+    free(tokens);
+    free(latencies);
+    free_batch(&batch, sequence_count);
+
+    return ok;
+}
+
+static void write_result(FILE * file, const struct bench_result * result, const struct bench_result * baseline, const bool last) {
+    fprintf(file, "    {\"model\": ");
+    write_json_string(file, result->model);
+    fprintf(
+        file,
+        ", \"mode\": \"%s\", \"threads\": %zu, \"gpu_layers\": %zu, \"chunk_size\": %zu, \"batch_size\": %zu, \"sequence_length\": %zu, "
+        "\"logits\": %zu, \"p50_ms\": %.4f, \"p99_ms\": %.4f, \"tokens_per_second\": %.2f",
+        mode_names[result->mode],
+        result->threads,
+        result->gpu_layers,
+        result->chunk_size,
+        result->batch_size,
+        result->sequence_length,
+        result->logits,
+        result->p50_ms,
+        result->p99_ms,
+        result->tokens_per_second
+    );
+
+    if (baseline) {
+        fprintf(file, ", \"baseline_tokens_per_second\": %.2f, \"speedup\": %.4f", baseline->tokens_per_second, result->tokens_per_second / baseline->tokens_per_second);
+    }
+
+    fprintf(file, "}%s\n", last ? "" : ",");
+}
+
+static bool write_results(const struct bench_params * params, const struct bench_result * results, const size_t count, const struct bench_result * baseline, const size_t baseline_count) {
+    FILE * file = params->output_path ? fopen(params->output_path, "wb") : stdout;
+
+    if (!file) {
+        fprintf(stderr, "Failed to open %s\n", params->output_path);
+
+        return false;
+    }
+
+    fprintf(file, "{\n  \"system_info\": ");
+    write_json_string(file, rwkv_get_system_info_string());
+    fprintf(file, ",\n  \"iterations\": %zu,\n  \"warmup\": %zu,\n  \"results\": [\n", params->iterations, params->warmup);
+
+    for (size_t i = 0; i < count; i++) {
+        write_result(file, &results[i], find_baseline(baseline, baseline_count, &results[i]), i + 1 == count);
+    }
+
+    fprintf(file, "  ]\n}\n");
+
+    const bool written = !ferror(file);
+
+    if (params->output_path && fclose(file) != 0) {
+        fprintf(stderr, "Failed to write %s\n", params->output_path);
+
+        return false;
+    }
+
+    return written;
+}
+
+// Reports cases which got slower than the baseline by more than the tolerance; returns the count of them.
+static size_t compare_with_baseline(const struct bench_params * params, const struct bench_result * results, const size_t count, const struct bench_result * baseline, const size_t baseline_count) {
+    size_t matched = 0;
+    size_t regressions = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        const struct bench_result * result = &results[i];
+        const struct bench_result * entry = find_baseline(baseline, baseline_count, result);
+
+        if (!entry) {
+            continue;
+        }
+
+        matched++;
+
+        if (result->tokens_per_second < entry->tokens_per_second * (1.0 - params->tolerance)) {
+            fprintf(
+                stderr,
+                "Regression: %s %s, %zu threads, %zu GPU layers, chunk %zu, batch %zu, length %zu, logits %zu: %.2f tokens/s, baseline %.2f tokens/s\n",
+                result->model,
+                mode_names[result->mode],
+                result->threads,
+                result->gpu_layers,
+                result->chunk_size,
+                result->batch_size,
+                result->sequence_length,
+                result->logits,
+                result->tokens_per_second,
+                entry->tokens_per_second
+            );
+
+            regressions++;
+        }
+    }
+
+    fprintf(stderr, "%zu of %zu cases compared with the baseline, %zu regressions\n", matched, count, regressions);
+
+    return regressions;
+}
+
+static bool run_model(const struct bench_params * params, const size_t m, const size_t threads, const size_t gpu_layers, struct bench_result * results, size_t * count) {
+    struct rwkv_init_params init_params = rwkv_init_params_default();
+    init_params.n_threads = (uint32_t) threads;
+    init_params.n_gpu_layers = (uint32_t) gpu_layers;
+
+    struct rwkv_context * ctx = rwkv_init_from_file_with_params(params->model_paths[m], &init_params);
+
+    if (!ctx) {
+        fprintf(stderr, "Failed to load %s: 0x%.8X\n", params->model_paths[m], rwkv_get_last_error(NULL));
+
+        return false;
+    }
+
+    float * state = (float *) malloc(rwkv_get_state_len(ctx) * sizeof(float));
+    float * logits = (float *) malloc(rwkv_get_logits_len(ctx) * sizeof(float));
+    bool ok = state && logits;
+
+    if (!ok) {
+        fprintf(stderr, "Failed to allocate state and logits\n");
+    }
+
+    for (size_t l = 0; ok && l < params->logits.count; l++) {
+        for (size_t o = 0; ok && o < params->modes.count; o++) {
+            const size_t mode = params->modes.values[o];
+            // Chunked and batch modes also run each of their chunk or batch sizes.
+            const size_t size_count = mode == BENCH_CHUNKED ? params->chunk_sizes.count : mode == BENCH_BATCH ? params->batch_sizes.count : 1;
+
+            for (size_t s = 0; ok && s < params->sequence_lengths.count; s++) {
+                for (size_t c = 0; ok && c < size_count; c++) {
+                    struct bench_result * result = &results[*count];
+                    snprintf(result->model, sizeof(result->model), "%s", params->model_paths[m]);
+                    result->mode = mode;
+                    result->threads = threads;
+                    result->gpu_layers = gpu_layers;
+                    result->chunk_size = mode == BENCH_CHUNKED ? params->chunk_sizes.values[c] : 0;
+                    result->batch_size = mode == BENCH_BATCH ? params->batch_sizes.values[c] : 0;
+                    result->sequence_length = params->sequence_lengths.values[s];
+                    result->logits = params->logits.values[l] ? 1 : 0;
+
+                    ok = run_case(params, ctx, result, state, logits);
+
+                    if (ok) {
+                        fprintf(
+                            stderr,
+                            "%s %s, %zu threads, %zu GPU layers, chunk %zu, batch %zu, length %zu, logits %zu: p50 %.3f ms, p99 %.3f ms, %.2f tokens/s\n",
+                            result->model,
+                            mode_names[result->mode],
+                            result->threads,
+                            result->gpu_layers,
+                            result->chunk_size,
+                            result->batch_size,
+                            result->sequence_length,
+                            result->logits,
+                            result->p50_ms,
+                            result->p99_ms,
+                            result->tokens_per_second
+                        );
+
+                        (*count)++;
+                    }
+                }
+            }
+        }
+    }
+
+    free(state);
+    free(logits);
+    rwkv_free(ctx);
+
+    return ok;
+}
+
+static void print_usage(const char * name) {
+    fprintf(
+        stderr,
+        "Usage: %s MODEL_FILE [MODEL_FILE ...] [options]\n\n"
+        "Lists of values are separated by commas, every combination of them is benchmarked.\n\n"
+        "Options:\n"
+        "  -t, --threads LIST          thread counts (default 4)\n"
+        "  -ngl, --gpu-layers LIST     counts of layers to offload to the GPU (default 0)\n"
+        "  -c, --chunk-sizes LIST      chunk sizes of chunked mode, 1 to 64, or 0 for auto (default 0,1,2,4,8,16,32,64)\n"
+        "  -b, --batch-sizes LIST      batch sizes of batch mode, each positive (default 1,2,4,8,16,32)\n"
+        "  -l, --sequence-lengths LIST counts of tokens evaluated per iteration, per sequence in batch mode (default 64)\n"
+        "  --logits LIST               0 to skip computing logits, 1 to compute them (default 0,1)\n"
+        "  --modes LIST                serial, sequence, chunked, batch (default all)\n"
+        "  -i, --iterations N          measured iterations per case (default 20)\n"
+        "  -w, --warmup N              iterations per case before measuring (default 2)\n"
+        "  -o, --output FILE           file to write JSON results to (default stdout)\n"
+        "  --baseline FILE             JSON results of an earlier run to compare with\n"
+        "  --tolerance F               allowed relative throughput loss against the baseline (default 0.05)\n",
+        name
+    );
+}
+
+int main(const int argc, const char * argv[]) {
+    static const size_t default_threads[] = { 4 };
+    static const size_t default_gpu_layers[] = { 0 };
+    static const size_t default_chunk_sizes[] = { 0, 1, 2, 4, 8, 16, 32, 64 };
+    static const size_t default_batch_sizes[] = { 1, 2, 4, 8, 16, 32 };
+    static const size_t default_sequence_lengths[] = { 64 };
+    static const size_t default_logits[] = { 0, 1 };
+    static const size_t default_modes[] = { BENCH_SERIAL, BENCH_SEQUENCE, BENCH_CHUNKED, BENCH_BATCH };
+
+    struct bench_params params;
+    params.model_count = 0;
+    set_list(&params.threads, default_threads, 1);
+    set_list(&params.gpu_layers, default_gpu_layers, 1);
+    set_list(&params.chunk_sizes, default_chunk_sizes, 8);
+    set_list(&params.batch_sizes, default_batch_sizes, 6);
+    set_list(&params.sequence_lengths, default_sequence_lengths, 1);
+    set_list(&params.logits, default_logits, 2);
+    set_list(&params.modes, default_modes, 4);
+    params.iterations = 20;
+    params.warmup = 2;
+    params.output_path = NULL;
+    params.baseline_path = NULL;
+    params.tolerance = 0.05;
+
+    int i = 1;
+
+    for (; i < argc && argv[i][0] != '-'; i++) {
+        if (params.model_count == MAX_MODELS) {
+            print_usage(argv[0]);
+
+            return EXIT_FAILURE;
+        }
+
+        params.model_paths[params.model_count++] = argv[i];
+    }
+
+    for (; i < argc; i += 2) {
+        const char * name = argv[i];
+
+        if (i + 1 >= argc) {
+            print_usage(argv[0]);
+
+            return EXIT_FAILURE;
+        }
+
+        const char * value = argv[i + 1];
+        bool valid = true;
+
+        if (strcmp(name, "-t") == 0 || strcmp(name, "--threads") == 0) {
+            valid = parse_list(value, &params.threads);
+        } else if (strcmp(name, "-ngl") == 0 || strcmp(name, "--gpu-layers") == 0) {
+            valid = parse_list(value, &params.gpu_layers);
+        } else if (strcmp(name, "-c") == 0 || strcmp(name, "--chunk-sizes") == 0) {
+            valid = parse_list(value, &params.chunk_sizes);
+        } else if (strcmp(name, "-b") == 0 || strcmp(name, "--batch-sizes") == 0) {
+            valid = parse_list(value, &params.batch_sizes);
+        } else if (strcmp(name, "-l") == 0 || strcmp(name, "--sequence-lengths") == 0) {
+            valid = parse_list(value, &params.sequence_lengths);
+        } else if (strcmp(name, "--logits") == 0) {
+            valid = parse_list(value, &params.logits);
+        } else if (strcmp(name, "--modes") == 0) {
+            valid = parse_modes(value, &params.modes);
+        } else if (strcmp(name, "-i") == 0 || strcmp(name, "--iterations") == 0) {
+            params.iterations = (size_t) atoi(value);
+        } else if (strcmp(name, "-w") == 0 || strcmp(name, "--warmup") == 0) {
+            params.warmup = (size_t) atoi(value);
+        } else if (strcmp(name, "-o") == 0 || strcmp(name, "--output") == 0) {
+            params.output_path = value;
+        } else if (strcmp(name, "--baseline") == 0) {
+            params.baseline_path = value;
+        } else if (strcmp(name, "--tolerance") == 0) {
+            params.tolerance = atof(value);
+        } else {
+            valid = false;
+        }
+
+        if (!valid) {
+            print_usage(argv[0]);
+
+            return EXIT_FAILURE;
+        }
+    }
+
+    bool valid = params.model_count > 0 && params.iterations > 0 && params.tolerance >= 0.0;
+
+    for (size_t j = 0; j < params.threads.count; j++) {
+        valid = valid && params.threads.values[j] > 0;
+    }
+
+    for (size_t j = 0; j < params.chunk_sizes.count; j++) {
+        valid = valid && params.chunk_sizes.values[j] <= 64;
+    }
+
+    for (size_t j = 0; j < params.batch_sizes.count; j++) {
+        valid = valid && params.batch_sizes.values[j] > 0;
+    }
+
+    for (size_t j = 0; j < params.sequence_lengths.count; j++) {
+        valid = valid && params.sequence_lengths.values[j] > 0;
+    }
+
+    if (!valid) {
+        print_usage(argv[0]);
+
+        return EXIT_FAILURE;
+    }
+
+    struct bench_result * baseline = NULL;
+    size_t baseline_count = 0;
+
+    if (params.baseline_path && !read_baseline(params.baseline_path, &baseline, &baseline_count)) {
+        return EXIT_FAILURE;
+    }
+
+    const size_t max_size_count = params.chunk_sizes.count > params.batch_sizes.count ? params.chunk_sizes.count : params.batch_sizes.count;
+    const size_t max_count = params.model_count * params.threads.count * params.gpu_layers.count * params.logits.count *
+        params.modes.count * params.sequence_lengths.count * max_size_count;
+
+    struct bench_result * results = (struct bench_result *) malloc(max_count * sizeof(struct bench_result));
+    size_t count = 0;
+
+    if (!results) {
+        fprintf(stderr, "Failed to allocate results\n");
+        free(baseline);
+
+        return EXIT_FAILURE;
+    }
+
+    bool ok = true;
+
+    for (size_t m = 0; ok && m < params.model_count; m++) {
+        for (size_t t = 0; ok && t < params.threads.count; t++) {
+            for (size_t g = 0; ok && g < params.gpu_layers.count; g++) {
+                ok = run_model(&params, m, params.threads.values[t], params.gpu_layers.values[g], results, &count);
+            }
+        }
+    }
+
+    ok = ok && write_results(&params, results, count, baseline, baseline_count);
+
+    if (ok && params.baseline_path && compare_with_baseline(&params, results, count, baseline, baseline_count) > 0) {
+        ok = false;
+    }
+
+    free(results);
+    free(baseline);
+
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
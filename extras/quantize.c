@@ -25,28 +25,66 @@ bool QueryPerformanceCounter(uint64_t* lpPerformanceCount);
 static enum ggml_type type_from_string(const char * string) {
     if (strcmp(string, "Q4_0") == 0) return GGML_TYPE_Q4_0;
     if (strcmp(string, "Q4_1") == 0) return GGML_TYPE_Q4_1;
-    if (strcmp(string, "Q4_K") == 0) return GGML_TYPE_Q4_K;
     if (strcmp(string, "Q5_0") == 0) return GGML_TYPE_Q5_0;
     if (strcmp(string, "Q5_1") == 0) return GGML_TYPE_Q5_1;
-    if (strcmp(string, "Q5_K") == 0) return GGML_TYPE_Q5_K;
     if (strcmp(string, "Q8_0") == 0) return GGML_TYPE_Q8_0;
+    if (strcmp(string, "Q2_K") == 0) return GGML_TYPE_Q2_K;
+    if (strcmp(string, "Q3_K") == 0) return GGML_TYPE_Q3_K;
+    if (strcmp(string, "Q4_K") == 0) return GGML_TYPE_Q4_K;
+    if (strcmp(string, "Q5_K") == 0) return GGML_TYPE_Q5_K;
+    if (strcmp(string, "Q6_K") == 0) return GGML_TYPE_Q6_K;
+    if (strcmp(string, "IQ4_NL") == 0) return GGML_TYPE_IQ4_NL;
+    if (strcmp(string, "IQ4_XS") == 0) return GGML_TYPE_IQ4_XS;
+    if (strcmp(string, "IQ3_XXS") == 0) return GGML_TYPE_IQ3_XXS;
+    if (strcmp(string, "IQ3_S") == 0) return GGML_TYPE_IQ3_S;
+    if (strcmp(string, "IQ2_S") == 0) return GGML_TYPE_IQ2_S;
     return GGML_TYPE_COUNT;
 }
 
+static void print_usage(const char * name) {
+    fprintf(
+        stderr,
+        "Usage: %s INPUT_FILE OUTPUT_FILE FORMAT [options]\n\n"
+        "Available formats: Q4_0 Q4_1 Q5_0 Q5_1 Q8_0 Q2_K Q3_K Q4_K Q5_K Q6_K IQ4_NL IQ4_XS IQ3_XXS IQ3_S IQ2_S\n\n"
+        "Options:\n"
+        "  -t, --threads N    count of threads quantizing tensors (default 1)\n"
+        "  --resume           continue an interrupted quantization into OUTPUT_FILE\n"
+        "  --recipe RULES     formats of some tensors, like \"*ffn*=Q4_K; *att.output*:0,-1=Q8_0\"\n"
+        "                     (see rwkv_quantize_params in rwkv.h)\n",
+        name
+    );
+}
+
 int main(const int argc, const char * argv[]) {
-    if (argc != 4 || type_from_string(argv[3]) == GGML_TYPE_COUNT) {
-        fprintf(stderr, "Usage: %s INPUT_FILE OUTPUT_FILE FORMAT\n\nAvailable formats: Q4_0 Q4_1 Q5_0 Q5_1 Q8_0\n", argv[0]);
+    if (argc < 4 || type_from_string(argv[3]) == GGML_TYPE_COUNT) {
+        print_usage(argv[0]);
 
         return EXIT_FAILURE;
     }
 
+    struct rwkv_quantize_params params = rwkv_quantize_params_default();
+
+    for (int i = 4; i < argc; i++) {
+        if ((strcmp(argv[i], "-t") == 0 || strcmp(argv[i], "--threads") == 0) && i + 1 < argc && atoi(argv[i + 1]) > 0) {
+            params.n_threads = (uint32_t) atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--recipe") == 0 && i + 1 < argc) {
+            params.recipe = argv[++i];
+        } else if (strcmp(argv[i], "--resume") == 0) {
+            params.resume = true;
+        } else {
+            print_usage(argv[0]);
+
+            return EXIT_FAILURE;
+        }
+    }
+
     time_t freq, start, end;
     time_calibrate(freq);
 
     fprintf(stderr, "Quantizing...\n");
 
     time_measure(start);
-    bool success = rwkv_quantize_model_file(argv[1], argv[2], argv[3]);
+    bool success = rwkv_quantize_model_file_with_params(argv[1], argv[2], argv[3], &params);
     time_measure(end);
 
     double diff = TIME_DIFF(freq, start, end);
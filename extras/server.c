@@ -0,0 +1,639 @@
+// Continuous batching inference loop.
+//
+// Requests are read from a file, one per line, in order of arrival: arrival time in milliseconds since start, max count of new tokens,
+// and prompt tokens, all separated by spaces. Tokens are ids, so that any tokenizer can be used to prepare requests.
+// Each step of the loop admits requests which have arrived while there are free slots, evaluates one chunk of the prompt
+// of each session that is still being prefilled, and generates one token for every other session in a single batch.
+// Finished requests free their slots right away, so that new requests do not wait for the whole batch to finish.
+//
+// Every token is sampled by the library with the same parameters and the random number generator of the context,
+// so that a seed gives the same outputs for the same order of steps.
+//
+// Generated tokens of each request are written to stdout as "ID: TOKEN TOKEN ...", metrics are written to stderr.
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include <rwkv.h>
+
+#if defined(_WIN32)
+#include <windows.h>
+
+static double time_ms(void) {
+    LARGE_INTEGER frequency, counter;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    return (double) counter.QuadPart * 1000.0 / (double) frequency.QuadPart;
+}
+
+static void sleep_ms(const double ms) {
+    Sleep((DWORD) ms);
+}
+#else
+#include <time.h>
+
+static double time_ms(void) {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (double) time.tv_sec * 1000.0 + (double) time.tv_nsec / 1000000.0;
+}
+
+static void sleep_ms(const double ms) {
+    struct timespec time;
+    time.tv_sec = (time_t) (ms / 1000.0);
+    time.tv_nsec = (long) (fmod(ms, 1000.0) * 1000000.0);
+    nanosleep(&time, NULL);
+}
+#endif
+
+struct server_params {
+    const char * model_path;
+    const char * requests_path;
+    uint32_t n_threads;
+    uint32_t n_gpu_layers;
+    size_t max_batch_size;
+    size_t chunk_size;
+    float temperature;
+    uint64_t seed;
+    int64_t stop_token;
+};
+
+struct request {
+    size_t id;
+    double arrival_time;
+    size_t max_new_tokens;
+    uint32_t * prompt;
+    size_t prompt_length;
+
+    // Set when the request is processed.
+    uint32_t * output;
+    size_t output_length;
+    double admission_time;
+    double first_token_time;
+    double finish_time;
+};
+
+// A request being processed, with its own state.
+struct session {
+    struct request * request;
+    size_t prefilled_length;
+    float * state;
+    float * logits;
+};
+
+struct metrics {
+    size_t prefill_tokens;
+    size_t decode_tokens;
+    size_t decode_steps;
+    double prefill_time;
+    double decode_time;
+};
+
+// Requests
+
+static void free_requests(struct request * requests, const size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        free(requests[i].prompt);
+        free(requests[i].output);
+    }
+
+    free(requests);
+}
+
+// Reads a whole line, growing the buffer as needed. Returns false at the end of the file,
+// or if the buffer could not grow, in which case it is freed and set to NULL.
+static bool read_line(FILE * file, char ** line, size_t * capacity) {
+    size_t length = 0;
+
+    while (fgets(*line + length, (int) (*capacity - length), file)) {
+        length += strlen(*line + length);
+
+        if (length > 0 && (*line)[length - 1] == '\n') {
+            return true;
+        }
+
+        if (length + 1 == *capacity) {
+            char * grown = realloc(*line, *capacity * 2);
+
+            if (!grown) {
+                free(*line);
+                *line = NULL;
+
+                return false;
+            }
+
+            *line = grown;
+            *capacity *= 2;
+        }
+    }
+
+    // The last line may have no line break.
+    return length > 0;
+}
+
+static bool read_requests(const char * path, struct request ** requests_out, size_t * count_out) {
+    FILE * file = fopen(path, "r");
+
+    if (!file) {
+        fprintf(stderr, "Failed to open %s\n", path);
+
+        return false;
+    }
+
+    size_t capacity = 16;
+    size_t count = 0;
+    struct request * requests = calloc(capacity, sizeof(struct request));
+
+    size_t line_capacity = 4096;
+    char * line = malloc(line_capacity);
+
+    bool is_allocated = requests != NULL && line != NULL;
+    bool is_valid = true;
+
+    while (is_allocated && is_valid && read_line(file, &line, &line_capacity)) {
+        char * cursor = line;
+        char * end;
+
+        double arrival_time = strtod(cursor, &end);
+
+        if (end == cursor) {
+            // Empty line.
+            continue;
+        }
+
+        cursor = end;
+
+        size_t max_new_tokens = strtoul(cursor, &end, 10);
+        cursor = end;
+
+        if (count == capacity) {
+            struct request * grown = realloc(requests, capacity * 2 * sizeof(struct request));
+
+            if (!grown) {
+                is_allocated = false;
+
+                break;
+            }
+
+            requests = grown;
+            capacity *= 2;
+        }
+
+        struct request * request = &requests[count];
+        memset(request, 0, sizeof(struct request));
+        request->id = count;
+        request->arrival_time = arrival_time;
+        request->max_new_tokens = max_new_tokens;
+        request->prompt = calloc(strlen(cursor) / 2 + 1, sizeof(uint32_t));
+        request->output = calloc(max_new_tokens + 1, sizeof(uint32_t));
+
+        // Counted right away, so that its buffers are freed on errors.
+        count++;
+
+        if (!request->prompt || !request->output) {
+            is_allocated = false;
+
+            break;
+        }
+
+        while (true) {
+            unsigned long token = strtoul(cursor, &end, 10);
+
+            if (end == cursor) {
+                break;
+            }
+
+            request->prompt[request->prompt_length++] = (uint32_t) token;
+            cursor = end;
+        }
+
+        if (request->prompt_length == 0 || max_new_tokens == 0) {
+            fprintf(stderr, "Request %zd needs a prompt and at least one new token\n", count);
+
+            is_valid = false;
+        }
+    }
+
+    // read_line frees the line if it can not grow it.
+    is_allocated = is_allocated && line != NULL;
+
+    const bool is_read = !ferror(file);
+
+    fclose(file);
+    free(line);
+
+    if (!is_read) {
+        fprintf(stderr, "Failed to read %s\n", path);
+    }
+
+    if (!is_allocated) {
+        fprintf(stderr, "Failed to allocate requests\n");
+    }
+
+    if (!is_read || !is_allocated || !is_valid) {
+        free_requests(requests, count);
+
+        return false;
+    }
+
+    *requests_out = requests;
+    *count_out = count;
+
+    return true;
+}
+
+// Appends the token to the output of the session. Returns true if the request is finished.
+static bool append_token(const struct server_params * params, struct session * session, const uint32_t token, const double now) {
+    struct request * request = session->request;
+
+    if (request->output_length == 0) {
+        request->first_token_time = now;
+    }
+
+    request->output[request->output_length++] = token;
+
+    return request->output_length >= request->max_new_tokens || (int64_t) token == params->stop_token;
+}
+
+// Metrics
+
+static int compare_doubles(const void * a, const void * b) {
+    double difference = *(const double *) a - *(const double *) b;
+    return (difference > 0) - (difference < 0);
+}
+
+static void print_latency(const char * name, double * values, const size_t count) {
+    qsort(values, count, sizeof(double), compare_doubles);
+
+    double sum = 0.0;
+
+    for (size_t i = 0; i < count; i++) {
+        sum += values[i];
+    }
+
+    fprintf(
+        stderr,
+        "%-22s mean %9.2f ms, p50 %9.2f ms, p90 %9.2f ms, p99 %9.2f ms\n",
+        name,
+        sum / count,
+        values[count / 2],
+        values[count * 9 / 10],
+        values[count * 99 / 100]
+    );
+}
+
+static void print_metrics(const struct request * requests, const size_t count, const struct metrics * metrics, const double total_time) {
+    double * queue_times = calloc(count, sizeof(double));
+    double * first_token_times = calloc(count, sizeof(double));
+    double * token_times = calloc(count, sizeof(double));
+
+    if (!queue_times || !first_token_times || !token_times) {
+        return;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        const struct request * request = &requests[i];
+
+        queue_times[i] = request->admission_time - request->arrival_time;
+        first_token_times[i] = request->first_token_time - request->arrival_time;
+        token_times[i] = request->output_length > 1 ?
+            (request->finish_time - request->first_token_time) / (request->output_length - 1) :
+            0.0;
+    }
+
+    fprintf(stderr, "\n%zd requests in %.3f s\n", count, total_time / 1000.0);
+    fprintf(stderr, "Prefill: %zd tokens, %.1f tokens/s\n", metrics->prefill_tokens, metrics->prefill_tokens * 1000.0 / metrics->prefill_time);
+    fprintf(
+        stderr,
+        "Decode: %zd tokens, %.1f tokens/s, mean batch size %.2f\n",
+        metrics->decode_tokens,
+        metrics->decode_tokens * 1000.0 / metrics->decode_time,
+        metrics->decode_steps > 0 ? (double) metrics->decode_tokens / metrics->decode_steps : 0.0
+    );
+
+    print_latency("Queue time", queue_times, count);
+    print_latency("Time to first token", first_token_times, count);
+    print_latency("Time per output token", token_times, count);
+
+    free(queue_times);
+    free(first_token_times);
+    free(token_times);
+}
+
+// Serving loop
+
+// Decode batches are padded to powers of two, so that the library builds a graph for only a few batch sizes.
+static size_t padded_batch_size(const size_t batch_size) {
+    size_t result = 1;
+
+    while (result < batch_size) {
+        result *= 2;
+    }
+
+    return result;
+}
+
+static bool serve(const struct server_params * params, struct rwkv_context * ctx, struct request * requests, const size_t request_count) {
+    const size_t state_len = rwkv_get_state_len(ctx);
+    const size_t n_vocab = rwkv_get_n_vocab(ctx);
+    const size_t max_batch_size = params->max_batch_size;
+    const size_t max_padded_batch_size = padded_batch_size(max_batch_size);
+
+    struct session * sessions = calloc(max_batch_size, sizeof(struct session));
+    uint32_t * batch_tokens = calloc(max_padded_batch_size, sizeof(uint32_t));
+    float ** batch_states = calloc(max_padded_batch_size, sizeof(float *));
+    float ** batch_logits = calloc(max_padded_batch_size, sizeof(float *));
+    struct session ** batch_sessions = calloc(max_batch_size, sizeof(struct session *));
+    bool is_served = false;
+
+    if (!sessions || !batch_tokens || !batch_states || !batch_logits || !batch_sessions) {
+        fprintf(stderr, "Failed to allocate sessions\n");
+
+        goto cleanup;
+    }
+
+    // Keep graphs of all padded sizes; batches of 1 token use the serial graph.
+    size_t padded_size_count = 0;
+
+    for (size_t size = 2; size <= max_padded_batch_size; size *= 2) {
+        padded_size_count++;
+    }
+
+    if (padded_size_count > rwkv_get_batch_graph_cache_capacity(ctx) && !rwkv_set_batch_graph_cache_capacity(ctx, padded_size_count)) {
+        fprintf(stderr, "Failed to set batch graph cache capacity: 0x%.8X\n", rwkv_get_last_error(ctx));
+
+        goto cleanup;
+    }
+
+    for (size_t i = 0; i < max_batch_size; i++) {
+        sessions[i].state = calloc(state_len, sizeof(float));
+        sessions[i].logits = calloc(n_vocab, sizeof(float));
+
+        if (!sessions[i].state || !sessions[i].logits) {
+            fprintf(stderr, "Failed to allocate sessions\n");
+
+            goto cleanup;
+        }
+    }
+
+    struct rwkv_sampling_params sampling = rwkv_sampling_params_default();
+    sampling.temperature = params->temperature;
+
+    struct metrics metrics;
+    memset(&metrics, 0, sizeof(metrics));
+
+    size_t next_request = 0;
+    size_t finished_count = 0;
+    const double start_time = time_ms();
+
+    while (finished_count < request_count) {
+        double now = time_ms() - start_time;
+
+        // Admit requests which have arrived.
+        for (size_t i = 0; i < max_batch_size && next_request < request_count; i++) {
+            if (sessions[i].request == NULL && requests[next_request].arrival_time <= now) {
+                sessions[i].request = &requests[next_request++];
+                sessions[i].request->admission_time = now;
+                sessions[i].prefilled_length = 0;
+            }
+        }
+
+        size_t batch_size = 0;
+        bool is_idle = true;
+
+        for (size_t i = 0; i < max_batch_size; i++) {
+            struct session * session = &sessions[i];
+            struct request * request = session->request;
+
+            if (request == NULL) {
+                continue;
+            }
+
+            is_idle = false;
+
+            if (request->output_length > 0) {
+                batch_tokens[batch_size] = request->output[request->output_length - 1];
+                batch_states[batch_size] = session->state;
+                batch_logits[batch_size] = session->logits;
+                batch_sessions[batch_size] = session;
+                batch_size++;
+
+                continue;
+            }
+
+            // Prefill one chunk; the last one also samples the first token.
+            const size_t length = request->prompt_length - session->prefilled_length < params->chunk_size ?
+                request->prompt_length - session->prefilled_length :
+                params->chunk_size;
+            const uint32_t * tokens = request->prompt + session->prefilled_length;
+            const float * state_in = session->prefilled_length == 0 ? NULL : session->state;
+            const bool is_last_chunk = session->prefilled_length + length == request->prompt_length;
+
+            const double prefill_start = time_ms();
+            uint32_t token;
+
+            bool result = is_last_chunk ?
+                rwkv_eval_sequence_and_sample(ctx, tokens, length, state_in, session->state, &sampling, &token) :
+                rwkv_eval_sequence(ctx, tokens, length, state_in, session->state, NULL);
+
+            if (!result) {
+                fprintf(stderr, "Failed to evaluate prompt of request %zd: 0x%.8X\n", request->id, rwkv_get_last_error(ctx));
+
+                goto cleanup;
+            }
+
+            now = time_ms() - start_time;
+            metrics.prefill_time += now + start_time - prefill_start;
+            metrics.prefill_tokens += length;
+            session->prefilled_length += length;
+
+            if (is_last_chunk && append_token(params, session, token, now)) {
+                request->finish_time = now;
+                session->request = NULL;
+                finished_count++;
+            }
+        }
+
+        if (batch_size > 0) {
+            const double decode_start = time_ms();
+            const size_t padded_size = padded_batch_size(batch_size);
+
+            // Padding sequences start from the initial state, and neither their states nor their logits are read.
+            for (size_t b = batch_size; b < padded_size; b++) {
+                batch_tokens[b] = 0;
+                batch_states[b] = NULL;
+                batch_logits[b] = NULL;
+            }
+
+            if (!rwkv_eval_batch(ctx, batch_tokens, padded_size, (const float * const *) batch_states, batch_states, batch_logits)) {
+                fprintf(stderr, "Failed to evaluate batch: 0x%.8X\n", rwkv_get_last_error(ctx));
+
+                goto cleanup;
+            }
+
+            now = time_ms() - start_time;
+            metrics.decode_time += now + start_time - decode_start;
+            metrics.decode_tokens += batch_size;
+            metrics.decode_steps++;
+
+            for (size_t b = 0; b < batch_size; b++) {
+                struct session * session = batch_sessions[b];
+                uint32_t token;
+
+                if (!rwkv_sample_from_logits(ctx, session->logits, &sampling, &token)) {
+                    fprintf(stderr, "Failed to sample token of request %zd: 0x%.8X\n", session->request->id, rwkv_get_last_error(ctx));
+
+                    goto cleanup;
+                }
+
+                if (append_token(params, session, token, now)) {
+                    session->request->finish_time = now;
+                    session->request = NULL;
+                    finished_count++;
+                }
+            }
+        }
+
+        if (is_idle && next_request < request_count) {
+            // Nothing to do until the next request arrives.
+            sleep_ms(requests[next_request].arrival_time - now);
+        }
+    }
+
+    print_metrics(requests, request_count, &metrics, time_ms() - start_time);
+
+    is_served = true;
+
+cleanup:
+    // Every failure above jumps here, so sessions and buffers are freed on all paths.
+    for (size_t i = 0; sessions && i < max_batch_size; i++) {
+        free(sessions[i].state);
+        free(sessions[i].logits);
+    }
+
+    free(sessions);
+    free(batch_tokens);
+    free(batch_states);
+    free(batch_logits);
+    free(batch_sessions);
+
+    return is_served;
+}
+
+static void print_usage(const char * name) {
+    fprintf(
+        stderr,
+        "Usage: %s MODEL_FILE REQUESTS_FILE [options]\n\n"
+        "Options:\n"
+        "  -t, --threads N        thread count (default 4)\n"
+        "  -ngl, --gpu-layers N   count of layers to offload to the GPU (default 0)\n"
+        "  -b, --max-batch N      max count of sessions processed at once (default 8)\n"
+        "  -c, --chunk-size N     prompt tokens evaluated per session per step (default 16)\n"
+        "  --temperature T        sampling temperature, 0 for greedy sampling (default 0)\n"
+        "  --seed N               seed of sampling, 0 for the default seed of the library (default 0)\n"
+        "  --stop-token ID        token which finishes requests (default none)\n",
+        name
+    );
+}
+
+int main(const int argc, const char * argv[]) {
+    if (argc < 3) {
+        print_usage(argv[0]);
+
+        return EXIT_FAILURE;
+    }
+
+    struct server_params params;
+    params.model_path = argv[1];
+    params.requests_path = argv[2];
+    params.n_threads = 4;
+    params.n_gpu_layers = 0;
+    params.max_batch_size = 8;
+    params.chunk_size = 16;
+    params.temperature = 0.0F;
+    params.seed = 0;
+    params.stop_token = -1;
+
+    for (int i = 3; i < argc; i += 2) {
+        const char * name = argv[i];
+
+        if (i + 1 >= argc) {
+            print_usage(argv[0]);
+
+            return EXIT_FAILURE;
+        }
+
+        const char * value = argv[i + 1];
+
+        if (strcmp(name, "-t") == 0 || strcmp(name, "--threads") == 0) {
+            params.n_threads = (uint32_t) atoi(value);
+        } else if (strcmp(name, "-ngl") == 0 || strcmp(name, "--gpu-layers") == 0) {
+            params.n_gpu_layers = (uint32_t) atoi(value);
+        } else if (strcmp(name, "-b") == 0 || strcmp(name, "--max-batch") == 0) {
+            params.max_batch_size = (size_t) atoi(value);
+        } else if (strcmp(name, "-c") == 0 || strcmp(name, "--chunk-size") == 0) {
+            params.chunk_size = (size_t) atoi(value);
+        } else if (strcmp(name, "--temperature") == 0) {
+            params.temperature = (float) atof(value);
+        } else if (strcmp(name, "--seed") == 0) {
+            params.seed = (uint64_t) strtoull(value, NULL, 10);
+        } else if (strcmp(name, "--stop-token") == 0) {
+            params.stop_token = atoll(value);
+        } else {
+            print_usage(argv[0]);
+
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (params.n_threads == 0 || params.max_batch_size == 0 || params.chunk_size == 0) {
+        print_usage(argv[0]);
+
+        return EXIT_FAILURE;
+    }
+
+    struct request * requests;
+    size_t request_count;
+
+    if (!read_requests(params.requests_path, &requests, &request_count)) {
+        return EXIT_FAILURE;
+    }
+
+    if (request_count == 0) {
+        fprintf(stderr, "No requests in %s\n", params.requests_path);
+        free_requests(requests, request_count);
+
+        return EXIT_FAILURE;
+    }
+
+    struct rwkv_context * ctx = rwkv_init_from_file(params.model_path, params.n_threads, params.n_gpu_layers);
+
+    if (!ctx) {
+        fprintf(stderr, "Failed to load model: 0x%.8X\n", rwkv_get_last_error(NULL));
+        free_requests(requests, request_count);
+
+        return EXIT_FAILURE;
+    }
+
+    rwkv_set_sampling_seed(ctx, params.seed);
+
+    bool success = serve(&params, ctx, requests, request_count);
+
+    if (success) {
+        for (size_t i = 0; i < request_count; i++) {
+            printf("%zd:", requests[i].id);
+
+            for (size_t j = 0; j < requests[i].output_length; j++) {
+                printf(" %d", (int) requests[i].output[j]);
+            }
+
+            printf("\n");
+        }
+    }
+
+    rwkv_free(ctx);
+    free_requests(requests, request_count);
+
+    return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
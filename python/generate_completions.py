@@ -3,7 +3,6 @@
 
 import argparse
 import time
-import sampling
 from rwkv_cpp import rwkv_cpp_shared_library, rwkv_cpp_model
 from tokenizer_util import add_tokenizer_argument, get_tokenizer
 from typing import List
@@ -49,7 +48,14 @@ prompt_tokens: List[int] = tokenizer_encode(prompt)
 prompt_token_count: int = len(prompt_tokens)
 print(f'{prompt_token_count} tokens in prompt')
 
-init_logits, init_state = model.eval_sequence_in_chunks(prompt_tokens, None, None, None, use_numpy=True)
+# The last prompt token is evaluated by each generation, so that each of them samples its own first token.
+init_state = None
+
+if prompt_token_count > 1:
+    _, init_state = model.eval_sequence_in_chunks(prompt_tokens[:-1], None, None, None, use_numpy=True)
+
+# Tokens are sampled by the library, so that logits are never copied to Python.
+sampling_params = model.create_sampling_params(temperature=temperature, top_p=top_p)
 
 for GENERATION in range(generation_count):
     print(f'\n--- Generation {GENERATION} ---\n')
@@ -57,14 +63,12 @@ for GENERATION in range(generation_count):
 
     start: float = time.time()
 
-    logits, state = init_logits.copy(), init_state.copy()
+    token, state = model.eval_and_sample(prompt_tokens[-1], init_state, None, sampling_params, use_numpy=True)
 
     for i in range(tokens_per_generation):
-        token: int = sampling.sample_logits(logits, temperature, top_p)
-
         print(tokenizer_decode([token]), end='', flush=True)
 
-        logits, state = model.eval(token, state, state, logits, use_numpy=True)
+        token, state = model.eval_and_sample(token, state, state, sampling_params)
 
     delay: float = time.time() - start
 
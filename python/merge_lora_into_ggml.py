@@ -8,7 +8,10 @@ import argparse
 import struct
 import torch
 import numpy as np
-from typing import List, Dict, Tuple
+from typing import List, Dict, Tuple, Iterator, BinaryIO
+
+# Since version 102, the file header is followed by a directory of all tensors, and tensor data is aligned.
+FILE_VERSION_2: int = 102
 
 def parse_args():
     parser = argparse.ArgumentParser(description='Merge a PyTorch LoRA checkpoint (.pth) into an rwkv.cpp model file')
@@ -42,6 +45,58 @@ def write_parameter(out_file, key: str, parameter: torch.Tensor) -> None:
 
     parameter.numpy().tofile(out_file)
 
+def read_parameters(in_file: BinaryIO, version: int) -> Iterator[Tuple[str, int, List[int], bytes]]:
+    """Yields key, data type, shape in PyTorch order and data of each parameter of a file positioned right after the file header."""
+
+    def read_data(data_type: int, shape: List[int]) -> bytes:
+        if not (data_type == 0 or data_type == 1):
+            raise ValueError('Only FP32 and FP16 models are supported')
+
+        element_count: int = 1
+
+        for dim in shape:
+            element_count *= dim
+
+        return in_file.read((2 if data_type == 1 else 4) * element_count)
+
+    if version >= FILE_VERSION_2:
+        # noinspection PyTypeChecker
+        _, _, tensor_count, _ = struct.unpack('=iiii', in_file.read(4 * 4))
+
+        entries: List[Tuple[str, int, List[int], int]] = []
+
+        for _ in range(tensor_count):
+            # Entries store all three sizes, whatever the dimension count is, followed by the data offset.
+            dim_count, key_length, data_type, *sizes = struct.unpack('=iiiiii', in_file.read(6 * 4))
+            offset: int = struct.unpack('=Q', in_file.read(8))[0]
+            key: str = in_file.read(key_length).decode('utf-8')
+            # ggml order to PyTorch
+            entries.append((key, data_type, [d for d in reversed(sizes[:dim_count])], offset))
+
+        for key, data_type, shape, offset in entries:
+            in_file.seek(offset)
+
+            yield key, data_type, shape, read_data(data_type, shape)
+
+        return
+
+    while True:
+        parameter_header_bytes: bytes = in_file.read(3 * 4)
+
+        if len(parameter_header_bytes) == 0:
+            break
+
+        dim_count, key_length, data_type = struct.unpack('=iii', parameter_header_bytes)
+
+        # noinspection PyTypeChecker
+        shape: Tuple[int] = struct.unpack('=' + 'i' * dim_count, in_file.read(dim_count * 4))
+        # ggml order to PyTorch
+        shape: List[int] = [d for d in reversed(shape)]
+
+        key: str = in_file.read(key_length).decode('utf-8')
+
+        yield key, data_type, shape, read_data(data_type, shape)
+
 def main() -> None:
     args = parse_args()
 
@@ -62,40 +117,22 @@ def main() -> None:
 
         if header[0] != 0x67676d66:
             raise ValueError(f'Invalid magic value {header[0]:x}')
-        if not (100 <= header[1] <= 101):
+        if not (100 <= header[1] <= FILE_VERSION_2):
             raise ValueError(f'Invalid version number {header[1]}')
         if not (header[5] == 0 or header[5] == 1):
             raise ValueError('Only FP32 and FP16 models are supported')
 
-        out_file.write(struct.pack('=iiiiii', *header))
-
-        while True:
-            parameter_header_bytes: bytes = in_file.read(3 * 4)
+        # Parameters are written one after another, as in version 101 files, which rwkv.cpp and the quantizer read too.
+        out_header: List[int] = list(header)
+        out_header[1] = min(header[1], 101)
 
-            if len(parameter_header_bytes) == 0:
-                break
-
-            dim_count, key_length, data_type = struct.unpack('=iii', parameter_header_bytes)
-
-            # noinspection PyTypeChecker
-            shape: Tuple[int] = struct.unpack('=' + 'i' * dim_count, in_file.read(dim_count * 4))
-            # ggml order to PyTorch
-            shape: List[int] = [d for d in reversed(shape)]
-
-            key: str = in_file.read(key_length).decode('utf-8')
+        out_file.write(struct.pack('=iiiiii', *out_header))
 
+        for key, data_type, shape, data in read_parameters(in_file, header[1]):
             print(f'* {key} {shape}')
 
-            if not (data_type == 0 or data_type == 1):
-                raise ValueError('Only FP32 and FP16 models are supported')
-
-            element_count: int = 1
-
-            for dim in shape:
-                element_count *= dim
-
             parameter_np: np.ndarray = np.frombuffer(
-                in_file.read((2 if data_type == 1 else 4) * element_count),
+                data,
                 dtype=(np.half if data_type == 1 else np.single)
             )
 
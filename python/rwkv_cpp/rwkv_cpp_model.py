@@ -1,4 +1,6 @@
 import os
+import ctypes
+import weakref
 import multiprocessing
 
 # Pre-import PyTorch, if available.
@@ -14,9 +16,11 @@ try:
 except ModuleNotFoundError:
     from . import rwkv_cpp_shared_library
 
-from typing import TypeVar, Optional, Tuple, List
+from typing import TypeVar, Optional, Tuple, List, Dict
 
 # A value of this type is either a numpy's ndarray or a PyTorch's Tensor.
+# Tensors received as parameters may also be any CPU array supporting DLPack, or any writable object supporting the buffer protocol;
+# they are never copied, and tensors returned in such case are numpy's ndarrays.
 NumpyArrayOrPyTorchTensor: TypeVar = TypeVar('NumpyArrayOrPyTorchTensor')
 
 class RWKVModel:
@@ -68,6 +72,11 @@ class RWKVModel:
         self._state_buffer_element_count: int = self._library.rwkv_get_state_buffer_element_count(self._ctx)
         self._logits_buffer_element_count: int = self._library.rwkv_get_logits_buffer_element_count(self._ctx)
 
+        # Device-resident states created by this model, which must be freed before it.
+        self._states: weakref.WeakSet = weakref.WeakSet()
+
+        self._default_sampling_params: rwkv_cpp_shared_library.RWKVSamplingParams = self._library.rwkv_sampling_params_default()
+
         self._valid: bool = True
 
     @property
@@ -82,6 +91,14 @@ class RWKVModel:
     def n_layer(self) -> int:
         return self._library.rwkv_get_n_layer(self._ctx)
 
+    @property
+    def state_buffer_element_count(self) -> int:
+        return self._state_buffer_element_count
+
+    @property
+    def logits_buffer_element_count(self) -> int:
+        return self._logits_buffer_element_count
+
     def eval(
             self,
             token: int,
@@ -120,29 +137,16 @@ class RWKVModel:
 
         use_numpy = self._detect_numpy_usage([state_in, state_out, logits_out], use_numpy)
 
-        if state_in is not None:
-            self._validate_tensor(state_in, 'state_in', self._state_buffer_element_count)
-
-            state_in_ptr = self._get_data_ptr(state_in)
-        else:
-            state_in_ptr = 0
-
-        if state_out is not None:
-            self._validate_tensor(state_out, 'state_out', self._state_buffer_element_count)
-        else:
-            state_out = self._zeros_float32(self._state_buffer_element_count, use_numpy)
-
-        if logits_out is not None:
-            self._validate_tensor(logits_out, 'logits_out', self._logits_buffer_element_count)
-        else:
-            logits_out = self._zeros_float32(self._logits_buffer_element_count, use_numpy)
+        state_in_ptr = self._get_input_ptr(state_in, 'state_in', (self._state_buffer_element_count,))
+        state_out, state_out_ptr = self._prepare_output(state_out, 'state_out', (self._state_buffer_element_count,), use_numpy)
+        logits_out, logits_out_ptr = self._prepare_output(logits_out, 'logits_out', (self._logits_buffer_element_count,), use_numpy)
 
         self._library.rwkv_eval(
             self._ctx,
             token,
             state_in_ptr,
-            self._get_data_ptr(state_out),
-            self._get_data_ptr(logits_out)
+            state_out_ptr,
+            logits_out_ptr
         )
 
         return logits_out, state_out
@@ -195,29 +199,16 @@ class RWKVModel:
 
         use_numpy = self._detect_numpy_usage([state_in, state_out, logits_out], use_numpy)
 
-        if state_in is not None:
-            self._validate_tensor(state_in, 'state_in', self._state_buffer_element_count)
-
-            state_in_ptr = self._get_data_ptr(state_in)
-        else:
-            state_in_ptr = 0
-
-        if state_out is not None:
-            self._validate_tensor(state_out, 'state_out', self._state_buffer_element_count)
-        else:
-            state_out = self._zeros_float32(self._state_buffer_element_count, use_numpy)
-
-        if logits_out is not None:
-            self._validate_tensor(logits_out, 'logits_out', self._logits_buffer_element_count)
-        else:
-            logits_out = self._zeros_float32(self._logits_buffer_element_count, use_numpy)
+        state_in_ptr = self._get_input_ptr(state_in, 'state_in', (self._state_buffer_element_count,))
+        state_out, state_out_ptr = self._prepare_output(state_out, 'state_out', (self._state_buffer_element_count,), use_numpy)
+        logits_out, logits_out_ptr = self._prepare_output(logits_out, 'logits_out', (self._logits_buffer_element_count,), use_numpy)
 
         self._library.rwkv_eval_sequence(
             self._ctx,
             tokens,
             state_in_ptr,
-            self._get_data_ptr(state_out),
-            self._get_data_ptr(logits_out)
+            state_out_ptr,
+            logits_out_ptr
         )
 
         return logits_out, state_out
@@ -247,7 +238,7 @@ class RWKVModel:
         tokens : List[int]
             Indices of the next tokens to be seen by the model. Must be in range 0 <= token < n_vocab.
         chunk_size : int
-            Size of each chunk in tokens, must be positive.
+            Size of each chunk in tokens, or 0 to choose it automatically, see `rwkv_get_auto_chunk_size`.
         state_in : Optional[NumpyArrayOrTorchTensor]
             State from previous call of this method. If this is a first pass, set it to None.
         state_out : Optional[NumpyArrayOrTorchTensor]
@@ -270,37 +261,523 @@ class RWKVModel:
 
         use_numpy = self._detect_numpy_usage([state_in, state_out, logits_out], use_numpy)
 
-        if state_in is not None:
-            self._validate_tensor(state_in, 'state_in', self._state_buffer_element_count)
+        state_in_ptr = self._get_input_ptr(state_in, 'state_in', (self._state_buffer_element_count,))
+        state_out, state_out_ptr = self._prepare_output(state_out, 'state_out', (self._state_buffer_element_count,), use_numpy)
+        logits_out, logits_out_ptr = self._prepare_output(logits_out, 'logits_out', (self._logits_buffer_element_count,), use_numpy)
 
-            state_in_ptr = self._get_data_ptr(state_in)
-        else:
-            state_in_ptr = 0
+        self._library.rwkv_eval_sequence_in_chunks(
+            self._ctx,
+            tokens,
+            chunk_size,
+            state_in_ptr,
+            state_out_ptr,
+            logits_out_ptr
+        )
 
-        if state_out is not None:
-            self._validate_tensor(state_out, 'state_out', self._state_buffer_element_count)
-        else:
-            state_out = self._zeros_float32(self._state_buffer_element_count, use_numpy)
+        return logits_out, state_out
 
-        if logits_out is not None:
-            self._validate_tensor(logits_out, 'logits_out', self._logits_buffer_element_count)
-        else:
-            logits_out = self._zeros_float32(self._logits_buffer_element_count, use_numpy)
+    def eval_sequence_with_all_logits(
+            self,
+            tokens: List[int],
+            state_in: Optional[NumpyArrayOrPyTorchTensor],
+            state_out: Optional[NumpyArrayOrPyTorchTensor] = None,
+            logits_out: Optional[NumpyArrayOrPyTorchTensor] = None,
+            use_numpy: bool = False
+    ) -> Tuple[NumpyArrayOrPyTorchTensor, NumpyArrayOrPyTorchTensor]:
+        """
+        Same as `eval_sequence`, but returns the logits after every token of the sequence, not only after the last one.
+        Useful for scoring a sequence, or for verifying several drafted tokens in one pass.
+        In case of any error, this method will throw an exception.
 
-        self._library.rwkv_eval_sequence_in_chunks(
+        Parameters
+        ----------
+        tokens : List[int]
+            Indices of the next tokens to be seen by the model. Must be in range 0 <= token < n_vocab.
+        state_in : Optional[NumpyArrayOrTorchTensor]
+            State from previous call of this method. If this is a first pass, set it to None.
+        state_out : Optional[NumpyArrayOrTorchTensor]
+            Optional output tensor for state. If provided, must be of type float32, contiguous and of shape (state_buffer_element_count).
+        logits_out : Optional[NumpyArrayOrTorchTensor]
+            Optional output tensor for logits. If provided, must be of type float32, contiguous and of shape (len(tokens), logits_buffer_element_count).
+        use_numpy : bool
+            If set to True, numpy's ndarrays will be created instead of PyTorch's Tensors.
+            This parameter is ignored if any tensor parameter is not None; in such case,
+            type of returned tensors will match the type of received tensors.
+
+        Returns
+        -------
+        logits, state
+            Logits matrix of shape (len(tokens), n_vocab); state for the next step.
+        """
+
+        if not self._valid:
+            raise ValueError('Model was freed')
+
+        use_numpy = self._detect_numpy_usage([state_in, state_out, logits_out], use_numpy)
+
+        state_in_ptr = self._get_input_ptr(state_in, 'state_in', (self._state_buffer_element_count,))
+        state_out, state_out_ptr = self._prepare_output(state_out, 'state_out', (self._state_buffer_element_count,), use_numpy)
+        logits_out, logits_out_ptr = self._prepare_output(logits_out, 'logits_out', (len(tokens), self._logits_buffer_element_count), use_numpy)
+
+        self._library.rwkv_eval_sequence_with_all_logits(
             self._ctx,
             tokens,
-            chunk_size,
             state_in_ptr,
-            self._get_data_ptr(state_out),
-            self._get_data_ptr(logits_out)
+            state_out_ptr,
+            logits_out_ptr
         )
 
         return logits_out, state_out
 
+    def eval_batch(
+            self,
+            tokens: List[int],
+            states_in: Optional[NumpyArrayOrPyTorchTensor],
+            states_out: Optional[NumpyArrayOrPyTorchTensor] = None,
+            logits_out: Optional[NumpyArrayOrPyTorchTensor] = None,
+            use_numpy: bool = False
+    ) -> Tuple[NumpyArrayOrPyTorchTensor, NumpyArrayOrPyTorchTensor]:
+        """
+        Evaluates the model for one token in each of several independent states at once.
+        This is equivalent to calling `eval` for each state, but weight matrices are read only once per call,
+        so a single Python thread can drive a whole batch with one call per step.
+        In case of any error, this method will throw an exception.
+
+        Parameters
+        ----------
+        tokens : List[int]
+            One token for each state. Must be in range 0 <= token < n_vocab.
+        states_in : Optional[NumpyArrayOrTorchTensor]
+            States from previous call of this method, of shape (len(tokens), state_buffer_element_count). If this is a first pass, set it to None.
+        states_out : Optional[NumpyArrayOrTorchTensor]
+            Optional output tensor for states. If provided, must be of type float32, contiguous and of shape (len(tokens), state_buffer_element_count).
+            May be the same tensor as states_in.
+        logits_out : Optional[NumpyArrayOrTorchTensor]
+            Optional output tensor for logits. If provided, must be of type float32, contiguous and of shape (len(tokens), logits_buffer_element_count).
+        use_numpy : bool
+            If set to True, numpy's ndarrays will be created instead of PyTorch's Tensors.
+            This parameter is ignored if any tensor parameter is not None; in such case,
+            type of returned tensors will match the type of received tensors.
+
+        Returns
+        -------
+        logits, states
+            Logits matrix of shape (len(tokens), n_vocab); states for the next step.
+        """
+
+        if not self._valid:
+            raise ValueError('Model was freed')
+
+        use_numpy = self._detect_numpy_usage([states_in, states_out, logits_out], use_numpy)
+
+        batch_size: int = len(tokens)
+        state_shape: Tuple[int, int] = (batch_size, self._state_buffer_element_count)
+
+        states_in_ptr = self._get_input_ptr(states_in, 'states_in', state_shape)
+        states_out, states_out_ptr = self._prepare_output(states_out, 'states_out', state_shape, use_numpy)
+        logits_out, logits_out_ptr = self._prepare_output(logits_out, 'logits_out', (batch_size, self._logits_buffer_element_count), use_numpy)
+
+        self._library.rwkv_eval_batch(
+            self._ctx,
+            tokens,
+            None if states_in is None else self._row_addresses(states_in_ptr, batch_size, self._state_buffer_element_count),
+            self._row_addresses(states_out_ptr, batch_size, self._state_buffer_element_count),
+            self._row_addresses(logits_out_ptr, batch_size, self._logits_buffer_element_count)
+        )
+
+        return logits_out, states_out
+
+    def create_sampling_params(
+            self,
+            temperature: float = 1.0,
+            top_p: float = 1.0,
+            top_k: int = 0,
+            presence_penalty: float = 0.0,
+            frequency_penalty: float = 0.0,
+            penalty_tokens: Optional[List[int]] = None,
+            logit_bias: Optional[Dict[int, float]] = None
+    ) -> rwkv_cpp_shared_library.RWKVSamplingParams:
+        """
+        Creates sampling parameters for `eval_and_sample` and similar methods. They follow sampling.py.
+        The parameters can be reused for any count of calls; penalty tokens and logit bias can be changed in place
+        with `set_penalty_tokens` and `set_logit_bias`.
+
+        Parameters
+        ----------
+        temperature : float
+            Sampling temperature, must be >= 0. 0 always selects the most probable token.
+        top_p : float
+            Only the most probable tokens whose cumulative probability exceeds top_p are kept. 0 or 1 disable top-p.
+        top_k : int
+            Only top_k most probable tokens are kept. 0 disables top-k.
+        presence_penalty : float
+            Subtracted once from logits of each distinct token in penalty_tokens.
+        frequency_penalty : float
+            Subtracted from logits of tokens in penalty_tokens for each of their occurrences.
+        penalty_tokens : Optional[List[int]]
+            Tokens to penalize, with one element for each occurrence.
+        logit_bias : Optional[Dict[int, float]]
+            Values added to logits of tokens.
+        """
+
+        params = self._library.rwkv_sampling_params_default()
+        params.temperature = temperature
+        params.top_p = top_p
+        params.top_k = top_k
+        params.presence_penalty = presence_penalty
+        params.frequency_penalty = frequency_penalty
+
+        if penalty_tokens is not None:
+            params.set_penalty_tokens(penalty_tokens)
+
+        if logit_bias is not None:
+            params.set_logit_bias(logit_bias)
+
+        return params
+
+    def set_sampling_seed(self, seed: int) -> None:
+        """
+        Sets the seed of the random number generator used for sampling by this model.
+        """
+
+        if not self._valid:
+            raise ValueError('Model was freed')
+
+        self._library.rwkv_set_sampling_seed(self._ctx, seed)
+
+    def eval_and_sample(
+            self,
+            token: int,
+            state_in: Optional[NumpyArrayOrPyTorchTensor],
+            state_out: Optional[NumpyArrayOrPyTorchTensor] = None,
+            params: Optional[rwkv_cpp_shared_library.RWKVSamplingParams] = None,
+            use_numpy: bool = False
+    ) -> Tuple[int, NumpyArrayOrPyTorchTensor]:
+        """
+        Evaluates the model for a single token and samples the next token inside the library, so that logits are never copied to Python.
+        In case of any error, this method will throw an exception.
+
+        Parameters
+        ----------
+        token : int
+            Index of next token to be seen by the model. Must be in range 0 <= token < n_vocab.
+        state_in : Optional[NumpyArrayOrTorchTensor]
+            State from previous call of this method. If this is a first pass, set it to None.
+        state_out : Optional[NumpyArrayOrTorchTensor]
+            Optional output tensor for state. If provided, must be of type float32, contiguous and of shape (state_buffer_element_count).
+        params : Optional[RWKVSamplingParams]
+            Sampling parameters obtained from `create_sampling_params`. If not set, tokens are sampled with temperature 1.
+        use_numpy : bool
+            If set to True, numpy's ndarrays will be created instead of PyTorch's Tensors.
+            This parameter is ignored if any tensor parameter is not None; in such case,
+            type of returned tensors will match the type of received tensors.
+
+        Returns
+        -------
+        token, state
+            Sampled token; state for the next step.
+        """
+
+        if not self._valid:
+            raise ValueError('Model was freed')
+
+        use_numpy = self._detect_numpy_usage([state_in, state_out], use_numpy)
+
+        state_in_ptr = self._get_input_ptr(state_in, 'state_in', (self._state_buffer_element_count,))
+        state_out, state_out_ptr = self._prepare_output(state_out, 'state_out', (self._state_buffer_element_count,), use_numpy)
+
+        token = self._library.rwkv_eval_and_sample(
+            self._ctx,
+            token,
+            state_in_ptr,
+            state_out_ptr,
+            self._default_sampling_params if params is None else params
+        )
+
+        return token, state_out
+
+    def eval_sequence_and_sample(
+            self,
+            tokens: List[int],
+            state_in: Optional[NumpyArrayOrPyTorchTensor],
+            state_out: Optional[NumpyArrayOrPyTorchTensor] = None,
+            params: Optional[rwkv_cpp_shared_library.RWKVSamplingParams] = None,
+            use_numpy: bool = False
+    ) -> Tuple[int, NumpyArrayOrPyTorchTensor]:
+        """
+        Same as `eval_sequence`, but samples the token following the sequence instead of returning logits.
+        In case of any error, this method will throw an exception.
+
+        Parameters
+        ----------
+        tokens : List[int]
+            Indices of the next tokens to be seen by the model. Must be in range 0 <= token < n_vocab.
+        state_in : Optional[NumpyArrayOrTorchTensor]
+            State from previous call of this method. If this is a first pass, set it to None.
+        state_out : Optional[NumpyArrayOrTorchTensor]
+            Optional output tensor for state. If provided, must be of type float32, contiguous and of shape (state_buffer_element_count).
+        params : Optional[RWKVSamplingParams]
+            Sampling parameters obtained from `create_sampling_params`. If not set, tokens are sampled with temperature 1.
+        use_numpy : bool
+            If set to True, numpy's ndarrays will be created instead of PyTorch's Tensors.
+            This parameter is ignored if any tensor parameter is not None; in such case,
+            type of returned tensors will match the type of received tensors.
+
+        Returns
+        -------
+        token, state
+            Sampled token; state for the next step.
+        """
+
+        if not self._valid:
+            raise ValueError('Model was freed')
+
+        use_numpy = self._detect_numpy_usage([state_in, state_out], use_numpy)
+
+        state_in_ptr = self._get_input_ptr(state_in, 'state_in', (self._state_buffer_element_count,))
+        state_out, state_out_ptr = self._prepare_output(state_out, 'state_out', (self._state_buffer_element_count,), use_numpy)
+
+        token = self._library.rwkv_eval_sequence_and_sample(
+            self._ctx,
+            tokens,
+            state_in_ptr,
+            state_out_ptr,
+            self._default_sampling_params if params is None else params
+        )
+
+        return token, state_out
+
+    def speculative_decode(
+            self,
+            draft_model: 'RWKVModel',
+            token: int,
+            state: NumpyArrayOrPyTorchTensor,
+            draft_state: NumpyArrayOrPyTorchTensor,
+            draft_length: int = 4,
+            params: Optional[rwkv_cpp_shared_library.RWKVSamplingParams] = None
+    ) -> List[int]:
+        """
+        Generates tokens with speculative decoding: the draft model, usually a much smaller model with the same vocab, proposes draft_length tokens,
+        and this model checks all of them in one pass. Generated tokens are distributed as if they were sampled from this model.
+        States are updated in place to the states after the token and all generated tokens but the last one, which is the token of the next call.
+        In case of any error, this method will throw an exception.
+
+        Parameters
+        ----------
+        draft_model : RWKVModel
+            Model that drafts tokens.
+        token : int
+            The last token, which neither model has seen yet.
+        state : NumpyArrayOrTorchTensor
+            State of this model before the token, of type float32, contiguous and of shape (state_buffer_element_count).
+        draft_state : NumpyArrayOrTorchTensor
+            State of the draft model before the token, of type float32, contiguous and of shape (draft_model.state_buffer_element_count).
+        draft_length : int
+            Count of drafted tokens, must be positive.
+        params : Optional[RWKVSamplingParams]
+            Sampling parameters obtained from `create_sampling_params`. If not set, tokens are sampled with temperature 1.
+
+        Returns
+        -------
+        tokens
+            Between 1 and draft_length + 1 generated tokens.
+        """
+
+        if not self._valid or not draft_model._valid:
+            raise ValueError('Model was freed')
+
+        if not (draft_length > 0):
+            raise ValueError('Draft length must be > 0')
+
+        return self._library.rwkv_speculative_decode(
+            self._ctx,
+            draft_model._ctx,
+            token,
+            self._validate_tensor(state, 'state', (self._state_buffer_element_count,)),
+            draft_model._validate_tensor(draft_state, 'draft_state', (draft_model._state_buffer_element_count,)),
+            draft_length,
+            self._default_sampling_params if params is None else params
+        )
+
+    def init_state(self) -> 'RWKVDeviceState':
+        """
+        Creates a device-resident state, initialized as for a first pass.
+        Device-resident states stay in the memory of the backend between calls, so they are never copied to Python.
+        In case of any error, this method will throw an exception.
+        """
+
+        if not self._valid:
+            raise ValueError('Model was freed')
+
+        return RWKVDeviceState(self, self._library.rwkv_state_init(self._ctx))
+
+    def eval_with_state(
+            self,
+            token: int,
+            state: 'RWKVDeviceState',
+            logits_out: Optional[NumpyArrayOrPyTorchTensor] = None,
+            use_numpy: bool = False
+    ) -> NumpyArrayOrPyTorchTensor:
+        """
+        Same as `eval`, but reads the device-resident state and writes the new state back to it.
+        In case of any error, this method will throw an exception.
+
+        Parameters
+        ----------
+        token : int
+            Index of next token to be seen by the model. Must be in range 0 <= token < n_vocab.
+        state : RWKVDeviceState
+            State obtained from `init_state`, which is updated in place.
+        logits_out : Optional[NumpyArrayOrTorchTensor]
+            Optional output tensor for logits. If provided, must be of type float32, contiguous and of shape (logits_buffer_element_count).
+        use_numpy : bool
+            If set to True, numpy's ndarrays will be created instead of PyTorch's Tensors.
+            This parameter is ignored if logits_out is not None.
+
+        Returns
+        -------
+        logits
+            Logits vector of shape (n_vocab).
+        """
+
+        self._validate_state(state)
+
+        use_numpy = self._detect_numpy_usage([logits_out], use_numpy)
+
+        logits_out, logits_out_ptr = self._prepare_output(logits_out, 'logits_out', (self._logits_buffer_element_count,), use_numpy)
+
+        self._library.rwkv_eval_with_state(self._ctx, token, state._state, logits_out_ptr)
+
+        return logits_out
+
+    def eval_sequence_with_state(
+            self,
+            tokens: List[int],
+            state: 'RWKVDeviceState',
+            logits_out: Optional[NumpyArrayOrPyTorchTensor] = None,
+            use_numpy: bool = False
+    ) -> NumpyArrayOrPyTorchTensor:
+        """
+        Same as `eval_sequence`, but reads the device-resident state and writes the new state back to it.
+        In case of any error, this method will throw an exception.
+
+        Parameters
+        ----------
+        tokens : List[int]
+            Indices of the next tokens to be seen by the model. Must be in range 0 <= token < n_vocab.
+        state : RWKVDeviceState
+            State obtained from `init_state`, which is updated in place.
+        logits_out : Optional[NumpyArrayOrTorchTensor]
+            Optional output tensor for logits. If provided, must be of type float32, contiguous and of shape (logits_buffer_element_count).
+        use_numpy : bool
+            If set to True, numpy's ndarrays will be created instead of PyTorch's Tensors.
+            This parameter is ignored if logits_out is not None.
+
+        Returns
+        -------
+        logits
+            Logits vector of shape (n_vocab).
+        """
+
+        self._validate_state(state)
+
+        use_numpy = self._detect_numpy_usage([logits_out], use_numpy)
+
+        logits_out, logits_out_ptr = self._prepare_output(logits_out, 'logits_out', (self._logits_buffer_element_count,), use_numpy)
+
+        self._library.rwkv_eval_sequence_with_state(self._ctx, tokens, state._state, logits_out_ptr)
+
+        return logits_out
+
+    def eval_batch_with_states(
+            self,
+            tokens: List[int],
+            states: List['RWKVDeviceState'],
+            logits_out: Optional[NumpyArrayOrPyTorchTensor] = None,
+            use_numpy: bool = False
+    ) -> NumpyArrayOrPyTorchTensor:
+        """
+        Same as `eval_batch`, but reads device-resident states and writes the new states back to them.
+        Evaluating forks of one state this way scores several branches of a prompt with a single pass over the weights.
+        In case of any error, this method will throw an exception.
+
+        Parameters
+        ----------
+        tokens : List[int]
+            One token for each state. Must be in range 0 <= token < n_vocab.
+        states : List[RWKVDeviceState]
+            Different states obtained from `init_state` or `RWKVDeviceState.fork`, which are updated in place.
+        logits_out : Optional[NumpyArrayOrTorchTensor]
+            Optional output tensor for logits. If provided, must be of type float32, contiguous and of shape (len(tokens), logits_buffer_element_count).
+        use_numpy : bool
+            If set to True, numpy's ndarrays will be created instead of PyTorch's Tensors.
+            This parameter is ignored if logits_out is not None.
+
+        Returns
+        -------
+        logits
+            Logits matrix of shape (len(tokens), n_vocab).
+        """
+
+        if len(states) != len(tokens):
+            raise ValueError(f'Got {len(states)} states for {len(tokens)} tokens')
+
+        for state in states:
+            self._validate_state(state)
+
+        use_numpy = self._detect_numpy_usage([logits_out], use_numpy)
+
+        batch_size: int = len(tokens)
+
+        logits_out, logits_out_ptr = self._prepare_output(logits_out, 'logits_out', (batch_size, self._logits_buffer_element_count), use_numpy)
+
+        self._library.rwkv_eval_batch_with_states(
+            self._ctx,
+            tokens,
+            [state._state for state in states],
+            self._row_addresses(logits_out_ptr, batch_size, self._logits_buffer_element_count)
+        )
+
+        return logits_out
+
+    def eval_with_state_and_sample(
+            self,
+            token: int,
+            state: 'RWKVDeviceState',
+            params: Optional[rwkv_cpp_shared_library.RWKVSamplingParams] = None
+    ) -> int:
+        """
+        Same as `eval_and_sample`, but reads the device-resident state and writes the new state back to it.
+        Neither the state nor logits are copied to Python, which makes this the fastest way to generate tokens one by one.
+        In case of any error, this method will throw an exception.
+
+        Parameters
+        ----------
+        token : int
+            Index of next token to be seen by the model. Must be in range 0 <= token < n_vocab.
+        state : RWKVDeviceState
+            State obtained from `init_state`, which is updated in place.
+        params : Optional[RWKVSamplingParams]
+            Sampling parameters obtained from `create_sampling_params`. If not set, tokens are sampled with temperature 1.
+
+        Returns
+        -------
+        token
+            Sampled token.
+        """
+
+        self._validate_state(state)
+
+        return self._library.rwkv_eval_with_state_and_sample(
+            self._ctx,
+            token,
+            state._state,
+            self._default_sampling_params if params is None else params
+        )
+
     def free(self) -> None:
         """
-        Frees all allocated resources.
+        Frees all allocated resources, including device-resident states of this model that were not freed yet.
         In case of any error, this method will throw an exception.
         The object must not be used anymore after calling this method.
         """
@@ -308,6 +785,10 @@ class RWKVModel:
         if not self._valid:
             raise ValueError('Already freed')
 
+        # States must be freed before the context.
+        for state in list(self._states):
+            state.free()
+
         self._valid = False
 
         self._library.rwkv_free(self._ctx)
@@ -320,6 +801,9 @@ class RWKVModel:
     def _is_pytorch_tensor(self, tensor: NumpyArrayOrPyTorchTensor) -> bool:
         return hasattr(tensor, '__module__') and tensor.__module__ == 'torch'
 
+    def _is_numpy_array(self, tensor: NumpyArrayOrPyTorchTensor) -> bool:
+        return type(tensor).__module__ == 'numpy'
+
     def _detect_numpy_usage(self, tensors: List[Optional[NumpyArrayOrPyTorchTensor]], use_numpy_by_default: bool) -> bool:
         for tensor in tensors:
             if tensor is not None:
@@ -327,28 +811,81 @@ class RWKVModel:
 
         return use_numpy_by_default
 
-    def _validate_tensor(self, tensor: NumpyArrayOrPyTorchTensor, name: str, size: int) -> None:
+    def _validate_tensor(self, tensor: NumpyArrayOrPyTorchTensor, name: str, shape: Tuple[int, ...]) -> int:
+        # Returns the address of the first element, so that the tensor is inspected only once per call.
         if self._is_pytorch_tensor(tensor):
             tensor: torch.Tensor = tensor
-            
+
             if tensor.device != torch.device('cpu'):
                 raise ValueError(f'{name} is not on CPU')
             if tensor.dtype != torch.float32:
                 raise ValueError(f'{name} is not of type float32')
-            if tensor.shape != (size,):
-                raise ValueError(f'{name} has invalid shape {tensor.shape}, expected ({size})')
+            if tensor.shape != shape:
+                raise ValueError(f'{name} has invalid shape {tensor.shape}, expected {shape}')
             if not tensor.is_contiguous():
                 raise ValueError(f'{name} is not contiguous')
-        else:
+
+            return tensor.data_ptr()
+        elif self._is_numpy_array(tensor):
             import numpy as np
             tensor: np.ndarray = tensor
 
             if tensor.dtype != np.float32:
                 raise ValueError(f'{name} is not of type float32')
-            if tensor.shape != (size,):
-                raise ValueError(f'{name} has invalid shape {tensor.shape}, expected ({size})')
-            if not tensor.data.contiguous:
+            if tensor.shape != shape:
+                raise ValueError(f'{name} has invalid shape {tensor.shape}, expected {shape}')
+            if not tensor.flags.c_contiguous:
+                raise ValueError(f'{name} is not contiguous')
+
+            return tensor.ctypes.data
+        elif hasattr(tensor, '__dlpack__'):
+            # Arrays of other libraries are viewed, not copied; numpy only accepts arrays that are in CPU memory.
+            import numpy as np
+
+            return self._validate_tensor(np.from_dlpack(tensor), name, shape)
+        else:
+            # Any writable object supporting the buffer protocol, like array.array('f') or a memoryview of a shared memory block.
+            view: memoryview = memoryview(tensor)
+
+            if view.format not in ('f', '<f', '=f'):
+                raise ValueError(f'{name} is not of type float32')
+            if view.shape != shape:
+                raise ValueError(f'{name} has invalid shape {view.shape}, expected {shape}')
+            if not view.c_contiguous:
                 raise ValueError(f'{name} is not contiguous')
+            if view.readonly:
+                raise ValueError(f'{name} is read-only')
+
+            return ctypes.addressof(ctypes.c_char.from_buffer(view))
+
+    def _validate_state(self, state: 'RWKVDeviceState') -> None:
+        if not self._valid:
+            raise ValueError('Model was freed')
+        if state._model is not self:
+            raise ValueError('State was created by another model')
+        if not state._valid:
+            raise ValueError('State was freed')
+
+    def _get_input_ptr(self, tensor: Optional[NumpyArrayOrPyTorchTensor], name: str, shape: Tuple[int, ...]) -> int:
+        return 0 if tensor is None else self._validate_tensor(tensor, name, shape)
+
+    def _prepare_output(
+            self,
+            tensor: Optional[NumpyArrayOrPyTorchTensor],
+            name: str,
+            shape: Tuple[int, ...],
+            use_numpy: bool
+    ) -> Tuple[NumpyArrayOrPyTorchTensor, int]:
+        if tensor is not None:
+            return tensor, self._validate_tensor(tensor, name, shape)
+
+        # The library writes every element, so new tensors do not need to be zeroed.
+        tensor = self._empty_float32(shape, use_numpy)
+
+        return tensor, self._get_data_ptr(tensor)
+
+    def _row_addresses(self, ptr: int, row_count: int, row_length: int) -> List[int]:
+        return [ptr + i * row_length * ctypes.sizeof(ctypes.c_float) for i in range(row_count)]
 
     def _get_data_ptr(self, tensor: NumpyArrayOrPyTorchTensor):
         if self._is_pytorch_tensor(tensor):
@@ -356,9 +893,90 @@ class RWKVModel:
         else:
             return tensor.ctypes.data
 
-    def _zeros_float32(self, element_count: int, use_numpy: bool) -> NumpyArrayOrPyTorchTensor:
+    def _empty_float32(self, shape: Tuple[int, ...], use_numpy: bool) -> NumpyArrayOrPyTorchTensor:
         if use_numpy:
             import numpy as np
-            return np.zeros(element_count, dtype=np.float32)
+            return np.empty(shape, dtype=np.float32)
         else:
-            return torch.zeros(element_count, dtype=torch.float32, device='cpu')
+            return torch.empty(shape, dtype=torch.float32, device='cpu')
+
+class RWKVDeviceState:
+    """
+    A state of an RWKV model that stays in the memory of the backend between calls, created by `RWKVModel.init_state`.
+    Forks of a state share its memory until either of them is written to.
+    """
+
+    def __init__(self, model: RWKVModel, state: rwkv_cpp_shared_library.RWKVState) -> None:
+        self._model: RWKVModel = model
+        self._state: rwkv_cpp_shared_library.RWKVState = state
+        self._valid: bool = True
+
+        model._states.add(self)
+
+    def fork(self) -> 'RWKVDeviceState':
+        """
+        Creates a state with the same values as this one, without copying them.
+        In case of any error, this method will throw an exception.
+        """
+
+        self._model._validate_state(self)
+
+        return RWKVDeviceState(self._model, self._model._library.rwkv_state_fork(self._model._ctx, self._state))
+
+    def upload(self, state_in: Optional[NumpyArrayOrPyTorchTensor]) -> None:
+        """
+        Copies a state into this state.
+        In case of any error, this method will throw an exception.
+
+        Parameters
+        ----------
+        state_in : Optional[NumpyArrayOrTorchTensor]
+            State of type float32, contiguous and of shape (state_buffer_element_count); or None, to reset the state.
+        """
+
+        self._model._validate_state(self)
+
+        state_in_ptr = self._model._get_input_ptr(state_in, 'state_in', (self._model._state_buffer_element_count,))
+
+        self._model._library.rwkv_state_upload(self._model._ctx, self._state, None if state_in is None else state_in_ptr)
+
+    def download(self, state_out: Optional[NumpyArrayOrPyTorchTensor] = None, use_numpy: bool = False) -> NumpyArrayOrPyTorchTensor:
+        """
+        Copies this state out of the backend.
+        In case of any error, this method will throw an exception.
+
+        Parameters
+        ----------
+        state_out : Optional[NumpyArrayOrTorchTensor]
+            Optional output tensor for state. If provided, must be of type float32, contiguous and of shape (state_buffer_element_count).
+        use_numpy : bool
+            If set to True, numpy's ndarrays will be created instead of PyTorch's Tensors.
+            This parameter is ignored if state_out is not None.
+        """
+
+        self._model._validate_state(self)
+
+        use_numpy = self._model._detect_numpy_usage([state_out], use_numpy)
+
+        state_out, state_out_ptr = self._model._prepare_output(state_out, 'state_out', (self._model._state_buffer_element_count,), use_numpy)
+
+        self._model._library.rwkv_state_download(self._model._ctx, self._state, state_out_ptr)
+
+        return state_out
+
+    def free(self) -> None:
+        """
+        Frees the state. The object must not be used anymore after calling this method.
+        """
+
+        if not self._valid:
+            raise ValueError('Already freed')
+
+        self._valid = False
+        self._model._states.discard(self)
+
+        self._model._library.rwkv_state_free(self._state)
+
+    def __del__(self) -> None:
+        if hasattr(self, '_valid') and self._valid:
+            self.free()
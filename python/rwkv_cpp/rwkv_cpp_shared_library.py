@@ -3,7 +3,7 @@ import sys
 import ctypes
 import pathlib
 import platform
-from typing import Optional, List, Tuple, Callable
+from typing import Optional, List, Tuple, Callable, Dict
 
 QUANTIZED_FORMAT_NAMES: Tuple[str, str, str, str, str] = (
     'Q4_0',
@@ -18,14 +18,82 @@ QUANTIZED_FORMAT_NAMES: Tuple[str, str, str, str, str] = (
 P_FLOAT = ctypes.POINTER(ctypes.c_float)
 P_INT = ctypes.POINTER(ctypes.c_int32)
 
+P_P_FLOAT = ctypes.POINTER(P_FLOAT)
+P_SIZE_T = ctypes.POINTER(ctypes.c_size_t)
+
 class RWKVContext:
 
     def __init__(self, ptr: ctypes.pointer) -> None:
         self.ptr: ctypes.pointer = ptr
 
+class RWKVState:
+    """
+    A device-resident state, see `rwkv_state_init`.
+    """
+
+    def __init__(self, ptr: ctypes.pointer) -> None:
+        self.ptr: ctypes.pointer = ptr
+
+class RWKVSamplingParams(ctypes.Structure):
+    """
+    Mirrors `struct rwkv_sampling_params` from rwkv.h.
+    Use `set_penalty_tokens` and `set_logit_bias` instead of setting the pointer fields directly,
+    so that the arrays stay alive as long as the parameters.
+    """
+
+    _fields_ = [
+        ('temperature', ctypes.c_float),
+        ('top_p', ctypes.c_float),
+        ('top_k', ctypes.c_uint32),
+        ('presence_penalty', ctypes.c_float),
+        ('frequency_penalty', ctypes.c_float),
+        ('penalty_tokens', P_INT),
+        ('penalty_token_count', ctypes.c_size_t),
+        ('logit_bias_tokens', P_INT),
+        ('logit_bias_values', P_FLOAT),
+        ('logit_bias_count', ctypes.c_size_t)
+    ]
+
+    def set_penalty_tokens(self, tokens: List[int]) -> None:
+        """
+        Sets tokens whose logits are decreased by presence and frequency penalties, with one element for each occurrence.
+        """
+
+        self._penalty_tokens = (ctypes.c_int32 * len(tokens))(*tokens)
+        self.penalty_tokens = ctypes.cast(self._penalty_tokens, P_INT)
+        self.penalty_token_count = len(tokens)
+
+    def set_logit_bias(self, logit_bias: Dict[int, float]) -> None:
+        """
+        Sets values that are added to logits of tokens.
+        """
+
+        self._logit_bias_tokens = (ctypes.c_int32 * len(logit_bias))(*logit_bias.keys())
+        self._logit_bias_values = (ctypes.c_float * len(logit_bias))(*logit_bias.values())
+        self.logit_bias_tokens = ctypes.cast(self._logit_bias_tokens, P_INT)
+        self.logit_bias_values = ctypes.cast(self._logit_bias_values, P_FLOAT)
+        self.logit_bias_count = len(logit_bias)
+
+P_SAMPLING_PARAMS = ctypes.POINTER(RWKVSamplingParams)
+
+def _token_array(tokens: List[int]) -> P_INT:
+    return ctypes.cast((ctypes.c_int32 * len(tokens))(*tokens), P_INT)
+
+def _address_array(addresses: List[Optional[int]]) -> P_P_FLOAT:
+    return ctypes.cast((P_FLOAT * len(addresses))(*[ctypes.cast(0 if address is None else address, P_FLOAT) for address in addresses]), P_P_FLOAT)
+
+def _validate_batch_list(values: Optional[list], name: str, batch_size: int) -> None:
+    # The library reads batch_size elements of each array, so a shorter list would be read past its end.
+    if values is not None and len(values) != batch_size:
+        raise ValueError(f'Got {len(values)} {name} for {batch_size} tokens')
+
 class RWKVSharedLibrary:
     """
     Python wrapper around rwkv.cpp shared library.
+
+    The library is loaded with ctypes.CDLL, which releases the GIL for the duration of every call, so evaluating
+    a model in one Python thread does not block other threads. Buffers are passed by address and never copied:
+    passing the same state and logits buffers to every call avoids allocations in generation loops.
     """
 
     def __init__(self, shared_library_path: str) -> None:
@@ -79,6 +147,129 @@ class RWKVSharedLibrary:
         ]
         self.library.rwkv_eval_sequence_in_chunks.restype = ctypes.c_bool
 
+        self.library.rwkv_eval_sequence_with_all_logits.argtypes = [
+            ctypes.c_void_p, # ctx
+            P_INT, # tokens
+            ctypes.c_size_t, # token count
+            P_FLOAT, # state_in
+            P_FLOAT, # state_out
+            P_FLOAT  # logits_out
+        ]
+        self.library.rwkv_eval_sequence_with_all_logits.restype = ctypes.c_bool
+
+        self.library.rwkv_eval_sequence_with_all_states.argtypes = [
+            ctypes.c_void_p, # ctx
+            P_INT, # tokens
+            ctypes.c_size_t, # token count
+            P_FLOAT, # state_in
+            P_FLOAT, # states_out
+            P_FLOAT  # logits_out
+        ]
+        self.library.rwkv_eval_sequence_with_all_states.restype = ctypes.c_bool
+
+        self.library.rwkv_eval_batch.argtypes = [
+            ctypes.c_void_p, # ctx
+            P_INT, # tokens
+            ctypes.c_size_t, # batch size
+            P_P_FLOAT, # states_in
+            P_P_FLOAT, # states_out
+            P_P_FLOAT  # logits_out
+        ]
+        self.library.rwkv_eval_batch.restype = ctypes.c_bool
+
+        self.library.rwkv_get_auto_chunk_size.argtypes = [ctypes.c_void_p]
+        self.library.rwkv_get_auto_chunk_size.restype = ctypes.c_size_t
+
+        self.library.rwkv_state_init.argtypes = [ctypes.c_void_p]
+        self.library.rwkv_state_init.restype = ctypes.c_void_p
+
+        self.library.rwkv_state_fork.argtypes = [ctypes.c_void_p, ctypes.c_void_p]
+        self.library.rwkv_state_fork.restype = ctypes.c_void_p
+
+        self.library.rwkv_state_upload.argtypes = [ctypes.c_void_p, ctypes.c_void_p, P_FLOAT]
+        self.library.rwkv_state_upload.restype = ctypes.c_bool
+
+        self.library.rwkv_state_download.argtypes = [ctypes.c_void_p, ctypes.c_void_p, P_FLOAT]
+        self.library.rwkv_state_download.restype = ctypes.c_bool
+
+        self.library.rwkv_eval_with_state.argtypes = [
+            ctypes.c_void_p, # ctx
+            ctypes.c_int32, # token
+            ctypes.c_void_p, # state
+            P_FLOAT  # logits_out
+        ]
+        self.library.rwkv_eval_with_state.restype = ctypes.c_bool
+
+        self.library.rwkv_eval_sequence_with_state.argtypes = [
+            ctypes.c_void_p, # ctx
+            P_INT, # tokens
+            ctypes.c_size_t, # token count
+            ctypes.c_void_p, # state
+            P_FLOAT  # logits_out
+        ]
+        self.library.rwkv_eval_sequence_with_state.restype = ctypes.c_bool
+
+        self.library.rwkv_eval_batch_with_states.argtypes = [
+            ctypes.c_void_p, # ctx
+            P_INT, # tokens
+            ctypes.c_size_t, # batch size
+            ctypes.POINTER(ctypes.c_void_p), # states
+            P_P_FLOAT  # logits_out
+        ]
+        self.library.rwkv_eval_batch_with_states.restype = ctypes.c_bool
+
+        self.library.rwkv_state_free.argtypes = [ctypes.c_void_p]
+        self.library.rwkv_state_free.restype = None
+
+        self.library.rwkv_sampling_params_default.argtypes = []
+        self.library.rwkv_sampling_params_default.restype = RWKVSamplingParams
+
+        self.library.rwkv_set_sampling_seed.argtypes = [ctypes.c_void_p, ctypes.c_uint64]
+        self.library.rwkv_set_sampling_seed.restype = None
+
+        self.library.rwkv_eval_and_sample.argtypes = [
+            ctypes.c_void_p, # ctx
+            ctypes.c_int32, # token
+            P_FLOAT, # state_in
+            P_FLOAT, # state_out
+            P_SAMPLING_PARAMS, # params
+            P_INT  # token_out
+        ]
+        self.library.rwkv_eval_and_sample.restype = ctypes.c_bool
+
+        self.library.rwkv_eval_with_state_and_sample.argtypes = [
+            ctypes.c_void_p, # ctx
+            ctypes.c_int32, # token
+            ctypes.c_void_p, # state
+            P_SAMPLING_PARAMS, # params
+            P_INT  # token_out
+        ]
+        self.library.rwkv_eval_with_state_and_sample.restype = ctypes.c_bool
+
+        self.library.rwkv_eval_sequence_and_sample.argtypes = [
+            ctypes.c_void_p, # ctx
+            P_INT, # tokens
+            ctypes.c_size_t, # token count
+            P_FLOAT, # state_in
+            P_FLOAT, # state_out
+            P_SAMPLING_PARAMS, # params
+            P_INT  # token_out
+        ]
+        self.library.rwkv_eval_sequence_and_sample.restype = ctypes.c_bool
+
+        self.library.rwkv_speculative_decode.argtypes = [
+            ctypes.c_void_p, # target_ctx
+            ctypes.c_void_p, # draft_ctx
+            ctypes.c_int32, # token
+            P_FLOAT, # target_state
+            P_FLOAT, # draft_state
+            ctypes.c_size_t, # draft length
+            P_SAMPLING_PARAMS, # params
+            P_INT, # tokens_out
+            P_SIZE_T  # n_tokens_out
+        ]
+        self.library.rwkv_speculative_decode.restype = ctypes.c_bool
+
         self.library.rwkv_get_n_vocab.argtypes = [ctypes.c_void_p]
         self.library.rwkv_get_n_vocab.restype = ctypes.c_size_t
 
@@ -241,7 +432,7 @@ class RWKVSharedLibrary:
         tokens : List[int]
             Next token indices, in range 0 <= token < n_vocab.
         chunk_size : int
-            Size of each chunk in tokens, must be positive.
+            Size of each chunk in tokens, or 0 to use `rwkv_get_auto_chunk_size`.
         state_in_address : int
             Address of the first element of a FP32 buffer of size rwkv_get_state_buffer_element_count; or None, if this is a first pass.
         state_out_address : int
@@ -261,6 +452,489 @@ class RWKVSharedLibrary:
         ):
             raise ValueError('rwkv_eval_sequence_in_chunks failed, check stderr')
 
+    def rwkv_eval_sequence_with_all_logits(
+            self,
+            ctx: RWKVContext,
+            tokens: List[int],
+            state_in_address: Optional[int],
+            state_out_address: Optional[int],
+            logits_out_address: int
+    ) -> None:
+        """
+        Same as `rwkv_eval_sequence`, but writes the logits after every token of the sequence, not only after the last one.
+        Throws an exception in case of any error. Error messages would be printed to stderr.
+
+        Parameters
+        ----------
+        ctx : RWKVContext
+            RWKV context obtained from rwkv_init_from_file.
+        tokens : List[int]
+            Next token indices, in range 0 <= token < n_vocab.
+        state_in_address : int
+            Address of the first element of a FP32 buffer of size rwkv_get_state_buffer_element_count; or None, if this is a first pass.
+        state_out_address : int
+            Address of the first element of a FP32 buffer of size rwkv_get_state_buffer_element_count; or None. This buffer will be written to.
+        logits_out_address : int
+            Address of the first element of a FP32 buffer of size len(tokens) * rwkv_get_logits_buffer_element_count. This buffer will be written to.
+        """
+
+        if not self.library.rwkv_eval_sequence_with_all_logits(
+            ctx.ptr,
+            _token_array(tokens),
+            ctypes.c_size_t(len(tokens)),
+            ctypes.cast(0 if state_in_address is None else state_in_address, P_FLOAT),
+            ctypes.cast(0 if state_out_address is None else state_out_address, P_FLOAT),
+            ctypes.cast(logits_out_address, P_FLOAT)
+        ):
+            raise ValueError('rwkv_eval_sequence_with_all_logits failed, check stderr')
+
+    def rwkv_eval_sequence_with_all_states(
+            self,
+            ctx: RWKVContext,
+            tokens: List[int],
+            state_in_address: Optional[int],
+            states_out_address: int,
+            logits_out_address: Optional[int]
+    ) -> None:
+        """
+        Same as `rwkv_eval_sequence_with_all_logits`, but also writes the state after every token of the sequence.
+        Throws an exception in case of any error. Error messages would be printed to stderr.
+
+        Parameters
+        ----------
+        ctx : RWKVContext
+            RWKV context obtained from rwkv_init_from_file.
+        tokens : List[int]
+            Next token indices, in range 0 <= token < n_vocab.
+        state_in_address : int
+            Address of the first element of a FP32 buffer of size rwkv_get_state_buffer_element_count; or None, if this is a first pass.
+        states_out_address : int
+            Address of the first element of a FP32 buffer of size len(tokens) * rwkv_get_state_buffer_element_count. This buffer will be written to.
+        logits_out_address : int
+            Address of the first element of a FP32 buffer of size len(tokens) * rwkv_get_logits_buffer_element_count; or None, to skip computing logits. This buffer will be written to.
+        """
+
+        if not self.library.rwkv_eval_sequence_with_all_states(
+            ctx.ptr,
+            _token_array(tokens),
+            ctypes.c_size_t(len(tokens)),
+            ctypes.cast(0 if state_in_address is None else state_in_address, P_FLOAT),
+            ctypes.cast(states_out_address, P_FLOAT),
+            ctypes.cast(0 if logits_out_address is None else logits_out_address, P_FLOAT)
+        ):
+            raise ValueError('rwkv_eval_sequence_with_all_states failed, check stderr')
+
+    def rwkv_eval_batch(
+            self,
+            ctx: RWKVContext,
+            tokens: List[int],
+            state_in_addresses: Optional[List[Optional[int]]],
+            state_out_addresses: List[Optional[int]],
+            logits_out_addresses: Optional[List[Optional[int]]]
+    ) -> None:
+        """
+        Evaluates the model for one token in each of several independent states at once, reading weight matrices only once.
+        Throws an exception in case of any error. Error messages would be printed to stderr.
+
+        Parameters
+        ----------
+        ctx : RWKVContext
+            RWKV context obtained from rwkv_init_from_file.
+        tokens : List[int]
+            One token for each state, in range 0 <= token < n_vocab.
+        state_in_addresses : List[Optional[int]]
+            Addresses of len(tokens) FP32 buffers of size rwkv_get_state_buffer_element_count; None elements, or None, mean a first pass.
+        state_out_addresses : List[Optional[int]]
+            Addresses of len(tokens) FP32 buffers of size rwkv_get_state_buffer_element_count. Buffers that are not None will be written to.
+        logits_out_addresses : List[Optional[int]]
+            Addresses of len(tokens) FP32 buffers of size rwkv_get_logits_buffer_element_count; or None, if logits are not needed.
+            Buffers that are not None will be written to.
+        """
+
+        _validate_batch_list(state_in_addresses, 'state_in_addresses', len(tokens))
+        _validate_batch_list(state_out_addresses, 'state_out_addresses', len(tokens))
+        _validate_batch_list(logits_out_addresses, 'logits_out_addresses', len(tokens))
+
+        if not self.library.rwkv_eval_batch(
+            ctx.ptr,
+            _token_array(tokens),
+            ctypes.c_size_t(len(tokens)),
+            ctypes.cast(0, P_P_FLOAT) if state_in_addresses is None else _address_array(state_in_addresses),
+            _address_array(state_out_addresses),
+            ctypes.cast(0, P_P_FLOAT) if logits_out_addresses is None else _address_array(logits_out_addresses)
+        ):
+            raise ValueError('rwkv_eval_batch failed, check stderr')
+
+    def rwkv_get_auto_chunk_size(self, ctx: RWKVContext) -> int:
+        """
+        Returns the chunk size that `rwkv_eval_sequence_in_chunks` uses when chunk_size is 0.
+        It is measured on the first call, which takes as long as evaluating several hundred tokens.
+
+        Parameters
+        ----------
+        ctx : RWKVContext
+            RWKV context obtained from rwkv_init_from_file.
+        """
+
+        return self.library.rwkv_get_auto_chunk_size(ctx.ptr)
+
+    def rwkv_state_init(self, ctx: RWKVContext) -> RWKVState:
+        """
+        Creates a device-resident state, initialized as by `rwkv_init_state`.
+        The state must be freed with `rwkv_state_free` before the context.
+        Throws an exception in case of any error. Error messages would be printed to stderr.
+
+        Parameters
+        ----------
+        ctx : RWKVContext
+            RWKV context obtained from rwkv_init_from_file.
+        """
+
+        ptr = self.library.rwkv_state_init(ctx.ptr)
+
+        if ptr is None:
+            raise ValueError('rwkv_state_init failed, check stderr')
+
+        return RWKVState(ptr)
+
+    def rwkv_state_fork(self, ctx: RWKVContext, state: RWKVState) -> RWKVState:
+        """
+        Creates a device-resident state with the same values as the given one, sharing its memory until either of them is written to.
+        Throws an exception in case of any error. Error messages would be printed to stderr.
+
+        Parameters
+        ----------
+        ctx : RWKVContext
+            RWKV context obtained from rwkv_init_from_file.
+        state : RWKVState
+            State obtained from rwkv_state_init or rwkv_state_fork.
+        """
+
+        ptr = self.library.rwkv_state_fork(ctx.ptr, state.ptr)
+
+        if ptr is None:
+            raise ValueError('rwkv_state_fork failed, check stderr')
+
+        return RWKVState(ptr)
+
+    def rwkv_state_upload(self, ctx: RWKVContext, state: RWKVState, state_in_address: Optional[int]) -> None:
+        """
+        Copies a state from the host into the device-resident state.
+        Throws an exception in case of any error. Error messages would be printed to stderr.
+
+        Parameters
+        ----------
+        ctx : RWKVContext
+            RWKV context obtained from rwkv_init_from_file.
+        state : RWKVState
+            State obtained from rwkv_state_init or rwkv_state_fork.
+        state_in_address : int
+            Address of the first element of a FP32 buffer of size rwkv_get_state_buffer_element_count; or None, to reset the state.
+        """
+
+        if not self.library.rwkv_state_upload(ctx.ptr, state.ptr, ctypes.cast(0 if state_in_address is None else state_in_address, P_FLOAT)):
+            raise ValueError('rwkv_state_upload failed, check stderr')
+
+    def rwkv_state_download(self, ctx: RWKVContext, state: RWKVState, state_out_address: int) -> None:
+        """
+        Copies the device-resident state to the host.
+        Throws an exception in case of any error. Error messages would be printed to stderr.
+
+        Parameters
+        ----------
+        ctx : RWKVContext
+            RWKV context obtained from rwkv_init_from_file.
+        state : RWKVState
+            State obtained from rwkv_state_init or rwkv_state_fork.
+        state_out_address : int
+            Address of the first element of a FP32 buffer of size rwkv_get_state_buffer_element_count. This buffer will be written to.
+        """
+
+        if not self.library.rwkv_state_download(ctx.ptr, state.ptr, ctypes.cast(state_out_address, P_FLOAT)):
+            raise ValueError('rwkv_state_download failed, check stderr')
+
+    def rwkv_eval_with_state(self, ctx: RWKVContext, token: int, state: RWKVState, logits_out_address: Optional[int]) -> None:
+        """
+        Same as `rwkv_eval`, but reads the device-resident state and writes the new state back to it.
+        Throws an exception in case of any error. Error messages would be printed to stderr.
+
+        Parameters
+        ----------
+        ctx : RWKVContext
+            RWKV context obtained from rwkv_init_from_file.
+        token : int
+            Next token index, in range 0 <= token < n_vocab.
+        state : RWKVState
+            State obtained from rwkv_state_init or rwkv_state_fork.
+        logits_out_address : int
+            Address of the first element of a FP32 buffer of size rwkv_get_logits_buffer_element_count; or None. This buffer will be written to.
+        """
+
+        if not self.library.rwkv_eval_with_state(
+            ctx.ptr,
+            ctypes.c_int32(token),
+            state.ptr,
+            ctypes.cast(0 if logits_out_address is None else logits_out_address, P_FLOAT)
+        ):
+            raise ValueError('rwkv_eval_with_state failed, check stderr')
+
+    def rwkv_eval_sequence_with_state(self, ctx: RWKVContext, tokens: List[int], state: RWKVState, logits_out_address: Optional[int]) -> None:
+        """
+        Same as `rwkv_eval_sequence`, but reads the device-resident state and writes the new state back to it.
+        Throws an exception in case of any error. Error messages would be printed to stderr.
+
+        Parameters
+        ----------
+        ctx : RWKVContext
+            RWKV context obtained from rwkv_init_from_file.
+        tokens : List[int]
+            Next token indices, in range 0 <= token < n_vocab.
+        state : RWKVState
+            State obtained from rwkv_state_init or rwkv_state_fork.
+        logits_out_address : int
+            Address of the first element of a FP32 buffer of size rwkv_get_logits_buffer_element_count; or None. This buffer will be written to.
+        """
+
+        if not self.library.rwkv_eval_sequence_with_state(
+            ctx.ptr,
+            _token_array(tokens),
+            ctypes.c_size_t(len(tokens)),
+            state.ptr,
+            ctypes.cast(0 if logits_out_address is None else logits_out_address, P_FLOAT)
+        ):
+            raise ValueError('rwkv_eval_sequence_with_state failed, check stderr')
+
+    def rwkv_eval_batch_with_states(
+            self,
+            ctx: RWKVContext,
+            tokens: List[int],
+            states: List[RWKVState],
+            logits_out_addresses: Optional[List[Optional[int]]]
+    ) -> None:
+        """
+        Same as `rwkv_eval_batch`, but reads device-resident states and writes the new states back to them.
+        Throws an exception in case of any error. Error messages would be printed to stderr.
+
+        Parameters
+        ----------
+        ctx : RWKVContext
+            RWKV context obtained from rwkv_init_from_file.
+        tokens : List[int]
+            One token for each state, in range 0 <= token < n_vocab.
+        states : List[RWKVState]
+            Different states obtained from rwkv_state_init or rwkv_state_fork, one for each token.
+        logits_out_addresses : List[Optional[int]]
+            Addresses of len(tokens) FP32 buffers of size rwkv_get_logits_buffer_element_count; or None, if logits are not needed.
+            Buffers that are not None will be written to.
+        """
+
+        _validate_batch_list(states, 'states', len(tokens))
+        _validate_batch_list(logits_out_addresses, 'logits_out_addresses', len(tokens))
+
+        if not self.library.rwkv_eval_batch_with_states(
+            ctx.ptr,
+            _token_array(tokens),
+            ctypes.c_size_t(len(tokens)),
+            (ctypes.c_void_p * len(states))(*[state.ptr for state in states]),
+            ctypes.cast(0, P_P_FLOAT) if logits_out_addresses is None else _address_array(logits_out_addresses)
+        ):
+            raise ValueError('rwkv_eval_batch_with_states failed, check stderr')
+
+    def rwkv_state_free(self, state: RWKVState) -> None:
+        """
+        Frees the device-resident state.
+
+        Parameters
+        ----------
+        state : RWKVState
+            State obtained from rwkv_state_init or rwkv_state_fork.
+        """
+
+        self.library.rwkv_state_free(state.ptr)
+
+        state.ptr = self.nullptr
+
+    def rwkv_sampling_params_default(self) -> RWKVSamplingParams:
+        """
+        Returns sampling parameters with temperature 1, top-p and top-k disabled, no penalties and no logit bias.
+        """
+
+        return self.library.rwkv_sampling_params_default()
+
+    def rwkv_set_sampling_seed(self, ctx: RWKVContext, seed: int) -> None:
+        """
+        Sets the seed of the random number generator used for sampling. Each context has its own generator.
+
+        Parameters
+        ----------
+        ctx : RWKVContext
+            RWKV context obtained from rwkv_init_from_file.
+        seed : int
+            Seed, in range 0 <= seed < 2 ** 64.
+        """
+
+        self.library.rwkv_set_sampling_seed(ctx.ptr, ctypes.c_uint64(seed))
+
+    def rwkv_eval_and_sample(
+            self,
+            ctx: RWKVContext,
+            token: int,
+            state_in_address: Optional[int],
+            state_out_address: Optional[int],
+            params: RWKVSamplingParams
+    ) -> int:
+        """
+        Same as `rwkv_eval`, but samples the next token instead of returning logits, so that logits never leave the library.
+        Returns the sampled token.
+        Throws an exception in case of any error. Error messages would be printed to stderr.
+
+        Parameters
+        ----------
+        ctx : RWKVContext
+            RWKV context obtained from rwkv_init_from_file.
+        token : int
+            Next token index, in range 0 <= token < n_vocab.
+        state_in_address : int
+            Address of the first element of a FP32 buffer of size rwkv_get_state_buffer_element_count; or None, if this is a first pass.
+        state_out_address : int
+            Address of the first element of a FP32 buffer of size rwkv_get_state_buffer_element_count; or None. This buffer will be written to.
+        params : RWKVSamplingParams
+            Sampling parameters obtained from rwkv_sampling_params_default.
+        """
+
+        token_out = ctypes.c_int32(0)
+
+        if not self.library.rwkv_eval_and_sample(
+            ctx.ptr,
+            ctypes.c_int32(token),
+            ctypes.cast(0 if state_in_address is None else state_in_address, P_FLOAT),
+            ctypes.cast(0 if state_out_address is None else state_out_address, P_FLOAT),
+            ctypes.byref(params),
+            ctypes.byref(token_out)
+        ):
+            raise ValueError('rwkv_eval_and_sample failed, check stderr')
+
+        return token_out.value
+
+    def rwkv_eval_with_state_and_sample(self, ctx: RWKVContext, token: int, state: RWKVState, params: RWKVSamplingParams) -> int:
+        """
+        Same as `rwkv_eval_and_sample`, but with a device-resident state.
+        Returns the sampled token.
+        Throws an exception in case of any error. Error messages would be printed to stderr.
+
+        Parameters
+        ----------
+        ctx : RWKVContext
+            RWKV context obtained from rwkv_init_from_file.
+        token : int
+            Next token index, in range 0 <= token < n_vocab.
+        state : RWKVState
+            State obtained from rwkv_state_init or rwkv_state_fork.
+        params : RWKVSamplingParams
+            Sampling parameters obtained from rwkv_sampling_params_default.
+        """
+
+        token_out = ctypes.c_int32(0)
+
+        if not self.library.rwkv_eval_with_state_and_sample(ctx.ptr, ctypes.c_int32(token), state.ptr, ctypes.byref(params), ctypes.byref(token_out)):
+            raise ValueError('rwkv_eval_with_state_and_sample failed, check stderr')
+
+        return token_out.value
+
+    def rwkv_eval_sequence_and_sample(
+            self,
+            ctx: RWKVContext,
+            tokens: List[int],
+            state_in_address: Optional[int],
+            state_out_address: Optional[int],
+            params: RWKVSamplingParams
+    ) -> int:
+        """
+        Same as `rwkv_eval_sequence`, but samples the token following the sequence instead of returning logits.
+        Returns the sampled token.
+        Throws an exception in case of any error. Error messages would be printed to stderr.
+
+        Parameters
+        ----------
+        ctx : RWKVContext
+            RWKV context obtained from rwkv_init_from_file.
+        tokens : List[int]
+            Next token indices, in range 0 <= token < n_vocab.
+        state_in_address : int
+            Address of the first element of a FP32 buffer of size rwkv_get_state_buffer_element_count; or None, if this is a first pass.
+        state_out_address : int
+            Address of the first element of a FP32 buffer of size rwkv_get_state_buffer_element_count; or None. This buffer will be written to.
+        params : RWKVSamplingParams
+            Sampling parameters obtained from rwkv_sampling_params_default.
+        """
+
+        token_out = ctypes.c_int32(0)
+
+        if not self.library.rwkv_eval_sequence_and_sample(
+            ctx.ptr,
+            _token_array(tokens),
+            ctypes.c_size_t(len(tokens)),
+            ctypes.cast(0 if state_in_address is None else state_in_address, P_FLOAT),
+            ctypes.cast(0 if state_out_address is None else state_out_address, P_FLOAT),
+            ctypes.byref(params),
+            ctypes.byref(token_out)
+        ):
+            raise ValueError('rwkv_eval_sequence_and_sample failed, check stderr')
+
+        return token_out.value
+
+    def rwkv_speculative_decode(
+            self,
+            target_ctx: RWKVContext,
+            draft_ctx: RWKVContext,
+            token: int,
+            target_state_address: int,
+            draft_state_address: int,
+            draft_length: int,
+            params: RWKVSamplingParams
+    ) -> List[int]:
+        """
+        Generates between 1 and draft_length + 1 tokens with speculative decoding, which are distributed as if they were sampled from the target model.
+        States are updated to the states after the token and all generated tokens but the last one, which is the token of the next call.
+        Returns the generated tokens.
+        Throws an exception in case of any error. Error messages would be printed to stderr.
+
+        Parameters
+        ----------
+        target_ctx : RWKVContext
+            RWKV context of the target model.
+        draft_ctx : RWKVContext
+            RWKV context of the draft model, which must have the same vocab.
+        token : int
+            The last token, which neither model has evaluated yet.
+        target_state_address : int
+            Address of the first element of a FP32 buffer with the state of the target model before the token. This buffer will be written to.
+        draft_state_address : int
+            Address of the first element of a FP32 buffer with the state of the draft model before the token. This buffer will be written to.
+        draft_length : int
+            Count of tokens drafted by the draft model, must be positive.
+        params : RWKVSamplingParams
+            Sampling parameters obtained from rwkv_sampling_params_default.
+        """
+
+        tokens_out = (ctypes.c_int32 * (draft_length + 1))()
+        n_tokens_out = ctypes.c_size_t(0)
+
+        if not self.library.rwkv_speculative_decode(
+            target_ctx.ptr,
+            draft_ctx.ptr,
+            ctypes.c_int32(token),
+            ctypes.cast(target_state_address, P_FLOAT),
+            ctypes.cast(draft_state_address, P_FLOAT),
+            ctypes.c_size_t(draft_length),
+            ctypes.byref(params),
+            ctypes.cast(tokens_out, P_INT),
+            ctypes.byref(n_tokens_out)
+        ):
+            raise ValueError('rwkv_speculative_decode failed, check stderr')
+
+        return tokens_out[:n_tokens_out.value]
+
     def rwkv_get_n_vocab(self, ctx: RWKVContext) -> int:
         """
         Returns the number of tokens in the given model's vocabulary.
@@ -19,13 +19,19 @@
 #endif
 
 #include <string>
+#include <algorithm>
+#include <atomic>
 #include <vector>
 #include <cstring>
 #include <cinttypes>
 #include <cmath>
 #include <fstream>
+#include <functional>
 #include <unordered_map>
+#include <list>
 #include <memory>
+#include <mutex>
+#include <thread>
 #include <utility>
 
 #define _FILE_OFFSET_BITS 64
@@ -48,6 +54,11 @@
 #        define ftell ftello
 #        define fseek fseeko
 #    endif
+#    include <unistd.h>
+#    if defined(_POSIX_MAPPED_FILES)
+#        include <sys/mman.h>
+#        define RWKV_MMAP_SUPPORTED
+#    endif
 #endif
 
 static_assert(sizeof(stat::st_size) >= 8, "File offsets should be 64-bit or else rwkv.cpp will not be able to load model files over 2 GB");
@@ -65,25 +76,89 @@ static_assert(sizeof(decltype(ftell(NULL))) >= 8, "File offsets should be 64-bit
 
 #include "rwkv_operators.inc"
 
+#include "rwkv_sampling.inc"
+
 #include "rwkv_graph.inc"
 
+#include "rwkv_layer_streaming.inc"
+
+#include "rwkv_profiling.inc"
+
+#include "rwkv_thread_pool.inc"
+
+// Creates the CPU backend of the context and the list of backends its graphs are scheduled on.
+static bool rwkv_init_context_backends(struct rwkv_context * ctx, struct rwkv_thread_pool * pool) {
+    ctx->cpu_backend = ggml_backend_cpu_init();
+    RWKV_ASSERT_FALSE_MSG(RWKV_ERROR_CTX | RWKV_ERROR_ALLOC, ctx->cpu_backend, "Failed to create CPU backend");
+
+    ctx->backends = ctx->model->backends;
+    ctx->backends.back() = ctx->cpu_backend;
+
+    rwkv_apply_thread_pool(ctx, pool);
+
+    return true;
+}
+
+// API function.
+struct rwkv_init_params rwkv_init_params_default(void) {
+    struct rwkv_init_params params;
+    params.n_threads = 1;
+    params.n_gpu_layers = 0;
+    params.use_mmap = true;
+    params.mmap_prefetch = true;
+    params.thread_pool = NULL;
+    params.n_stream_slots = 0;
+    params.gpu_memory_budget = 0;
+    params.n_gpu_devices = 1;
+    return params;
+}
+
 // API function.
 struct rwkv_context * rwkv_init_from_file(const char * file_path, const uint32_t n_threads, const uint32_t n_gpu_layers) {
+    struct rwkv_init_params params = rwkv_init_params_default();
+    params.n_threads = n_threads;
+    params.n_gpu_layers = n_gpu_layers;
+    return rwkv_init_from_file_with_params(file_path, &params);
+}
+
+// API function.
+struct rwkv_context * rwkv_init_from_file_with_params(const char * file_path, const struct rwkv_init_params * params) {
     global_last_error = RWKV_ERROR_NONE;
 
+    RWKV_ASSERT_NULL_MSG(RWKV_ERROR_ARGS, params, "Parameters are NULL");
+    RWKV_ASSERT_NULL_MSG(RWKV_ERROR_ARGS, params->n_stream_slots != 1, "At least 2 stream slots are needed");
+    RWKV_ASSERT_NULL_MSG(RWKV_ERROR_ARGS, params->n_gpu_devices > 0, "GPU device count is 0");
+
+    const uint32_t n_threads = params->thread_pool ? params->thread_pool->n_threads : params->n_threads;
+    const uint32_t n_gpu_layers = params->n_gpu_layers;
+
     std::unique_ptr<struct rwkv_context> ctx(new(std::nothrow) struct rwkv_context());
     RWKV_ASSERT_NULL_MSG(RWKV_ERROR_CTX | RWKV_ERROR_ALLOC, ctx, "Failed to allocate rwkv_context");
 
     ctx->model = new(std::nothrow) struct rwkv_model();
     ctx->model->reference_count++;
+    ctx->model->id = rwkv_next_model_id++;
 
     ctx->n_threads = n_threads;
+    ctx->sequential_graph_cache_capacity = rwkv_default_sequential_graph_cache_capacity;
+    ctx->batch_graph_cache_capacity = rwkv_default_batch_graph_cache_capacity;
+    ctx->sampler.rng_state = rwkv_default_sampling_seed;
 
-    if (n_gpu_layers) {
+    if (n_gpu_layers || params->gpu_memory_budget || params->n_stream_slots) {
         ggml_backend_t backend = nullptr;
 
 #ifdef GGML_USE_CUDA
-        backend = ggml_backend_cuda_init(0);
+        const int device_count = ggml_backend_cuda_get_device_count();
+        RWKV_ASSERT_NULL_MSG(RWKV_ERROR_ARGS, (int) params->n_gpu_devices <= device_count, "Only %d GPU devices are available", device_count);
+
+        // Devices before the last one; the last one is added below like the only device of other backends.
+        for (uint32_t device = 0; device + 1 < params->n_gpu_devices; device++) {
+            backend = ggml_backend_cuda_init((int) device);
+            RWKV_ENSURE_OR_NULL(backend);
+            ctx->model->backends.push_back(backend);
+        }
+
+        backend = ggml_backend_cuda_init(params->n_gpu_devices > 1 ? (int) params->n_gpu_devices - 1 : 0);
         RWKV_ENSURE_OR_NULL(backend);
 #endif
 
@@ -102,17 +177,51 @@ struct rwkv_context * rwkv_init_from_file(const char * file_path, const uint32_t
         }
     }
 
+    // Used for loading; contexts compute on their own CPU backends.
     ggml_backend_t cpu_backend = ggml_backend_cpu_init();
     RWKV_ENSURE_OR_NULL(cpu_backend);
-    ggml_backend_cpu_set_n_threads(cpu_backend, n_threads);
     ctx->model->backends.push_back(cpu_backend);
 
     int ngl = n_gpu_layers;
+    size_t gpu_memory_budget = params->gpu_memory_budget;
     if (ctx->model->backends.size() == 1) {
         ngl = 0;
+        gpu_memory_budget = 0;
     }
 
-    RWKV_ENSURE_OR_NULL(rwkv_load_model_from_file(file_path, *ctx->model, ngl));
+    // Offloaded layers are split between devices, and the head goes to the last one, so each device is planned against its own free memory.
+    std::vector<size_t> device_free_memory;
+
+    if (gpu_memory_budget) {
+        for (size_t i = 0; i + 1 < ctx->model->backends.size(); i++) {
+            ggml_backend_dev_t device = ggml_backend_get_device(ctx->model->backends[i]);
+            size_t free_memory = 0;
+
+            if (device) {
+                size_t total_memory = 0;
+                ggml_backend_dev_memory(device, &free_memory, &total_memory);
+            }
+
+            device_free_memory.push_back(free_memory);
+        }
+    }
+
+    RWKV_ENSURE_OR_NULL(rwkv_load_model_from_file(
+        file_path,
+        *ctx->model,
+        ngl,
+        gpu_memory_budget,
+        device_free_memory,
+        params->n_stream_slots,
+        params->use_mmap,
+        params->mmap_prefetch
+    ));
+
+    if (params->n_stream_slots) {
+        RWKV_ENSURE_OR_NULL(rwkv_init_layer_stream(*ctx->model, ctx->model->offload_plan.layer_count, params->n_stream_slots));
+    }
+
+    RWKV_ENSURE_OR_NULL(rwkv_init_context_backends(ctx.get(), params->thread_pool));
 
     RWKV_ENSURE_OR_NULL(rwkv_measure_and_build_serial_context(*ctx->model, ctx->serial_graph));
 
@@ -120,7 +229,41 @@ struct rwkv_context * rwkv_init_from_file(const char * file_path, const uint32_t
 }
 
 // API function.
-struct rwkv_context * rwkv_clone_context(struct rwkv_context * ctx, const uint32_t n_threads) {
+bool rwkv_read_file_info(const char * file_path, struct rwkv_file_info * info) {
+    global_last_error = RWKV_ERROR_NONE;
+
+    RWKV_ASSERT_FALSE_MSG(RWKV_ERROR_ARGS, info, "File info is NULL");
+
+    struct stat file_stat;
+    struct rwkv_file_header header;
+    struct rwkv_file_header_v2 header_v2;
+    std::vector<struct rwkv_tensor_entry> entries;
+
+    rwkv_file file(fopen(file_path, "rb"));
+
+    RWKV_ASSERT_FALSE_MSG(RWKV_ERROR_FILE | RWKV_ERROR_FILE_OPEN, file.file, "Failed to open file %s", file_path);
+    RWKV_ASSERT_FALSE_MSG(RWKV_ERROR_FILE | RWKV_ERROR_FILE_STAT, fstat(fileno(file.file), &file_stat) == 0, "Failed to stat file %s", file_path);
+    RWKV_ASSERT_FALSE_MSG(RWKV_ERROR_FILE, rwkv_fread_file_header(file.file, header), "Invalid file header");
+    RWKV_ASSERT_FALSE_MSG(
+        RWKV_ERROR_MODEL_PARAMS,
+        rwkv_fread_tensor_directory(file.file, header, file_stat.st_size, header_v2, entries),
+        "Failed to read model parameters"
+    );
+
+    info->file_version = header.version;
+    info->n_vocab = header.n_vocab;
+    info->n_embed = header.n_embed;
+    info->n_layer = header.n_layer;
+    info->arch_version_major = header_v2.arch_version_major;
+    info->arch_version_minor = header_v2.arch_version_minor;
+    info->data_type = rwkv_type_to_string[header.data_type];
+    info->tensor_count = header_v2.tensor_count;
+    info->alignment = header_v2.alignment;
+
+    return true;
+}
+
+static struct rwkv_context * rwkv_clone_context_impl(struct rwkv_context * ctx, const uint32_t n_threads, struct rwkv_thread_pool * pool) {
     std::unique_ptr<struct rwkv_context> clone(new(std::nothrow) struct rwkv_context());
     RWKV_ASSERT_NULL_MSG(RWKV_ERROR_CTX | RWKV_ERROR_ALLOC, clone, "Failed to allocate rwkv_context");
 
@@ -129,17 +272,39 @@ struct rwkv_context * rwkv_clone_context(struct rwkv_context * ctx, const uint32
 
     clone->n_threads = n_threads;
 
+    RWKV_ENSURE_OR_NULL(rwkv_init_context_backends(clone.get(), pool));
+
     RWKV_ENSURE_OR_NULL(rwkv_measure_and_build_serial_context(*clone->model, clone->serial_graph));
 
-    clone->last_used_sequence_length = 0;
+    clone->sequential_graph_cache_capacity = ctx->sequential_graph_cache_capacity;
+    clone->batch_graph_cache_capacity = ctx->batch_graph_cache_capacity;
+    clone->prefix_cache = ctx->prefix_cache;
+    clone->sampler.rng_state = rwkv_default_sampling_seed;
 
     clone->print_errors = ctx->print_errors;
 
     return clone.release();
 }
 
+// API function.
+struct rwkv_context * rwkv_clone_context(struct rwkv_context * ctx, const uint32_t n_threads) {
+    return rwkv_clone_context_impl(ctx, n_threads, NULL);
+}
+
+// API function.
+struct rwkv_context * rwkv_clone_context_with_thread_pool(struct rwkv_context * ctx, struct rwkv_thread_pool * pool) {
+    // Without a pool, the clone starts its own threads, as many as the context has.
+    return rwkv_clone_context_impl(ctx, pool ? pool->n_threads : ctx->n_threads, pool);
+}
+
+#include "rwkv_prefix_cache.inc"
+
 #include "rwkv_eval.inc"
 
+#include "rwkv_state_packing.inc"
+
+#include "rwkv_speculative_decoding.inc"
+
 // API function.
 // Provided for backwards compatibility.
 extern "C" RWKV_API uint32_t rwkv_get_state_buffer_element_count(const struct rwkv_context * ctx) {
@@ -183,6 +348,70 @@ size_t rwkv_get_logits_len(const struct rwkv_context * ctx) {
     return (size_t) ctx->model->header.n_vocab;
 }
 
+// API function.
+bool rwkv_get_token_embedding(struct rwkv_context * ctx, const uint32_t token, float * embedding) {
+    ctx->last_error = RWKV_ERROR_NONE;
+
+    const struct ggml_tensor * emb = ctx->model->emb;
+    const size_t n_embed = (size_t) ctx->model->header.n_embed;
+
+    RWKV_CTX_ASSERT_FALSE_MSG(ctx, RWKV_ERROR_ARGS, embedding, "Embedding buffer is NULL");
+    RWKV_CTX_ASSERT_FALSE_MSG(ctx, RWKV_ERROR_ARGS, token < ctx->model->header.n_vocab, "Token %" PRIu32 " is out of range", token);
+
+    // The embedding matrix is never quantized, see rwkv_quantize.inc.
+    switch (emb->type) {
+        case GGML_TYPE_F32:
+            ggml_backend_tensor_get(emb, embedding, token * emb->nb[1], n_embed * sizeof(float));
+            break;
+        case GGML_TYPE_F16: {
+            std::unique_ptr<ggml_fp16_t[]> row(new(std::nothrow) ggml_fp16_t[n_embed]);
+            RWKV_CTX_ASSERT_FALSE_MSG(ctx, RWKV_ERROR_ALLOC, row.get(), "Failed to allocate embedding row");
+            ggml_backend_tensor_get(emb, row.get(), token * emb->nb[1], n_embed * sizeof(ggml_fp16_t));
+            ggml_fp16_to_fp32_row(row.get(), embedding, (int64_t) n_embed);
+            break;
+        }
+        case GGML_TYPE_BF16: {
+            std::unique_ptr<ggml_bf16_t[]> row(new(std::nothrow) ggml_bf16_t[n_embed]);
+            RWKV_CTX_ASSERT_FALSE_MSG(ctx, RWKV_ERROR_ALLOC, row.get(), "Failed to allocate embedding row");
+            ggml_backend_tensor_get(emb, row.get(), token * emb->nb[1], n_embed * sizeof(ggml_bf16_t));
+            ggml_bf16_to_fp32_row(row.get(), embedding, (int64_t) n_embed);
+            break;
+        }
+        default:
+            RWKV_CTX_ASSERT_FALSE_MSG(ctx, RWKV_ERROR_DATA_TYPE, false, "Unsupported embedding type %s", ggml_type_name(emb->type));
+    }
+
+    return true;
+}
+
+// API function.
+bool rwkv_get_offload_info(struct rwkv_context * ctx, struct rwkv_offload_info * info) {
+    RWKV_CTX_ASSERT_FALSE_MSG(ctx, RWKV_ERROR_ARGS, info, "Offload info is NULL");
+
+    const struct rwkv_model & model = *ctx->model;
+
+    info->n_gpu_devices = model.offload_plan.device_count;
+    info->n_gpu_layers = model.offload_plan.layer_count;
+    info->head_offloaded = model.offload_plan.head;
+    info->n_streamed_layers = model.stream ? model.stream->layer_count : 0;
+    info->gpu_weights_size = model.gpu_weights_size;
+    info->cpu_weights_size = model.cpu_weights_size;
+
+    if (!ctx->serial_graph.sched) {
+        rwkv_init_graph_sched(ctx, ctx->serial_graph);
+    }
+
+    size_t copy_count;
+    size_t copy_size;
+    rwkv_count_graph_copies(ctx->serial_graph.sched, ctx->serial_graph.cgraph, copy_count, copy_size);
+
+    info->n_graph_splits = (uint32_t) ggml_backend_sched_get_n_splits(ctx->serial_graph.sched);
+    info->n_graph_copies = (uint32_t) copy_count;
+    info->graph_copy_size = copy_size;
+
+    return true;
+}
+
 // API function.
 void rwkv_free(struct rwkv_context * ctx) {
     if (ctx == NULL) {
@@ -190,6 +419,8 @@ void rwkv_free(struct rwkv_context * ctx) {
     }
 
     if (--ctx->model->reference_count == 0) {
+        ctx->model->stream.reset();
+
         for (auto buffer : ctx->model->buffers_w) {
             ggml_backend_buffer_free(buffer);
         }
@@ -206,11 +437,17 @@ void rwkv_free(struct rwkv_context * ctx) {
     ggml_backend_sched_free(ctx->serial_graph.sched);
     ggml_free(ctx->serial_graph.ggml_ctx);
 
-    if (ctx->last_used_sequence_length > 0) {
-        ggml_backend_sched_free(ctx->sequential_graph.sched);
-        ggml_free(ctx->sequential_graph.ggml_ctx);
+    for (auto & entry : ctx->sequential_graphs) {
+        rwkv_free_computation_graph(entry.graph);
+    }
+
+    for (auto & entry : ctx->batch_graphs) {
+        rwkv_free_computation_graph(entry.graph);
     }
 
+    ggml_backend_free(ctx->cpu_backend);
+
+    delete ctx->profiler;
     delete ctx;
 }
 
@@ -24,8 +24,10 @@
 
 #define RWKV_FILE_VERSION_0 100
 #define RWKV_FILE_VERSION_1 101
+// Adds a tensor directory at the start of the file, aligns tensor data and stores the architecture version.
+#define RWKV_FILE_VERSION_2 102
 #define RWKV_FILE_VERSION_MIN RWKV_FILE_VERSION_0
-#define RWKV_FILE_VERSION_MAX RWKV_FILE_VERSION_1
+#define RWKV_FILE_VERSION_MAX RWKV_FILE_VERSION_2
 // Default file version is the latest version.
 #define RWKV_FILE_VERSION RWKV_FILE_VERSION_MAX
 
@@ -88,8 +90,90 @@ extern "C" {
     // - model_file_path: path to model file in ggml format.
     // - n_threads: count of threads to use, must be positive.
     // - n_gpu_layer: count of layers need to load to gpu
+    // The model file is loaded with default parameters from rwkv_init_params_default.
     RWKV_API struct rwkv_context * rwkv_init_from_file(const char * model_file_path, const uint32_t n_threads, const uint32_t n_gpu_layers);
 
+    // Pool of threads which computes graphs of contexts attached to it, see `rwkv_thread_pool_init`.
+    struct rwkv_thread_pool;
+
+    // Parameters for loading a model with rwkv_init_from_file_with_params.
+    // Always get an instance from rwkv_init_params_default and then change the fields you need,
+    // so that fields added in the future get their default values.
+    struct rwkv_init_params {
+        // Count of threads to use, must be positive.
+        uint32_t n_threads;
+        // Count of layers need to load to gpu.
+        // If it is one more than the count of layers of the model, the head is offloaded too.
+        uint32_t n_gpu_layers;
+        // Whether to map the model file into memory instead of reading it.
+        // Weights which stay on the CPU are then used directly from the mapping. This loads large models faster and with less memory,
+        // and processes which load the same file share its pages in the OS page cache.
+        // The file must not be modified while the model is loaded. Ignored where mmap is not supported.
+        bool use_mmap;
+        // Whether to ask the OS to start reading the whole mapped file right away.
+        // Otherwise, the file is read lazily when weights are first used.
+        bool mmap_prefetch;
+        // Pool of threads to compute on instead of starting n_threads threads for each graph, or NULL.
+        // If set, n_threads is ignored. See `rwkv_set_thread_pool`.
+        struct rwkv_thread_pool * thread_pool;
+        // Count of GPU buffers, each holding weights of one layer, which layers that are not offloaded are streamed through.
+        // Weights of these layers stay in host memory; during each eval, every layer is uploaded to a free buffer while the previous
+        // layers are computed, so that models larger than GPU memory can run on the GPU. Uploads are costly for single tokens,
+        // but are amortized by long sequences in `rwkv_eval_sequence` and large batches in `rwkv_eval_batch`.
+        // The model head is not streamed.
+        // 0 disables streaming; otherwise must be at least 2. Ignored if there is no GPU backend.
+        uint32_t n_stream_slots;
+        // Bytes of GPU memory that offloaded weights may take, or 0 to offload by n_gpu_layers.
+        // If set, n_gpu_layers is ignored: the head is offloaded first if it fits, because it is the largest matrix of the model,
+        // and then as many layers as fit, starting from the first one, so that values cross between the CPU and the GPU
+        // as rarely as possible. The head is left on the CPU instead if more layers then fit with fewer copies between backends,
+        // see rwkv_offload_info.n_graph_copies, like when all layers fit without it. If layers are streamed, memory of the slots
+        // is reserved from the budget.
+        // Weights planned for each device are also capped to its free memory. Memory for graphs and states is not included,
+        // so leave some free memory besides the budget. Ignored if there is no GPU backend.
+        size_t gpu_memory_budget;
+        // Count of GPU devices to split offloaded layers between, starting from device 0.
+        // Each device computes a range of consecutive layers, and the last one also computes the head if it is offloaded;
+        // the hidden state is copied from each device to the next. In rwkv_eval_batch, the batch is split into one micro-batch
+        // per device, so that devices can work at once. The budget of gpu_memory_budget is shared by all devices.
+        // Only CUDA supports more than 1 device. Ignored if there is no GPU backend.
+        uint32_t n_gpu_devices;
+    };
+
+    // Returns default parameters for rwkv_init_from_file_with_params.
+    // n_threads is 1, n_gpu_layers is 0, use_mmap and mmap_prefetch are true, thread_pool is NULL, n_stream_slots is 0,
+    // gpu_memory_budget is 0, n_gpu_devices is 1.
+    RWKV_API struct rwkv_init_params rwkv_init_params_default(void);
+
+    // Loads the model from a file and prepares it for inference, like rwkv_init_from_file.
+    // Returns NULL on any error.
+    // - model_file_path: path to model file in ggml format.
+    // - params: loading parameters, see rwkv_init_params.
+    RWKV_API struct rwkv_context * rwkv_init_from_file_with_params(const char * model_file_path, const struct rwkv_init_params * params);
+
+    // Metadata of a model file, read by rwkv_read_file_info.
+    struct rwkv_file_info {
+        uint32_t file_version;
+        uint32_t n_vocab;
+        uint32_t n_embed;
+        uint32_t n_layer;
+        // RWKV architecture version, like 5 and 2 for v5.2.
+        uint32_t arch_version_major;
+        uint32_t arch_version_minor;
+        // Name of the format from the file header, like "Q5_1". Some tensors may be in other formats.
+        const char * data_type;
+        uint32_t tensor_count;
+        // Alignment of tensor data in bytes. Files before version 2 do not align it, and report 1.
+        uint32_t alignment;
+    };
+
+    // Reads metadata of a model file without loading the model.
+    // Files of version 2 are read only up to the end of their tensor directory; older files are read through all tensor headers.
+    // Returns false on any error.
+    // - model_file_path: path to model file in ggml format.
+    // - info: metadata is written here.
+    RWKV_API bool rwkv_read_file_info(const char * model_file_path, struct rwkv_file_info * info);
+
     // Creates a new context from an existing one.
     // This can allow you to run multiple rwkv_eval's in parallel, without having to load a single model multiple times.
     // Each rwkv_context can have one eval running at a time.
@@ -98,6 +182,47 @@ extern "C" {
     // - n_threads: count of threads to use, must be positive.
     RWKV_API struct rwkv_context * rwkv_clone_context(struct rwkv_context * ctx, const uint32_t n_threads);
 
+    // Creates a new context from an existing one, like `rwkv_clone_context`, which computes on the thread pool.
+    // If pool is NULL, the new context starts its own threads, as many as ctx computes with.
+    RWKV_API struct rwkv_context * rwkv_clone_context_with_thread_pool(struct rwkv_context * ctx, struct rwkv_thread_pool * pool);
+
+    // Parameters for creating a thread pool with rwkv_thread_pool_init.
+    // Always get an instance from rwkv_thread_pool_params_default and then change the fields you need.
+    struct rwkv_thread_pool_params {
+        // Count of threads in the pool, must be positive.
+        uint32_t n_threads;
+        // If not negative, thread i is pinned to CPU first_cpu + i. Pools with disjoint CPU ranges can then compute
+        // at the same time without competing for cores.
+        int32_t first_cpu;
+        // How actively idle threads wait for work, from 0 (sleep right away) to 100 (spin the longest).
+        // Higher values lower latency of small graphs at the cost of CPU time.
+        uint32_t poll;
+        // Whether to spread threads over NUMA nodes. This is set up once per process, by the first pool that asks for it.
+        bool numa;
+    };
+
+    // Returns default parameters for rwkv_thread_pool_init.
+    // n_threads is 1, first_cpu is -1, poll is 50, numa is false.
+    RWKV_API struct rwkv_thread_pool_params rwkv_thread_pool_params_default(void);
+
+    // Creates a pool of threads and starts them. Returns NULL on any error.
+    // Any number of contexts may share a pool. The pool computes one graph at a time with all its threads,
+    // so concurrent evals of contexts sharing a pool take turns instead of oversubscribing cores.
+    // For evals to run in parallel, give each group of contexts its own pool, pinned to its own CPUs.
+    RWKV_API struct rwkv_thread_pool * rwkv_thread_pool_init(const struct rwkv_thread_pool_params * params);
+
+    // Makes the context compute on the thread pool, or start its own n_threads threads for each graph if the pool is NULL.
+    // The pool must outlive its use by the context; it is not freed by `rwkv_free`.
+    // Must not be called while the context is evaluating.
+    // Returns false on any error.
+    RWKV_API bool rwkv_set_thread_pool(struct rwkv_context * ctx, struct rwkv_thread_pool * pool);
+
+    // Returns the count of threads in the pool.
+    RWKV_API uint32_t rwkv_thread_pool_get_n_threads(const struct rwkv_thread_pool * pool);
+
+    // Stops the threads and frees the pool. Contexts using the pool must be freed or detached from it first.
+    RWKV_API void rwkv_thread_pool_free(struct rwkv_thread_pool * pool);
+
     // Evaluates the model for a single token.
     // You can pass NULL to logits_out whenever logits are not needed. This can improve speed by ~10 ms per iteration, because logits are not calculated.
     // Not thread-safe. For parallel inference, call rwkv_clone_context to create one rwkv_context for each thread.
@@ -146,19 +271,103 @@ extern "C" {
         float * logits_out
     );
 
+    // Same as `rwkv_eval_sequence`, but writes the logits after every token of the sequence, not only after the last one.
+    // Verifies several drafted tokens in one pass, as in speculative decoding. Sequences of each length use graphs of their own,
+    // which are cached together with the graphs of `rwkv_eval_sequence`.
+    // - logits_out: FP32 buffer of size sequence_len * rwkv_get_logits_len(). Logits after token i start at i * rwkv_get_logits_len().
+    RWKV_API bool rwkv_eval_sequence_with_all_logits(
+        struct rwkv_context * ctx,
+        const uint32_t * tokens,
+        const size_t sequence_len,
+        const float * state_in,
+        float * state_out,
+        float * logits_out
+    );
+
+    // Same as `rwkv_eval_sequence_with_all_logits`, but also writes the state after every token, so that evaluation can continue
+    // from any of them without evaluating the tokens again, like after rejecting drafted tokens in speculative decoding.
+    // The graph computes the time mixing of one token at a time, which makes it somewhat slower for long sequences.
+    // - states_out: FP32 buffer of size sequence_len * rwkv_get_state_len(). The state after token i starts at i * rwkv_get_state_len().
+    //   The state after the last token is the state after the sequence.
+    // - logits_out: FP32 buffer of size sequence_len * rwkv_get_logits_len(), or NULL to skip computing logits.
+    RWKV_API bool rwkv_eval_sequence_with_all_states(
+        struct rwkv_context * ctx,
+        const uint32_t * tokens,
+        const size_t sequence_len,
+        const float * state_in,
+        float * states_out,
+        float * logits_out
+    );
+
+    // Sets how many sequence graphs are cached by the context.
+    // `rwkv_eval_sequence` keeps a graph and its allocated buffers for each of the most recently used sequence lengths,
+    // so switching between them does not rebuild anything. Each cached graph holds its own compute buffers.
+    // Least recently used graphs are freed when there are more of them than the capacity. The default is 4.
+    // Returns false on any error.
+    // - capacity: max count of cached graphs, must be positive.
+    RWKV_API bool rwkv_set_sequence_graph_cache_capacity(struct rwkv_context * ctx, const size_t capacity);
+
+    // Returns how many sequence graphs are cached by the context.
+    RWKV_API size_t rwkv_get_sequence_graph_cache_capacity(const struct rwkv_context * ctx);
+
+    // Sets how many batch graphs are cached by the context, like `rwkv_set_sequence_graph_cache_capacity`, but for the batch sizes
+    // of `rwkv_eval_batch` and `rwkv_eval_batch_with_states`. The default is 4.
+    // Returns false on any error.
+    // - capacity: max count of cached graphs, must be positive.
+    RWKV_API bool rwkv_set_batch_graph_cache_capacity(struct rwkv_context * ctx, const size_t capacity);
+
+    // Returns how many batch graphs are cached by the context.
+    RWKV_API size_t rwkv_get_batch_graph_cache_capacity(const struct rwkv_context * ctx);
+
+    // Builds and allocates sequence graphs for the given sequence lengths, so that the first `rwkv_eval_sequence` calls
+    // with these lengths do not have to. Useful for chunk sizes and typical remainders.
+    // If there are more lengths than the cache capacity, only the last ones stay cached.
+    // Returns false on any error.
+    // - sequence_lengths: array of sequence lengths, each must be positive.
+    // - count: number of lengths to read from the array.
+    RWKV_API bool rwkv_prewarm_sequence_graphs(struct rwkv_context * ctx, const size_t * sequence_lengths, const size_t count);
+
+    // Evaluates the model for one token in each of several independent states at once.
+    // This is equivalent to calling `rwkv_eval` for each state, but weight matrices are read only once per call,
+    // which gives much higher throughput when serving many users or sampling many branches of one prompt.
+    // Has to build a computation graph on the first call for a given batch size, but will use this cached graph for subsequent calls of the same batch size.
+    //
+    // You can pass NULL to logits_out, or NULL in any of its elements, whenever logits are not needed.
+    // Logits are not calculated at all if every element of logits_out is NULL.
+    // Not thread-safe. For parallel inference, call `rwkv_clone_context` to create one rwkv_context for each thread.
+    // Returns false on any error.
+    // - tokens: array of batch_size tokens, one for each state. If NULL, the graph will be built and cached, but not executed: this can be useful for initialization.
+    // - batch_size: number of states to evaluate, must be positive.
+    // - states_in: array of batch_size FP32 buffers of size rwkv_get_state_len(). NULL elements, or NULL array, mean a first pass.
+    // - states_out: array of batch_size FP32 buffers of size rwkv_get_state_len(). Non-NULL elements will be written to.
+    // - logits_out: array of batch_size FP32 buffers of size rwkv_get_logits_len(). Non-NULL elements will be written to.
+    RWKV_API bool rwkv_eval_batch(
+        struct rwkv_context * ctx,
+        const uint32_t * tokens,
+        const size_t batch_size,
+        const float * const * states_in,
+        float * const * states_out,
+        float * const * logits_out
+    );
+
     // Evaluates the model for a sequence of tokens using `rwkv_eval_sequence`, splitting a potentially long sequence into fixed-length chunks.
     // This function is useful for processing complete prompts and user input in chat & role-playing use-cases.
     // It is recommended to use this function instead of `rwkv_eval_sequence` to avoid mistakes and get maximum performance.
     //
     // Chunking allows processing sequences of thousands of tokens, while not reaching the ggml's node limit and not consuming too much memory.
     // A reasonable and recommended value of chunk size is 16. If you want maximum performance, try different chunk sizes in range [2..64]
-    // and choose one that works the best in your use case.
+    // and choose one that works the best in your use case, or pass 0 to use the chunk size from `rwkv_get_auto_chunk_size`.
+    // With chunk size 0, the remainder of the sequence after the last full chunk is evaluated in chunks of decreasing powers of two,
+    // so that graphs are only built for these lengths; the sequence graph cache capacity is raised to hold all of them if needed.
+    //
+    // If a prefix cache is set with `rwkv_set_prefix_cache` and state_in is NULL, evaluation resumes from the longest cached prefix
+    // whose length is a multiple of chunk_size, and states at chunk boundaries are added to the cache.
     //
     // Not thread-safe. For parallel inference, call `rwkv_clone_context` to create one rwkv_context for each thread.
     // Returns false on any error.
     // - tokens: pointer to an array of tokens. If NULL, the graph will be built and cached, but not executed: this can be useful for initialization.
     // - sequence_len: number of tokens to read from the array.
-    // - chunk_size: size of each chunk in tokens, must be positive.
+    // - chunk_size: size of each chunk in tokens, or 0 to choose it automatically.
     // - state_in: FP32 buffer of size rwkv_get_state_len(), or NULL if this is a first pass.
     // - state_out: FP32 buffer of size rwkv_get_state_len(). This buffer will be written to if non-NULL.
     // - logits_out: FP32 buffer of size rwkv_get_logits_len(). This buffer will be written to if non-NULL.
@@ -172,6 +381,47 @@ extern "C" {
         float * logits_out
     );
 
+    // Returns the chunk size that `rwkv_eval_sequence_in_chunks` uses when chunk_size is 0: a power of two in range [4..64] with the least
+    // time per token on the backends of the model. It is measured on the first call, which takes as long as evaluating several hundred tokens,
+    // and is then remembered for the model and the thread count of the context, including by contexts cloned from it.
+    // Measuring builds sequence graphs, which may replace graphs in the sequence graph cache of the context.
+    // Returns 0 on any error.
+    RWKV_API size_t rwkv_get_auto_chunk_size(struct rwkv_context * ctx);
+
+    // Prefix state cache.
+    // Stores states after prefixes of sequences evaluated by `rwkv_eval_sequence_in_chunks`, so that later sequences starting
+    // with the same tokens (system prompts, few-shot examples, chat templates) resume from the longest cached prefix
+    // instead of evaluating it again. States are stored at every chunk boundary and are only used for sequences that start
+    // from the initial state, that is, with state_in == NULL. Least recently used states are freed to stay within the memory budget.
+    //
+    // A cache is thread-safe and may be shared by contexts cloned from the same context. Contexts of other models may use
+    // the same cache too; each state is only ever used by contexts of the model that computed it.
+    struct rwkv_prefix_cache;
+
+    // Creates an empty prefix cache. Returns NULL on any error.
+    // - max_bytes: memory budget for cached states and their tokens, must be positive.
+    RWKV_API struct rwkv_prefix_cache * rwkv_prefix_cache_init(const size_t max_bytes);
+
+    // Makes `rwkv_eval_sequence_in_chunks` use the cache, or stop using any cache if it is NULL.
+    // The cache must outlive its use by the context; it is not freed by `rwkv_free`.
+    // Returns false on any error.
+    RWKV_API bool rwkv_set_prefix_cache(struct rwkv_context * ctx, struct rwkv_prefix_cache * cache);
+
+    // Frees all cached states.
+    RWKV_API void rwkv_prefix_cache_clear(struct rwkv_prefix_cache * cache);
+
+    // Returns the memory used by cached states and their tokens, in bytes.
+    RWKV_API size_t rwkv_prefix_cache_get_size(struct rwkv_prefix_cache * cache);
+
+    // Returns the number of cached states.
+    RWKV_API size_t rwkv_prefix_cache_get_entry_count(struct rwkv_prefix_cache * cache);
+
+    // Returns the total number of tokens that did not have to be evaluated because their states were cached.
+    RWKV_API size_t rwkv_prefix_cache_get_reused_token_count(struct rwkv_prefix_cache * cache);
+
+    // Frees the cache. Contexts using the cache must not be used for evaluation afterwards, unless detached from it.
+    RWKV_API void rwkv_prefix_cache_free(struct rwkv_prefix_cache * cache);
+
     // Returns the number of tokens in the given model's vocabulary.
     // Useful for telling 20B_tokenizer models (n_vocab = 50277) apart from World models (n_vocab = 65536).
     RWKV_API size_t rwkv_get_n_vocab(const struct rwkv_context * ctx);
@@ -194,12 +444,284 @@ extern "C" {
     // This is currently always identical to n_vocab.
     RWKV_API size_t rwkv_get_logits_len(const struct rwkv_context * ctx);
 
+    // Copies the row of the embedding matrix for a token into a buffer, converted to FP32.
+    // Useful for comparing tokens, or concepts named by them, by meaning.
+    // - embedding: FP32 buffer of size rwkv_get_n_embed().
+    RWKV_API bool rwkv_get_token_embedding(struct rwkv_context * ctx, const uint32_t token, float * embedding);
+
+    // Where the weights of a model are, and how its graph for single tokens is split between backends.
+    struct rwkv_offload_info {
+        // Count of GPU devices that offloaded layers are split between.
+        uint32_t n_gpu_devices;
+        // Count of offloaded layers, which are the first layers of the model.
+        uint32_t n_gpu_layers;
+        bool head_offloaded;
+        // Count of layers which are streamed to the GPU, see rwkv_init_params.n_stream_slots.
+        uint32_t n_streamed_layers;
+        // Total size of weights on the GPU, and in host memory.
+        size_t gpu_weights_size;
+        size_t cpu_weights_size;
+        // Count of parts of the graph that are computed by one backend each.
+        uint32_t n_graph_splits;
+        // Count and total size of tensors that are copied between backends for each evaluated token.
+        uint32_t n_graph_copies;
+        size_t graph_copy_size;
+    };
+
+    // Gets the offload plan chosen when the model was loaded, by n_gpu_layers or gpu_memory_budget of rwkv_init_params.
+    // Returns false on any error.
+    RWKV_API bool rwkv_get_offload_info(struct rwkv_context * ctx, struct rwkv_offload_info * info);
+
+    // Time and data counted while profiling.
+    struct rwkv_profile_entry {
+        // One of:
+        // - "emb", "layer.N.att", "layer.N.wkv", "layer.N.ffn", "head", "sampling": parts of graphs, where N is the layer index;
+        //   "wkv" is the WKV operation, which is separate from the rest of time mixing of v5, v6 and v7 models;
+        // - "op.NAME": ggml operations, like "op.MUL_MAT", counted in parts of graphs too;
+        // - "input", "output": copies of states, tokens and logits between buffers of the caller and graph tensors;
+        // - "copy": tensors copied between backends by the scheduler; only bytes are counted, as their time is counted
+        //   in the nodes that need them;
+        // - "graph_build", "sched_alloc": building graphs, and allocating them with the scheduler.
+        // Valid until the next profiled call or rwkv_free.
+        const char * name;
+        // How many times this was counted, like the count of evaluated nodes of a part.
+        uint64_t count;
+        uint64_t time_us;
+        uint64_t bytes;
+    };
+
+    // Enables or disables profiling of evals. Counters are kept when profiling is disabled and enabled again.
+    // While profiling, graphs are computed one node at a time, waiting for backends after each node, which makes evals slower;
+    // the time of each node includes copying its inputs between backends.
+    // Returns false on any error.
+    RWKV_API bool rwkv_set_profiling(struct rwkv_context * ctx, const bool enable);
+
+    // Zeroes all profiling counters and clears the trace.
+    RWKV_API void rwkv_reset_profile(struct rwkv_context * ctx);
+
+    // Copies up to capacity profiling entries with non-zero counts into entries, in the order they were first counted.
+    // Returns the count of all such entries, so that entries can be NULL to get the count.
+    RWKV_API size_t rwkv_get_profile(const struct rwkv_context * ctx, struct rwkv_profile_entry * entries, const size_t capacity);
+
+    // Writes the trace of profiled evals in Chrome trace event format, which can be opened in chrome://tracing or Perfetto.
+    // Consecutive nodes of the same part of a graph are merged into one event. The trace holds up to 2^20 events.
+    // Returns false on any error.
+    RWKV_API bool rwkv_write_profile_trace(struct rwkv_context * ctx, const char * file_path);
+
     // Initializes the given state so that passing it to rwkv_eval or rwkv_eval_sequence would be identical to passing NULL.
     // Useful in cases where tracking the first call to these functions may be annoying or expensive.
     // State must be initialized for behavior to be defined, passing a zeroed state to rwkv.cpp functions will result in NaNs.
     // - state: FP32 buffer of size rwkv_get_state_len() to initialize
     RWKV_API void rwkv_init_state(const struct rwkv_context * ctx, float * state);
 
+    // Computes the weighted sum of several states, such as the average of the states of branches that are merged.
+    // RWKV v4 states keep att_aa and att_bb scaled by exp(-att_pp); they are rescaled to the largest att_pp before they are added.
+    // Returns false on any error.
+    // - states: array of count FP32 buffers of size rwkv_get_state_len().
+    // - weights: array of count weights, usually adding up to 1.
+    // - state_out: FP32 buffer of size rwkv_get_state_len(). It may be one of the states.
+    RWKV_API bool rwkv_mix_states(struct rwkv_context * ctx, const float * const * states, const float * weights, const size_t count, float * state_out);
+
+    // Device-resident states.
+    // A state that stays in the memory of the backend between eval calls. Compared to passing FP32 buffers to `rwkv_eval`,
+    // the state is not copied from and to the host on every call; with all layers offloaded to a GPU, it never leaves the GPU.
+    // A state can be used with any context sharing the model of the context that created it, and must be freed before the model.
+    // Forks of a state share its memory until they are written to, so forking branches for beam search or best-of-n
+    // sampling copies nothing; a state that is written to while it shares memory gets memory of its own first.
+    // A state must not be forked while another thread writes to it.
+    struct rwkv_state;
+
+    // Creates a state initialized as by `rwkv_init_state`. Returns NULL on any error.
+    RWKV_API struct rwkv_state * rwkv_state_init(struct rwkv_context * ctx);
+
+    // Creates a state with the same values as the given one, sharing its memory. Returns NULL on any error.
+    RWKV_API struct rwkv_state * rwkv_state_fork(struct rwkv_context * ctx, const struct rwkv_state * state);
+
+    // Copies a state from the host into the device-resident state.
+    // Returns false on any error.
+    // - state_in: FP32 buffer of size rwkv_get_state_len(), or NULL to reset the state to the initial state.
+    RWKV_API bool rwkv_state_upload(struct rwkv_context * ctx, struct rwkv_state * state, const float * state_in);
+
+    // Copies the device-resident state to the host.
+    // Returns false on any error.
+    // - state_out: FP32 buffer of size rwkv_get_state_len().
+    RWKV_API bool rwkv_state_download(struct rwkv_context * ctx, const struct rwkv_state * state, float * state_out);
+
+    // Same as `rwkv_eval`, but reads the device-resident state and writes the new state back to it without copying it to the host.
+    RWKV_API bool rwkv_eval_with_state(struct rwkv_context * ctx, const uint32_t token, struct rwkv_state * state, float * logits_out);
+
+    // Same as `rwkv_eval_sequence`, but reads the device-resident state and writes the new state back to it without copying it to the host.
+    RWKV_API bool rwkv_eval_sequence_with_state(
+        struct rwkv_context * ctx,
+        const uint32_t * sequence,
+        const size_t sequence_len,
+        struct rwkv_state * state,
+        float * logits_out
+    );
+
+    // Same as `rwkv_eval_batch`, but reads device-resident states and writes the new states back to them without copying them to the host.
+    // Evaluating forks of one state this way scores K branches of a prompt with a single pass over the weights.
+    // - states: array of batch_size different states; forks of one state are different states.
+    RWKV_API bool rwkv_eval_batch_with_states(
+        struct rwkv_context * ctx,
+        const uint32_t * tokens,
+        const size_t batch_size,
+        struct rwkv_state * const * states,
+        float * const * logits_out
+    );
+
+    // Frees the device-resident state.
+    RWKV_API void rwkv_state_free(struct rwkv_state * state);
+
+    // Sampling.
+    // Tokens can be sampled as a part of evaluation, in which case only the sampled token has to be read from the backend,
+    // and no logits are returned. Sampling follows python/sampling.py: logit bias and penalties are applied to logits,
+    // top-k and top-p are applied to probabilities, and the remaining probabilities are raised to the power of 1 / temperature.
+    struct rwkv_sampling_params {
+        // 0 always selects the most probable token.
+        float temperature;
+        // Only the most probable tokens whose cumulative probability exceeds top_p are kept. 0 or 1 disable top-p.
+        float top_p;
+        // Only top_k most probable tokens are kept. 0 disables top-k.
+        uint32_t top_k;
+        // Subtracted from logits of tokens in penalty_tokens: presence_penalty once for each distinct token,
+        // and frequency_penalty for each occurrence.
+        float presence_penalty;
+        float frequency_penalty;
+        const uint32_t * penalty_tokens;
+        size_t penalty_token_count;
+        // logit_bias_values[i] is added to the logit of logit_bias_tokens[i].
+        const uint32_t * logit_bias_tokens;
+        const float * logit_bias_values;
+        size_t logit_bias_count;
+    };
+
+    // Returns sampling parameters with temperature 1, top-p and top-k disabled, no penalties and no logit bias.
+    RWKV_API struct rwkv_sampling_params rwkv_sampling_params_default(void);
+
+    // Sets the seed of the random number generator used for sampling. Each context has its own generator.
+    RWKV_API void rwkv_set_sampling_seed(struct rwkv_context * ctx, const uint64_t seed);
+
+    // Same as `rwkv_eval`, but samples the next token instead of returning logits.
+    // Sorting of the vocab is avoided when possible: enable top-k or top-p for the best performance.
+    // Returns false on any error.
+    // - params: sampling parameters; arrays they point to are only read during the call.
+    // - token_out: the sampled token is written here.
+    RWKV_API bool rwkv_eval_and_sample(
+        struct rwkv_context * ctx,
+        const uint32_t token,
+        const float * state_in,
+        float * state_out,
+        const struct rwkv_sampling_params * params,
+        uint32_t * token_out
+    );
+
+    // Same as `rwkv_eval_and_sample`, but with a device-resident state.
+    RWKV_API bool rwkv_eval_with_state_and_sample(
+        struct rwkv_context * ctx,
+        const uint32_t token,
+        struct rwkv_state * state,
+        const struct rwkv_sampling_params * params,
+        uint32_t * token_out
+    );
+
+    // Same as `rwkv_eval_sequence`, but samples the token following the sequence instead of returning logits.
+    RWKV_API bool rwkv_eval_sequence_and_sample(
+        struct rwkv_context * ctx,
+        const uint32_t * sequence,
+        const size_t sequence_len,
+        const float * state_in,
+        float * state_out,
+        const struct rwkv_sampling_params * params,
+        uint32_t * token_out
+    );
+
+    // Samples a token from logits on the host, in the same way and with the same random number generator as the functions above.
+    // Useful for logits which are not sampled during evaluation, such as those of each state in `rwkv_eval_batch`.
+    // Returns false on any error.
+    // - logits: FP32 buffer of size rwkv_get_logits_len().
+    // - params: sampling parameters; arrays they point to are only read during the call.
+    // - token_out: the sampled token is written here.
+    RWKV_API bool rwkv_sample_from_logits(
+        struct rwkv_context * ctx,
+        const float * logits,
+        const struct rwkv_sampling_params * params,
+        uint32_t * token_out
+    );
+
+    // Copies candidates of the last sampling: tokens that were kept after top-k and top-p, most probable first,
+    // with their final probabilities. If neither top-k nor top-p was used, the only candidate is the sampled token.
+    // Returns the number of copied candidates.
+    // - ids: buffer of max_count tokens, or NULL.
+    // - probs: buffer of max_count probabilities, or NULL.
+    RWKV_API size_t rwkv_get_sampling_candidates(const struct rwkv_context * ctx, uint32_t * ids, float * probs, const size_t max_count);
+
+    // Generates tokens with speculative decoding. The draft context, usually of a much smaller model with the same vocab,
+    // samples draft_length tokens one by one; the target context then evaluates all of them with one sequence eval
+    // and accepts or replaces them, so that the tokens are distributed as if they were sampled from the target model
+    // with the sampling parameters. With temperature 0, they are the tokens of greedy decoding with the target model.
+    // Between 1 and draft_length + 1 tokens are generated. The target state is rolled back to the last accepted token
+    // from the states after each token of the verification, as in `rwkv_eval_sequence_with_all_states`.
+    // Drafted and generated tokens are not added to penalty tokens of the parameters.
+    // Random numbers come from the generator of the target context.
+    // Not thread-safe. Returns false on any error.
+    // - token: the last token, which neither model has evaluated yet.
+    // - target_state: FP32 buffer of rwkv_get_state_len(target_ctx) with the state before the token.
+    //   It is updated to the state after the token and all generated tokens but the last one.
+    // - draft_state: same for the draft context.
+    // - tokens_out: buffer of draft_length + 1 tokens. The last generated token is the token of the next call.
+    // - n_tokens_out: count of generated tokens is written here.
+    RWKV_API bool rwkv_speculative_decode(
+        struct rwkv_context * target_ctx,
+        struct rwkv_context * draft_ctx,
+        const uint32_t token,
+        float * target_state,
+        float * draft_state,
+        const size_t draft_length,
+        const struct rwkv_sampling_params * params,
+        uint32_t * tokens_out,
+        size_t * n_tokens_out
+    );
+
+    // Formats of packed states.
+    enum rwkv_state_format {
+        RWKV_STATE_FORMAT_FP32 = 0,
+        RWKV_STATE_FORMAT_FP16 = 1,
+        RWKV_STATE_FORMAT_BF16 = 2,
+        // 8-bit integers with one FP32 scale for each vector and each attention head.
+        RWKV_STATE_FORMAT_Q8 = 3
+    };
+
+    // Returns the size in bytes of a state packed with `rwkv_pack_state`, or 0 if any of the formats is invalid.
+    RWKV_API size_t rwkv_get_packed_state_size(const struct rwkv_context * ctx, const enum rwkv_state_format vectors_format, const enum rwkv_state_format heads_format);
+
+    // Converts a state into a compact, reduced-precision representation, useful for storing many idle sessions in memory or on disk.
+    // FP16 and BF16 halve the size, Q8 quarters it. All formats except FP32 are lossy; continuing from an unpacked state gives
+    // slightly different results than continuing from the original one.
+    // Attention heads (v5+ models) make up most of the state and can be kept in a more precise format than the rest.
+    // v4 states contain very large values that do not fit into FP16; BF16 is recommended for them.
+    // Returns false on any error.
+    // - state: FP32 buffer of size rwkv_get_state_len().
+    // - vectors_format: format of token shift vectors and, for v4 models, all of the state.
+    // - heads_format: format of attention head matrices of v5+ models.
+    // - buffer: buffer of at least rwkv_get_packed_state_size() bytes, aligned to 4 bytes.
+    // - buffer_size: size of the buffer in bytes.
+    RWKV_API bool rwkv_pack_state(
+        struct rwkv_context * ctx,
+        const float * state,
+        const enum rwkv_state_format vectors_format,
+        const enum rwkv_state_format heads_format,
+        void * buffer,
+        const size_t buffer_size
+    );
+
+    // Converts a state packed with `rwkv_pack_state` back into FP32. Formats are read from the packed state.
+    // Returns false on any error, including packed states of models with a different state length.
+    // - buffer: packed state, aligned to 4 bytes.
+    // - buffer_size: size of the buffer in bytes.
+    // - state: FP32 buffer of size rwkv_get_state_len().
+    RWKV_API bool rwkv_unpack_state(struct rwkv_context * ctx, const void * buffer, const size_t buffer_size, float * state);
+
     // Frees all allocated memory and the context.
     // Does not need to be called on the same thread that created the rwkv_context.
     RWKV_API void rwkv_free(struct rwkv_context * ctx);
@@ -215,8 +737,53 @@ extern "C" {
     // - Q5_0
     // - Q5_1
     // - Q8_0
+    // - K-quants: Q2_K, Q3_K, Q4_K, Q5_K, Q6_K
+    // - IQ quants which do not need an importance matrix: IQ4_NL, IQ4_XS, IQ3_XXS, IQ3_S, IQ2_S
+    // Tensors with rows that can not be split into blocks of the format get a format with smaller blocks.
     RWKV_API bool rwkv_quantize_model_file(const char * model_file_path_in, const char * model_file_path_out, const char * format_name);
 
+    // Parameters for quantizing a model with rwkv_quantize_model_file_with_params.
+    // Always get an instance from rwkv_quantize_params_default and then change the fields you need.
+    struct rwkv_quantize_params {
+        // Count of threads quantizing rows, must be positive. Reading and writing are done on two more threads,
+        // at the same time as quantization.
+        uint32_t n_threads;
+        // Tensors are processed in parts of at most this many bytes of FP32 data, or of one row if rows are larger.
+        // Memory use is a small multiple of this size, regardless of the size of the model. Must be positive.
+        size_t chunk_size;
+        // Whether to keep tensors which were completely written to the output file by an interrupted quantization
+        // of the same model into the same format, and continue after them. Otherwise, the output file is overwritten.
+        bool resume;
+        // Rules which override the format of some tensors, or NULL. By default, the format given to
+        // rwkv_quantize_model_file_with_params is used for matrices other than the embedding, the head and LoRA-like matrices of v6+.
+        // Rules are separated by ';' or new lines and have the form PATTERN[:LAYERS]=FORMAT, where:
+        // - PATTERN is matched against whole tensor names, like "blocks.0.att.output.weight"; '*' matches any characters.
+        // - LAYERS is an optional comma-separated list of layer indices or ranges FIRST..LAST; negative indices count
+        //   from the end, -1 being the last layer. A rule with layers only applies to tensors of these layers.
+        // - FORMAT is FP32, FP16, or one of the formats of rwkv_quantize_model_file.
+        // Rules apply to any 2D tensor, and later rules override earlier ones. For example, "*ffn*=Q4_K; *att.output*:0,-1=Q8_0".
+        // The format of each tensor is stored in the output file, with the default format in the file header.
+        const char * recipe;
+        // Called after each part is written, with the count of input bytes processed so far and the total count. May be NULL.
+        void (*progress_callback)(size_t processed_bytes, size_t total_bytes, void * data);
+        // Passed to progress_callback.
+        void * progress_callback_data;
+    };
+
+    // Returns default parameters for rwkv_quantize_model_file_with_params.
+    // n_threads is 1, chunk_size is 16 MB, resume is false, recipe and progress_callback are NULL.
+    RWKV_API struct rwkv_quantize_params rwkv_quantize_params_default(void);
+
+    // Quantizes FP32 or FP16 model to one of quantized formats, like rwkv_quantize_model_file.
+    // The output file is identical for any parameters.
+    // - params: quantization parameters, see rwkv_quantize_params.
+    RWKV_API bool rwkv_quantize_model_file_with_params(
+        const char * model_file_path_in,
+        const char * model_file_path_out,
+        const char * format_name,
+        const struct rwkv_quantize_params * params
+    );
+
     // Returns system information string.
     RWKV_API const char * rwkv_get_system_info_string(void);
 
@@ -1,413 +1,2301 @@
 #include "rwkv_opencog.h"
-#include <unordered_map>
 #include <unordered_set>
+#include <unordered_map>
+#include <deque>
 #include <vector>
 #include <string>
 #include <memory>
 #include <mutex>
+#include <atomic>
 #include <cmath>
 #include <algorithm>
 #include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <sys/stat.h>
+
+#if !defined(_WIN32)
+#    include <unistd.h>
+#    if defined(_POSIX_MAPPED_FILES)
+#        include <sys/mman.h>
+#        define RWKV_OPENCOG_MMAP_SUPPORTED
+#    endif
+#endif
+
+// SSE2 is part of x86-64 and NEON of AArch64, so the threshold kernel needs no runtime dispatch.
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#    include <emmintrin.h>
+#    define RWKV_OPENCOG_SSE2
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#    include <arm_neon.h>
+#    define RWKV_OPENCOG_NEON
+#endif
+
+// Atoms are stored by handle in blocks, which are allocated as handles grow and never move,
+// so that atoms are found without locks and pointers to them stay valid until they are cleared.
+static const size_t atom_block_bits = 14;
+static const size_t atom_block_size = size_t(1) << atom_block_bits;
+static const size_t max_atom_blocks = size_t(1) << 16;
+
+struct rwkv_atom_block;
+struct rwkv_atomspace;
 
 // Internal atom representation
+// Atoms are kept as a struct of arrays in their block; an rwkv_atom only refers to the block,
+// and its position among the atoms of the block is the index into the arrays.
 struct rwkv_atom {
-    rwkv_atom_handle_t handle;
-    rwkv_atom_type_t type;
-    std::string name;  // For nodes
-    std::vector<rwkv_atom_handle_t> outgoing;  // For links
-    rwkv_truth_value_t tv;
-    rwkv_attention_value_t av;
-    
-    rwkv_atom(rwkv_atom_handle_t h, rwkv_atom_type_t t) 
-        : handle(h), type(t), tv{0.5f, 0.1f}, av{0.0f, 0.0f, 0.0f} {}
+    struct rwkv_atom_block * block;
+};
+
+// The type, name and outgoing set never change once the atom is ready, so they are read without locks.
+// Incoming sets are guarded by the lock stripe of the atom's handle, see rwkv_atomspace::incoming_mutexes.
+struct rwkv_atom_block {
+    struct rwkv_atomspace * atomspace;
+    rwkv_atom_handle_t first_handle;
+    std::atomic<bool> ready[atom_block_size];
+    uint8_t types[atom_block_size];
+    rwkv_truth_value_t tvs[atom_block_size];
+    rwkv_attention_value_t avs[atom_block_size];
+    const char * names[atom_block_size];  // For nodes, interned in an arena
+    const rwkv_atom_handle_t * outgoing[atom_block_size];  // For links, in an arena
+    uint32_t outgoing_counts[atom_block_size];
+    std::vector<rwkv_atom_handle_t> incoming[atom_block_size];  // Links which have the atom in their outgoing set
+    struct rwkv_atom atoms[atom_block_size];
+    
+    rwkv_atom_block(struct rwkv_atomspace * atomspace, rwkv_atom_handle_t first_handle) : atomspace(atomspace), first_handle(first_handle) {
+        for (size_t i = 0; i < atom_block_size; i++) {
+            ready[i].store(false, std::memory_order_relaxed);
+            atoms[i].block = this;
+        }
+    }
+};
+
+// Append-only storage for names and outgoing sets of atoms. Chunks never move, so data in them stays valid until cleared.
+// Data of removed atoms stays until rwkv_atomspace_compact copies the data of the remaining atoms into a new arena.
+static const size_t arena_chunk_size = size_t(1) << 20;
+
+struct rwkv_atom_arena {
+    std::vector<std::unique_ptr<char[]>> chunks;
+    size_t used;
+    size_t capacity;
+    size_t allocated;  // Bytes of all chunks
+    
+    rwkv_atom_arena() : used(0), capacity(0), allocated(0) {}
+    
+    void * allocate(size_t size, size_t alignment) {
+        used = (used + alignment - 1) / alignment * alignment;
+        if (used + size > capacity) {
+            // Data larger than a chunk gets a chunk of its own.
+            capacity = std::max(arena_chunk_size, size);
+            chunks.emplace_back(new char[capacity]);
+            allocated += capacity;
+            used = 0;
+        }
+        void * data = chunks.back().get() + used;
+        used += size;
+        return data;
+    }
+    
+    void clear() {
+        chunks.clear();
+        used = 0;
+        capacity = 0;
+        allocated = 0;
+    }
+};
+
+// Open addressing table from hashes to handles of atoms with the hash; atoms are compared to tell collisions apart.
+struct rwkv_atom_hash_table {
+    std::vector<std::pair<uint64_t, rwkv_atom_handle_t>> slots;  // Empty slots have the invalid handle
+    size_t count;
+    
+    rwkv_atom_hash_table() : count(0) {}
+    
+    // Calls the function with handles of atoms with the hash, until it returns false.
+    template<typename F>
+    void find(uint64_t hash, F function) const {
+        if (slots.empty()) return;
+        
+        const size_t mask = slots.size() - 1;
+        for (size_t i = hash & mask; slots[i].second != RWKV_INVALID_ATOM_HANDLE; i = (i + 1) & mask) {
+            if (slots[i].first == hash && !function(slots[i].second)) return;
+        }
+    }
+    
+    void insert(uint64_t hash, rwkv_atom_handle_t handle) {
+        // Kept at most half full, so that probe sequences stay short.
+        if ((count + 1) * 2 > slots.size()) {
+            std::vector<std::pair<uint64_t, rwkv_atom_handle_t>> old_slots(std::max(slots.size() * 2, size_t(64)));
+            old_slots.swap(slots);
+            count = 0;
+            for (const auto & slot : old_slots) {
+                if (slot.second != RWKV_INVALID_ATOM_HANDLE) insert(slot.first, slot.second);
+            }
+        }
+        
+        const size_t mask = slots.size() - 1;
+        size_t i = hash & mask;
+        while (slots[i].second != RWKV_INVALID_ATOM_HANDLE) i = (i + 1) & mask;
+        slots[i] = std::make_pair(hash, handle);
+        count++;
+    }
+    
+    void erase(uint64_t hash, rwkv_atom_handle_t handle) {
+        if (slots.empty()) return;
+        
+        const size_t mask = slots.size() - 1;
+        size_t i = hash & mask;
+        for (; slots[i].second != handle; i = (i + 1) & mask) {
+            if (slots[i].second == RWKV_INVALID_ATOM_HANDLE) return;
+        }
+        
+        // Later slots of the probe sequence move back into the hole if it is on their way from their home slot,
+        // so that lookups never stop at an empty slot too early.
+        for (size_t j = (i + 1) & mask; slots[j].second != RWKV_INVALID_ATOM_HANDLE; j = (j + 1) & mask) {
+            const size_t home = slots[j].first & mask;
+            if (((j - home) & mask) >= ((j - i) & mask)) {
+                slots[i] = slots[j];
+                i = j;
+            }
+        }
+        
+        slots[i] = std::make_pair(uint64_t(0), RWKV_INVALID_ATOM_HANDLE);
+        count--;
+    }
+    
+    void clear() {
+        slots.clear();
+        count = 0;
+    }
+};
+
+// Atoms are deduplicated by a hash of their name, or of their type and outgoing set, in the shard picked by the hash,
+// so that threads adding different atoms rarely wait for each other. Nodes with the same name share the shard,
+// which is how names are interned. Names and outgoing sets of the atoms are stored in the arena of the shard.
+static const size_t atomspace_shard_count = 64;
+
+struct rwkv_atomspace_shard {
+    std::mutex mutex;
+    rwkv_atom_hash_table atoms;
+    rwkv_atom_arena arena;
+};
+
+static const size_t atom_type_count = RWKV_ATOM_INHERITANCE_LINK + 1;
+
+// Handles of the atoms of a type, in order of their addition, so that queries by type cost in proportion to their results.
+struct rwkv_atom_type_index {
+    std::mutex mutex;
+    std::vector<rwkv_atom_handle_t> handles;
+};
+
+// Consolidation finds similar nodes with locality-sensitive hashing: each table hashes embeddings by the signs of their
+// projections on random hyperplanes, so that embeddings at a small angle likely share a bucket in some table.
+static const size_t lsh_table_count = 8;
+static const size_t lsh_hyperplane_count = 12;  // Bits of the code of each table
+
+struct rwkv_atom_embedding {
+    std::vector<float> values;  // Of unit length
+    bool indexed;
+    uint32_t codes[lsh_table_count];
+};
+
+struct rwkv_atom_similarity_index {
+    std::mutex mutex;
+    size_t dimension;  // 0 until the first embedding is set
+    std::vector<float> hyperplanes;  // lsh_table_count * lsh_hyperplane_count rows of dimension elements
+    std::unordered_map<rwkv_atom_handle_t, rwkv_atom_embedding> embeddings;
+    std::unordered_map<uint64_t, std::vector<rwkv_atom_handle_t>> buckets;  // By table in the high bits and code
+    std::deque<rwkv_atom_handle_t> pending;  // Nodes whose embeddings were set since they were indexed
+    
+    rwkv_atom_similarity_index() : dimension(0) {}
+    
+    void clear() {
+        dimension = 0;
+        hyperplanes.clear();
+        embeddings.clear();
+        buckets.clear();
+        pending.clear();
+    }
+};
+
+// Contents of a snapshot file which atoms loaded from it use in place: names and outgoing sets.
+// The file is mapped read-only if possible, or else read into memory.
+struct rwkv_atomspace_snapshot {
+    void * addr;
+    size_t size;
+    std::unique_ptr<uint64_t[]> buffer;
+    
+    rwkv_atomspace_snapshot() : addr(nullptr), size(0) {}
+    
+    ~rwkv_atomspace_snapshot() {
+#ifdef RWKV_OPENCOG_MMAP_SUPPORTED
+        if (addr && !buffer) munmap(addr, size);
+#endif
+    }
 };
 
 // AtomSpace implementation
 struct rwkv_atomspace {
-    std::unordered_map<rwkv_atom_handle_t, std::unique_ptr<rwkv_atom>> atoms;
-    std::unordered_map<std::string, std::vector<rwkv_atom_handle_t>> name_index;  // For node lookup
-    std::unordered_set<std::string> link_signatures;  // For link deduplication
-    rwkv_atom_handle_t next_handle;
-    std::mutex mutex;  // Thread safety
+    std::unique_ptr<std::atomic<rwkv_atom_block *>[]> blocks;
+    std::atomic<rwkv_atom_handle_t> next_handle;
+    std::atomic<size_t> atom_count;
+
+    rwkv_atomspace_shard shards[atomspace_shard_count];
+    std::mutex incoming_mutexes[atomspace_shard_count];
+    rwkv_atom_type_index type_indexes[atom_type_count];
+    rwkv_atom_similarity_index similarity_index;
+    
+    std::vector<std::unique_ptr<rwkv_atomspace_snapshot>> snapshots;
+    
+    // Changes are appended to the log while it is open, see rwkv_atomspace_open_log
+    // Only changed with log_mutex held and only written to with it held, but atomic, so that changes when no log is open
+    // skip the mutex
+    std::atomic<FILE *> log_file;
+    std::string log_path;
+    std::mutex log_mutex;
     
-    rwkv_atomspace() : next_handle(1) {}
+    rwkv_atomspace() : blocks(new std::atomic<rwkv_atom_block *>[max_atom_blocks]()), next_handle(1), atom_count(0), log_file(nullptr) {}
+
+    ~rwkv_atomspace() {
+        if (log_file) fclose(log_file);
+        free_blocks();
+    }
+    
+    void free_blocks() {
+        for (size_t i = 0; i < max_atom_blocks; i++) {
+            delete blocks[i].exchange(nullptr);
+        }
+    }
 };
 
 // Utility functions
-static std::string create_link_signature(rwkv_atom_type_t type, const rwkv_atom_handle_t * outgoing, size_t count) {
-    std::string sig = std::to_string(type) + ":";
+static uint64_t hash_combine(uint64_t hash, uint64_t value) {
+    // Mixes with the finalizer of splitmix64, so that shards get hashes of similar atoms evenly.
+    hash ^= value + 0x9E3779B97F4A7C15ULL + (hash << 6) + (hash >> 2);
+    hash ^= hash >> 30;
+    hash *= 0xBF58476D1CE4E5B9ULL;
+    hash ^= hash >> 27;
+    hash *= 0x94D049BB133111EBULL;
+    return hash ^ (hash >> 31);
+}
+
+static uint64_t hash_name(const char * name) {
+    uint64_t hash = 0xCBF29CE484222325ULL;
+    for (const char * c = name; *c; c++) {
+        hash = (hash ^ (unsigned char) *c) * 0x100000001B3ULL;
+    }
+    return hash_combine(hash, 0);
+}
+
+static uint64_t hash_link(rwkv_atom_type_t type, const rwkv_atom_handle_t * outgoing, size_t count) {
+    uint64_t hash = hash_combine(1, (uint64_t) type);
     for (size_t i = 0; i < count; i++) {
-        if (i > 0) sig += ",";
-        sig += std::to_string(outgoing[i]);
+        hash = hash_combine(hash, outgoing[i]);
     }
-    return sig;
+    return hash;
 }
 
-static bool is_node_type(rwkv_atom_type_t type) {
-    return type == RWKV_ATOM_NODE || 
-           type == RWKV_ATOM_CONCEPT_NODE || 
-           type == RWKV_ATOM_PREDICATE_NODE ||
-           type == RWKV_ATOM_NUMBER_NODE ||
-           type == RWKV_ATOM_VARIABLE_NODE;
+static size_t get_shard_index(uint64_t hash) {
+    return (hash >> 32) % atomspace_shard_count;
 }
 
-static bool is_link_type(rwkv_atom_type_t type) {
-    return !is_node_type(type);
+static std::mutex & get_incoming_mutex(struct rwkv_atomspace * atomspace, rwkv_atom_handle_t handle) {
+    return atomspace->incoming_mutexes[handle % atomspace_shard_count];
 }
 
-// AtomSpace creation and destruction
-struct rwkv_atomspace * rwkv_atomspace_create(void) {
-    try {
-        return new rwkv_atomspace();
-    } catch (...) {
+static size_t atom_index(const struct rwkv_atom * atom) {
+    return (size_t) (atom - atom->block->atoms);
+}
+
+static rwkv_atom_handle_t atom_handle(const struct rwkv_atom * atom) {
+    return atom->block->first_handle + atom_index(atom);
+}
+
+static rwkv_atom_type_t atom_type(const struct rwkv_atom * atom) {
+    return (rwkv_atom_type_t) atom->block->types[atom_index(atom)];
+}
+
+// Returns the atom, or nullptr if there is none with the handle or it is still being added.
+static struct rwkv_atom * find_atom(const struct rwkv_atomspace * atomspace, rwkv_atom_handle_t handle) {
+    if (handle == RWKV_INVALID_ATOM_HANDLE || handle >= atomspace->next_handle.load(std::memory_order_acquire) ||
+        (handle >> atom_block_bits) >= max_atom_blocks) {
         return nullptr;
     }
+    
+    rwkv_atom_block * block = atomspace->blocks[handle >> atom_block_bits].load(std::memory_order_acquire);
+    const size_t index = handle & (atom_block_size - 1);
+    return block && block->ready[index].load(std::memory_order_acquire) ? &block->atoms[index] : nullptr;
 }
 
-void rwkv_atomspace_free(struct rwkv_atomspace * atomspace) {
-    delete atomspace;
+// Calls the function with each atom in order of handles, until it returns false.
+// Atoms added meanwhile may or may not be visited.
+template<typename F>
+static void for_each_atom(const struct rwkv_atomspace * atomspace, F function) {
+    const rwkv_atom_handle_t end = atomspace->next_handle.load(std::memory_order_acquire);
+    
+    for (size_t b = 0; b < max_atom_blocks && (rwkv_atom_handle_t) (b << atom_block_bits) < end; b++) {
+        rwkv_atom_block * block = atomspace->blocks[b].load(std::memory_order_acquire);
+        if (!block) continue;
+        
+        for (size_t i = 0; i < atom_block_size; i++) {
+            if (block->ready[i].load(std::memory_order_acquire) && !function(&block->atoms[i])) return;
+        }
+    }
 }
 
-// Atom creation
-rwkv_atom_handle_t rwkv_atomspace_add_node(
+// Makes an atom findable by its handle, once the atom is complete.
+// The name and outgoing set must stay valid as long as the atom. Returns nullptr if the handle is out of range.
+static struct rwkv_atom * place_atom(
     struct rwkv_atomspace * atomspace,
+    rwkv_atom_handle_t handle,
     rwkv_atom_type_t type,
-    const char * name
+    const char * name,
+    const rwkv_atom_handle_t * outgoing,
+    size_t outgoing_count,
+    const rwkv_truth_value_t & tv,
+    const rwkv_attention_value_t & av
 ) {
-    if (!atomspace || !name || !is_node_type(type)) {
-        return RWKV_INVALID_ATOM_HANDLE;
-    }
+    const size_t block_index = handle >> atom_block_bits;
     
-    std::lock_guard<std::mutex> lock(atomspace->mutex);
+    if (block_index >= max_atom_blocks) {
+        return nullptr;
+    }
     
-    std::string node_name(name);
+    rwkv_atom_block * block = atomspace->blocks[block_index].load(std::memory_order_acquire);
     
-    // Check if node already exists
-    auto it = atomspace->name_index.find(node_name);
-    if (it != atomspace->name_index.end()) {
-        for (rwkv_atom_handle_t handle : it->second) {
-            auto atom_it = atomspace->atoms.find(handle);
-            if (atom_it != atomspace->atoms.end() && atom_it->second->type == type) {
-                return handle;  // Return existing atom
-            }
+    if (!block) {
+        // Threads which need the same block at once race to allocate it; only one of the blocks is kept.
+        rwkv_atom_block * new_block = new rwkv_atom_block(atomspace, (rwkv_atom_handle_t) block_index << atom_block_bits);
+        if (atomspace->blocks[block_index].compare_exchange_strong(block, new_block, std::memory_order_acq_rel)) {
+            block = new_block;
+        } else {
+            delete new_block;
         }
     }
     
-    // Create new atom
-    rwkv_atom_handle_t handle = atomspace->next_handle++;
-    std::unique_ptr<rwkv_atom> atom(new rwkv_atom(handle, type));
-    atom->name = node_name;
+    const size_t index = handle & (atom_block_size - 1);
+    block->types[index] = (uint8_t) type;
+    block->tvs[index] = tv;
+    block->avs[index] = av;
+    block->names[index] = name;
+    block->outgoing[index] = outgoing;
+    block->outgoing_counts[index] = (uint32_t) outgoing_count;
+    block->ready[index].store(true, std::memory_order_release);
     
-    atomspace->atoms[handle] = std::move(atom);
-    atomspace->name_index[node_name].push_back(handle);
+    atomspace->atom_count.fetch_add(1, std::memory_order_relaxed);
     
-    return handle;
+    rwkv_atom_type_index & index_of_type = atomspace->type_indexes[type];
+    std::lock_guard<std::mutex> lock(index_of_type.mutex);
+    index_of_type.handles.push_back(handle);
+    return &block->atoms[index];
 }
 
-rwkv_atom_handle_t rwkv_atomspace_add_link(
+// Records of the change log, see rwkv_atomspace_open_log
+enum rwkv_atomspace_log_op : uint8_t {
+    LOG_OP_NODE = 1,       // Handle, type, name length, name
+    LOG_OP_LINK = 2,       // Handle, type, outgoing count, outgoing set
+    LOG_OP_TRUTH = 3,      // Handle, truth value
+    LOG_OP_ATTENTION = 4,  // Handle, attention value
+    LOG_OP_REMOVE = 5,     // Handle
+    LOG_OP_CLEAR = 6
+};
+
+static void log_atom(
     struct rwkv_atomspace * atomspace,
+    rwkv_atom_handle_t handle,
     rwkv_atom_type_t type,
+    const char * name,
     const rwkv_atom_handle_t * outgoing,
     size_t outgoing_count
 ) {
-    if (!atomspace || !outgoing || outgoing_count == 0 || !is_link_type(type)) {
-        return RWKV_INVALID_ATOM_HANDLE;
-    }
+    std::lock_guard<std::mutex> lock(atomspace->log_mutex);
+    if (!atomspace->log_file) return;
     
-    std::lock_guard<std::mutex> lock(atomspace->mutex);
+    const uint8_t op = name ? LOG_OP_NODE : LOG_OP_LINK;
+    const uint8_t type_byte = (uint8_t) type;
+    const uint32_t count = (uint32_t) (name ? strlen(name) : outgoing_count);
     
-    // Verify all outgoing atoms exist
-    for (size_t i = 0; i < outgoing_count; i++) {
-        if (atomspace->atoms.find(outgoing[i]) == atomspace->atoms.end()) {
-            return RWKV_INVALID_ATOM_HANDLE;
-        }
-    }
+    fwrite(&op, 1, 1, atomspace->log_file);
+    fwrite(&handle, sizeof(handle), 1, atomspace->log_file);
+    fwrite(&type_byte, 1, 1, atomspace->log_file);
+    fwrite(&count, sizeof(count), 1, atomspace->log_file);
     
-    // Check if link already exists
-    std::string signature = create_link_signature(type, outgoing, outgoing_count);
-    if (atomspace->link_signatures.find(signature) != atomspace->link_signatures.end()) {
-        // Find and return existing link handle
-        for (auto it = atomspace->atoms.begin(); it != atomspace->atoms.end(); ++it) {
-            rwkv_atom_handle_t handle = it->first;
-            const std::unique_ptr<rwkv_atom>& atom = it->second;
-            if (atom->type == type && atom->outgoing.size() == outgoing_count) {
-                bool match = true;
-                for (size_t i = 0; i < outgoing_count; i++) {
-                    if (atom->outgoing[i] != outgoing[i]) {
-                        match = false;
-                        break;
-                    }
-                }
-                if (match) return handle;
-            }
-        }
+    if (name) {
+        fwrite(name, 1, count, atomspace->log_file);
+    } else {
+        fwrite(outgoing, sizeof(rwkv_atom_handle_t), count, atomspace->log_file);
     }
+}
+
+static void log_values(const struct rwkv_atom * atom, bool truth, bool attention) {
+    struct rwkv_atomspace * atomspace = atom->block->atomspace;
+    if (!atomspace->log_file.load(std::memory_order_acquire)) return;
     
-    // Create new link
-    rwkv_atom_handle_t handle = atomspace->next_handle++;
-    std::unique_ptr<rwkv_atom> atom(new rwkv_atom(handle, type));
-    atom->outgoing.assign(outgoing, outgoing + outgoing_count);
+    std::lock_guard<std::mutex> lock(atomspace->log_mutex);
+    if (!atomspace->log_file) return;
     
-    atomspace->atoms[handle] = std::move(atom);
-    atomspace->link_signatures.insert(signature);
+    const rwkv_atom_handle_t handle = atom_handle(atom);
+    const size_t i = atom_index(atom);
+    const uint8_t truth_op = LOG_OP_TRUTH;
+    const uint8_t attention_op = LOG_OP_ATTENTION;
     
-    return handle;
-}
-
-// Atom retrieval
-struct rwkv_atom * rwkv_atomspace_get_atom(
-    struct rwkv_atomspace * atomspace,
-    rwkv_atom_handle_t handle
-) {
-    if (!atomspace || handle == RWKV_INVALID_ATOM_HANDLE) {
-        return nullptr;
+    if (truth) {
+        fwrite(&truth_op, 1, 1, atomspace->log_file);
+        fwrite(&handle, sizeof(handle), 1, atomspace->log_file);
+        fwrite(&atom->block->tvs[i], sizeof(rwkv_truth_value_t), 1, atomspace->log_file);
     }
     
-    std::lock_guard<std::mutex> lock(atomspace->mutex);
-    auto it = atomspace->atoms.find(handle);
-    return (it != atomspace->atoms.end()) ? it->second.get() : nullptr;
+    if (attention) {
+        fwrite(&attention_op, 1, 1, atomspace->log_file);
+        fwrite(&handle, sizeof(handle), 1, atomspace->log_file);
+        fwrite(&atom->block->avs[i], sizeof(rwkv_attention_value_t), 1, atomspace->log_file);
+    }
 }
 
-// Truth value operations
-bool rwkv_atom_set_truth_value(
-    struct rwkv_atom * atom,
-    const rwkv_truth_value_t * tv
-) {
-    if (!atom || !tv) return false;
+static void log_op(struct rwkv_atomspace * atomspace, uint8_t op, rwkv_atom_handle_t handle) {
+    std::lock_guard<std::mutex> lock(atomspace->log_mutex);
+    if (!atomspace->log_file) return;
     
-    atom->tv = *tv;
-    // Clamp values to valid ranges
-    atom->tv.strength = std::max(0.0f, std::min(1.0f, atom->tv.strength));
-    atom->tv.confidence = std::max(0.0f, std::min(1.0f, atom->tv.confidence));
-    return true;
-}
-
-bool rwkv_atom_get_truth_value(
-    struct rwkv_atom * atom,
-    rwkv_truth_value_t * tv
-) {
-    if (!atom || !tv) return false;
-    *tv = atom->tv;
-    return true;
+    fwrite(&op, 1, 1, atomspace->log_file);
+    if (op == LOG_OP_REMOVE) fwrite(&handle, sizeof(handle), 1, atomspace->log_file);
 }
 
-// Attention value operations
-bool rwkv_atom_set_attention_value(
-    struct rwkv_atom * atom,
-    const rwkv_attention_value_t * av
+// Allocates a handle and makes a new atom findable by it, once the atom is complete.
+// The name and outgoing set must already be in an arena. Returns nullptr if there are no more handles.
+static struct rwkv_atom * create_atom(
+    struct rwkv_atomspace * atomspace,
+    rwkv_atom_type_t type,
+    const char * name,
+    const rwkv_atom_handle_t * outgoing,
+    size_t outgoing_count
 ) {
-    if (!atom || !av) return false;
-    atom->av = *av;
-    return true;
+    const rwkv_atom_handle_t handle = atomspace->next_handle.fetch_add(1, std::memory_order_acq_rel);
+    
+    // Logged before the atom can be found, so that records of its values follow this one
+    if (atomspace->log_file.load(std::memory_order_acquire) && (handle >> atom_block_bits) < max_atom_blocks) {
+        log_atom(atomspace, handle, type, name, outgoing, outgoing_count);
+    }
+    
+    return place_atom(atomspace, handle, type, name, outgoing, outgoing_count, {0.5f, 0.1f}, {0.0f, 0.0f, 0.0f});
 }
 
-bool rwkv_atom_get_attention_value(
-    struct rwkv_atom * atom,
-    rwkv_attention_value_t * av
-) {
-    if (!atom || !av) return false;
-    *av = atom->av;
-    return true;
+static bool is_node_type(rwkv_atom_type_t type) {
+    return type == RWKV_ATOM_NODE || 
+           type == RWKV_ATOM_CONCEPT_NODE || 
+           type == RWKV_ATOM_PREDICATE_NODE ||
+           type == RWKV_ATOM_NUMBER_NODE ||
+           type == RWKV_ATOM_VARIABLE_NODE;
 }
 
-// Atom property access
-rwkv_atom_type_t rwkv_atom_get_type(struct rwkv_atom * atom) {
-    return atom ? atom->type : RWKV_ATOM_NODE;
+static bool is_link_type(rwkv_atom_type_t type) {
+    return !is_node_type(type);
 }
 
-const char * rwkv_atom_get_name(struct rwkv_atom * atom) {
-    if (!atom || is_link_type(atom->type)) return nullptr;
-    return atom->name.c_str();
+static bool is_valid_type(rwkv_atom_type_t type) {
+    return (size_t) type < atom_type_count;
 }
 
-size_t rwkv_atom_get_outgoing(
-    struct rwkv_atom * atom,
-    rwkv_atom_handle_t * outgoing,
-    size_t max_count
+// Copies handles of atoms of the type, except for the excluded one, and returns the count of them.
+static size_t get_atoms_of_type(
+    struct rwkv_atomspace * atomspace,
+    rwkv_atom_type_t type,
+    rwkv_atom_handle_t excluded,
+    rwkv_atom_handle_t * results,
+    size_t max_results
 ) {
-    if (!atom || !outgoing || !is_link_type(atom->type)) return 0;
+    rwkv_atom_type_index & index = atomspace->type_indexes[type];
+    std::lock_guard<std::mutex> lock(index.mutex);
     
-    size_t count = std::min(max_count, atom->outgoing.size());
-    for (size_t i = 0; i < count; i++) {
-        outgoing[i] = atom->outgoing[i];
+    // Atoms merged by consolidation stay in the index until the end of the consolidation step
+    size_t count = 0;
+    for (size_t i = 0; i < index.handles.size() && count < max_results; i++) {
+        if (index.handles[i] != excluded && find_atom(atomspace, index.handles[i])) results[count++] = index.handles[i];
     }
     return count;
 }
 
-// Pattern matching (simplified implementation)
-size_t rwkv_atomspace_pattern_match(
-    struct rwkv_atomspace * atomspace,
-    rwkv_atom_handle_t pattern,
-    rwkv_atom_handle_t * results,
-    size_t max_results
-) {
-    if (!atomspace || pattern == RWKV_INVALID_ATOM_HANDLE || !results) return 0;
-    
-    std::lock_guard<std::mutex> lock(atomspace->mutex);
-    
-    auto pattern_atom = atomspace->atoms.find(pattern);
-    if (pattern_atom == atomspace->atoms.end()) return 0;
-    
+static size_t count_atoms(struct rwkv_atomspace * atomspace, bool (* predicate)(rwkv_atom_type_t)) {
     size_t count = 0;
-    
-    // Simple pattern matching: find atoms of the same type
-    for (auto it = atomspace->atoms.begin(); it != atomspace->atoms.end(); ++it) {
-        if (count >= max_results) break;
+    for (size_t type = 0; type < atom_type_count; type++) {
+        if (!predicate((rwkv_atom_type_t) type)) continue;
         
-        rwkv_atom_handle_t handle = it->first;
-        const std::unique_ptr<rwkv_atom>& atom = it->second;
-        
-        if (atom->type == pattern_atom->second->type && handle != pattern) {
-            results[count++] = handle;
-        }
+        rwkv_atom_type_index & index = atomspace->type_indexes[type];
+        std::lock_guard<std::mutex> lock(index.mutex);
+        count += index.handles.size();
     }
-    
     return count;
 }
 
-// RWKV integration functions
-bool rwkv_context_to_atoms(
-    struct rwkv_context * rwkv_ctx,
-    struct rwkv_atomspace * atomspace,
-    const float * state,
-    size_t state_len
-) {
-    // rwkv_ctx can be NULL for standalone AtomSpace usage
-    if (!atomspace || !state) return false;
+// Calls the function with each implication link A -> B in the incoming set of A.
+template<typename F>
+static void for_each_implication(struct rwkv_atomspace * atomspace, const struct rwkv_atom * premise, F function) {
+    const rwkv_atom_handle_t premise_handle = atom_handle(premise);
+    std::vector<rwkv_atom_handle_t> incoming;
+    {
+        std::lock_guard<std::mutex> lock(get_incoming_mutex(atomspace, premise_handle));
+        incoming = premise->block->incoming[atom_index(premise)];
+    }
     
-    // Convert significant state values to concept nodes
-    // This is a simplified implementation - in practice, you'd want more sophisticated conversion
-    
-    for (size_t i = 0; i < std::min(state_len, size_t(100)); i++) {
-        if (std::abs(state[i]) > 0.1f) {  // Only consider significant activations
-            std::string concept_name = "state_" + std::to_string(i);
-            rwkv_atom_handle_t handle = rwkv_atomspace_add_node(
-                atomspace, RWKV_ATOM_CONCEPT_NODE, concept_name.c_str()
-            );
-            
-            if (handle != RWKV_INVALID_ATOM_HANDLE) {
-                struct rwkv_atom * atom = rwkv_atomspace_get_atom(atomspace, handle);
-                if (atom) {
-                    rwkv_truth_value_t tv = {std::abs(state[i]), 0.8f};
-                    rwkv_atom_set_truth_value(atom, &tv);
-                    
-                    rwkv_attention_value_t av = {state[i] > 0 ? state[i] : 0.0f, 0.0f, 0.0f};
-                    rwkv_atom_set_attention_value(atom, &av);
-                }
-            }
+    for (rwkv_atom_handle_t handle : incoming) {
+        const struct rwkv_atom * link = find_atom(atomspace, handle);
+        if (!link) continue;  // Merged meanwhile
+        
+        const size_t i = atom_index(link);
+        const rwkv_atom_block * block = link->block;
+        if (block->types[i] == RWKV_ATOM_IMPLICATION_LINK && block->outgoing_counts[i] == 2 && block->outgoing[i][0] == premise_handle) {
+            if (!function(block->outgoing[i][1])) break;
         }
     }
-    
-    return true;
 }
 
-bool rwkv_atoms_to_context(
+// Returns the node, adding it if needed. The shard of the name must be locked.
+static rwkv_atom_handle_t add_node_locked(
     struct rwkv_atomspace * atomspace,
-    struct rwkv_context * rwkv_ctx,
-    float * state,
-    size_t state_len
+    rwkv_atomspace_shard & shard,
+    uint64_t hash,
+    rwkv_atom_type_t type,
+    const char * name
 ) {
-    // rwkv_ctx can be NULL for standalone AtomSpace usage
-    if (!atomspace || !state) return false;
+    rwkv_atom_handle_t handle = RWKV_INVALID_ATOM_HANDLE;
+    const char * interned_name = nullptr;
     
-    // Initialize state to zeros
-    memset(state, 0, state_len * sizeof(float));
+    // Check if node already exists; nodes of other types with the name share its storage
+    shard.atoms.find(hash, [&](rwkv_atom_handle_t candidate) -> bool {
+        const struct rwkv_atom * atom = find_atom(atomspace, candidate);
+        const char * candidate_name = atom->block->names[atom_index(atom)];
+        if (strcmp(candidate_name, name) != 0) return true;
+        
+        interned_name = candidate_name;
+        if (atom_type(atom) == type) handle = candidate;
+        return handle == RWKV_INVALID_ATOM_HANDLE;
+    });
     
-    std::lock_guard<std::mutex> lock(atomspace->mutex);
+    if (handle != RWKV_INVALID_ATOM_HANDLE) {
+        return handle;  // Return existing atom
+    }
     
-    // Convert atoms back to state values
-    // This is a simplified implementation
-    for (auto it = atomspace->atoms.begin(); it != atomspace->atoms.end(); ++it) {
-        const std::unique_ptr<rwkv_atom>& atom = it->second;
-        if (atom->type == RWKV_ATOM_CONCEPT_NODE && atom->name.find("state_") == 0) {
-            try {
-                size_t index = std::stoul(atom->name.substr(6));  // Remove "state_" prefix
-                if (index < state_len) {
-                    state[index] = atom->tv.strength * (atom->av.sti > 0 ? 1.0f : -1.0f);
-                }
-            } catch (...) {
-                // Ignore parsing errors
-            }
-        }
+    if (!interned_name) {
+        const size_t size = strlen(name) + 1;
+        char * data = (char *) shard.arena.allocate(size, 1);
+        memcpy(data, name, size);
+        interned_name = data;
     }
     
-    return true;
+    // Create new atom
+    struct rwkv_atom * atom = create_atom(atomspace, type, interned_name, nullptr, 0);
+    if (!atom) return RWKV_INVALID_ATOM_HANDLE;
+    
+    shard.atoms.insert(hash, atom_handle(atom));
+    
+    return atom_handle(atom);
 }
 
-// Simple forward inference
-bool rwkv_atomspace_forward_inference(
+// Returns the link, adding it if needed, or the invalid handle if an outgoing atom does not exist.
+// The shard of the link must be locked.
+static rwkv_atom_handle_t add_link_locked(
     struct rwkv_atomspace * atomspace,
-    rwkv_atom_handle_t premise,
-    rwkv_atom_handle_t * conclusions,
-    size_t max_conclusions,
-    size_t * num_conclusions
-) {
-    if (!atomspace || premise == RWKV_INVALID_ATOM_HANDLE || !conclusions || !num_conclusions) {
+    rwkv_atomspace_shard & shard,
+    uint64_t hash,
+    rwkv_atom_type_t type,
+    const rwkv_atom_handle_t * outgoing,
+    size_t outgoing_count
+) {
+    // Outgoing atoms are verified under the lock, as consolidation removes atoms only while holding all shard locks
+    for (size_t i = 0; i < outgoing_count; i++) {
+        if (!find_atom(atomspace, outgoing[i])) return RWKV_INVALID_ATOM_HANDLE;
+    }
+    
+    rwkv_atom_handle_t handle = RWKV_INVALID_ATOM_HANDLE;
+    
+    // Check if link already exists
+    shard.atoms.find(hash, [&](rwkv_atom_handle_t candidate) -> bool {
+        const struct rwkv_atom * atom = find_atom(atomspace, candidate);
+        const size_t i = atom_index(atom);
+        if (atom_type(atom) == type && atom->block->outgoing_counts[i] == outgoing_count &&
+            std::equal(outgoing, outgoing + outgoing_count, atom->block->outgoing[i])) {
+            handle = candidate;
+        }
+        return handle == RWKV_INVALID_ATOM_HANDLE;
+    });
+    
+    if (handle != RWKV_INVALID_ATOM_HANDLE) {
+        return handle;
+    }
+    
+    rwkv_atom_handle_t * stored_outgoing = (rwkv_atom_handle_t *) shard.arena.allocate(
+        outgoing_count * sizeof(rwkv_atom_handle_t), alignof(rwkv_atom_handle_t)
+    );
+    std::copy_n(outgoing, outgoing_count, stored_outgoing);
+    
+    // Create new link
+    struct rwkv_atom * atom = create_atom(atomspace, type, nullptr, stored_outgoing, outgoing_count);
+    if (!atom) return RWKV_INVALID_ATOM_HANDLE;
+    
+    handle = atom_handle(atom);
+    shard.atoms.insert(hash, handle);
+    
+    // Add the link to incoming sets while the shard is still locked, so that it is in them once it can be found.
+    // Incoming locks are never held while taking shard locks.
+    for (size_t i = 0; i < outgoing_count; i++) {
+        if (std::find(outgoing, outgoing + i, outgoing[i]) != outgoing + i) continue;  // Repeated target
+        
+        struct rwkv_atom * target = find_atom(atomspace, outgoing[i]);
+        std::lock_guard<std::mutex> incoming_lock(get_incoming_mutex(atomspace, outgoing[i]));
+        target->block->incoming[atom_index(target)].push_back(handle);
+    }
+    
+    return handle;
+}
+
+// Calls the function with the index of each item and the shard of its hash, sorted by shard, so that each shard is locked once.
+template<typename F>
+static void for_each_by_shard(struct rwkv_atomspace * atomspace, const std::vector<uint64_t> & hashes, F function) {
+    std::vector<size_t> order(hashes.size());
+    for (size_t i = 0; i < order.size(); i++) order[i] = i;
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        return get_shard_index(hashes[a]) < get_shard_index(hashes[b]);
+    });
+    
+    for (size_t begin = 0; begin < order.size();) {
+        const size_t shard_index = get_shard_index(hashes[order[begin]]);
+        rwkv_atomspace_shard & shard = atomspace->shards[shard_index];
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        
+        size_t end = begin;
+        for (; end < order.size() && get_shard_index(hashes[order[end]]) == shard_index; end++) {
+            function(order[end], shard);
+        }
+        begin = end;
+    }
+}
+
+// AtomSpace creation and destruction
+struct rwkv_atomspace * rwkv_atomspace_create(void) {
+    try {
+        return new rwkv_atomspace();
+    } catch (...) {
+        return nullptr;
+    }
+}
+
+void rwkv_atomspace_free(struct rwkv_atomspace * atomspace) {
+    delete atomspace;
+}
+
+void rwkv_atomspace_clear(struct rwkv_atomspace * atomspace) {
+    if (!atomspace) return;
+    
+    atomspace->free_blocks();
+    atomspace->atom_count.store(0);
+    
+    for (rwkv_atomspace_shard & shard : atomspace->shards) {
+        shard.atoms.clear();
+        shard.arena.clear();
+    }
+    
+    for (rwkv_atom_type_index & index : atomspace->type_indexes) {
+        index.handles.clear();
+    }
+    
+    atomspace->similarity_index.clear();
+    atomspace->snapshots.clear();
+    log_op(atomspace, LOG_OP_CLEAR, RWKV_INVALID_ATOM_HANDLE);
+}
+
+// Atom creation
+rwkv_atom_handle_t rwkv_atomspace_add_node(
+    struct rwkv_atomspace * atomspace,
+    rwkv_atom_type_t type,
+    const char * name
+) {
+    if (!atomspace || !name || !is_node_type(type)) {
+        return RWKV_INVALID_ATOM_HANDLE;
+    }
+    
+    const uint64_t hash = hash_name(name);
+    rwkv_atomspace_shard & shard = atomspace->shards[get_shard_index(hash)];
+    
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    return add_node_locked(atomspace, shard, hash, type, name);
+}
+
+rwkv_atom_handle_t rwkv_atomspace_add_link(
+    struct rwkv_atomspace * atomspace,
+    rwkv_atom_type_t type,
+    const rwkv_atom_handle_t * outgoing,
+    size_t outgoing_count
+) {
+    if (!atomspace || !outgoing || outgoing_count == 0 || !is_valid_type(type) || !is_link_type(type)) {
+        return RWKV_INVALID_ATOM_HANDLE;
+    }
+    
+    const uint64_t hash = hash_link(type, outgoing, outgoing_count);
+    rwkv_atomspace_shard & shard = atomspace->shards[get_shard_index(hash)];
+    
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    return add_link_locked(atomspace, shard, hash, type, outgoing, outgoing_count);
+}
+
+// Bulk atom creation
+size_t rwkv_atomspace_add_nodes(
+    struct rwkv_atomspace * atomspace,
+    rwkv_atom_type_t type,
+    const char * const * names,
+    size_t count,
+    rwkv_atom_handle_t * handles
+) {
+    if (!atomspace || !names || !handles || !is_node_type(type)) {
+        return 0;
+    }
+    
+    std::vector<uint64_t> hashes(count);
+    for (size_t i = 0; i < count; i++) {
+        handles[i] = RWKV_INVALID_ATOM_HANDLE;
+        hashes[i] = names[i] ? hash_name(names[i]) : 0;
+    }
+    
+    size_t added = 0;
+    for_each_by_shard(atomspace, hashes, [&](size_t i, rwkv_atomspace_shard & shard) {
+        if (!names[i]) return;
+        
+        handles[i] = add_node_locked(atomspace, shard, hashes[i], type, names[i]);
+        if (handles[i] != RWKV_INVALID_ATOM_HANDLE) added++;
+    });
+    return added;
+}
+
+size_t rwkv_atomspace_add_links(
+    struct rwkv_atomspace * atomspace,
+    rwkv_atom_type_t type,
+    const rwkv_atom_handle_t * outgoing,
+    const size_t * outgoing_counts,
+    size_t count,
+    rwkv_atom_handle_t * handles
+) {
+    if (!atomspace || !outgoing || !outgoing_counts || !handles || !is_valid_type(type) || !is_link_type(type)) {
+        return 0;
+    }
+    
+    std::vector<size_t> offsets(count);
+    std::vector<uint64_t> hashes(count);
+    std::vector<bool> valid(count);
+    
+    for (size_t i = 0, offset = 0; i < count; offset += outgoing_counts[i], i++) {
+        handles[i] = RWKV_INVALID_ATOM_HANDLE;
+        offsets[i] = offset;
+        hashes[i] = hash_link(type, outgoing + offset, outgoing_counts[i]);
+        valid[i] = outgoing_counts[i] > 0;
+    }
+    
+    size_t added = 0;
+    for_each_by_shard(atomspace, hashes, [&](size_t i, rwkv_atomspace_shard & shard) {
+        if (!valid[i]) return;
+        
+        handles[i] = add_link_locked(atomspace, shard, hashes[i], type, outgoing + offsets[i], outgoing_counts[i]);
+        if (handles[i] != RWKV_INVALID_ATOM_HANDLE) added++;
+    });
+    return added;
+}
+
+// Atom retrieval
+struct rwkv_atom * rwkv_atomspace_get_atom(
+    struct rwkv_atomspace * atomspace,
+    rwkv_atom_handle_t handle
+) {
+    if (!atomspace) {
+        return nullptr;
+    }
+    
+    return find_atom(atomspace, handle);
+}
+
+size_t rwkv_atomspace_get_incoming(
+    struct rwkv_atomspace * atomspace,
+    rwkv_atom_handle_t handle,
+    rwkv_atom_handle_t * incoming,
+    size_t max_count
+) {
+    if (!atomspace) return 0;
+    
+    const struct rwkv_atom * atom = find_atom(atomspace, handle);
+    if (!atom) return 0;
+    
+    std::lock_guard<std::mutex> lock(get_incoming_mutex(atomspace, handle));
+    const std::vector<rwkv_atom_handle_t> & atom_incoming = atom->block->incoming[atom_index(atom)];
+    
+    if (incoming) {
+        std::copy_n(atom_incoming.begin(), std::min(max_count, atom_incoming.size()), incoming);
+    }
+    return atom_incoming.size();
+}
+
+// Truth value operations
+bool rwkv_atom_set_truth_value(
+    struct rwkv_atom * atom,
+    const rwkv_truth_value_t * tv
+) {
+    if (!atom || !tv) return false;
+    
+    rwkv_truth_value_t & atom_tv = atom->block->tvs[atom_index(atom)];
+    atom_tv = *tv;
+    // Clamp values to valid ranges
+    atom_tv.strength = std::max(0.0f, std::min(1.0f, atom_tv.strength));
+    atom_tv.confidence = std::max(0.0f, std::min(1.0f, atom_tv.confidence));
+    log_values(atom, true, false);
+    return true;
+}
+
+bool rwkv_atom_get_truth_value(
+    struct rwkv_atom * atom,
+    rwkv_truth_value_t * tv
+) {
+    if (!atom || !tv) return false;
+    *tv = atom->block->tvs[atom_index(atom)];
+    return true;
+}
+
+// Attention value operations
+bool rwkv_atom_set_attention_value(
+    struct rwkv_atom * atom,
+    const rwkv_attention_value_t * av
+) {
+    if (!atom || !av) return false;
+    atom->block->avs[atom_index(atom)] = *av;
+    log_values(atom, false, true);
+    return true;
+}
+
+bool rwkv_atom_get_attention_value(
+    struct rwkv_atom * atom,
+    rwkv_attention_value_t * av
+) {
+    if (!atom || !av) return false;
+    *av = atom->block->avs[atom_index(atom)];
+    return true;
+}
+
+// Atom property access
+rwkv_atom_type_t rwkv_atom_get_type(struct rwkv_atom * atom) {
+    return atom ? atom_type(atom) : RWKV_ATOM_NODE;
+}
+
+const char * rwkv_atom_get_name(struct rwkv_atom * atom) {
+    if (!atom || is_link_type(atom_type(atom))) return nullptr;
+    return atom->block->names[atom_index(atom)];
+}
+
+size_t rwkv_atom_get_outgoing(
+    struct rwkv_atom * atom,
+    rwkv_atom_handle_t * outgoing,
+    size_t max_count
+) {
+    if (!atom || !outgoing || !is_link_type(atom_type(atom))) return 0;
+    
+    const size_t index = atom_index(atom);
+    size_t count = std::min(max_count, (size_t) atom->block->outgoing_counts[index]);
+    std::copy_n(atom->block->outgoing[index], count, outgoing);
+    return count;
+}
+
+// Pattern matching (simplified implementation)
+size_t rwkv_atomspace_pattern_match(
+    struct rwkv_atomspace * atomspace,
+    rwkv_atom_handle_t pattern,
+    rwkv_atom_handle_t * results,
+    size_t max_results
+) {
+    if (!atomspace || pattern == RWKV_INVALID_ATOM_HANDLE || !results) return 0;
+    
+    const struct rwkv_atom * pattern_atom = find_atom(atomspace, pattern);
+    if (!pattern_atom) return 0;
+    
+    // Simple pattern matching: find atoms of the same type
+    return get_atoms_of_type(atomspace, atom_type(pattern_atom), pattern, results, max_results);
+}
+
+// Writes indices of elements with an absolute value above the threshold, and returns the count of them.
+// indices must fit count elements. NaN elements are never above the threshold.
+static size_t find_significant(const float * values, size_t count, float threshold, uint32_t * indices) {
+    size_t found = 0;
+    size_t i = 0;
+    
+#if defined(RWKV_OPENCOG_SSE2)
+    const __m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+    const __m128 threshold_vec = _mm_set1_ps(threshold);
+    
+    for (; i + 4 <= count; i += 4) {
+        const int mask = _mm_movemask_ps(_mm_cmpgt_ps(_mm_and_ps(_mm_loadu_ps(values + i), abs_mask), threshold_vec));
+        if (!mask) continue;
+        
+        // Indices are written unconditionally and kept only for set bits, so that dense states do not branch.
+        for (int j = 0; j < 4; j++) {
+            indices[found] = (uint32_t) (i + j);
+            found += (mask >> j) & 1;
+        }
+    }
+#elif defined(RWKV_OPENCOG_NEON)
+    const float32x4_t threshold_vec = vdupq_n_f32(threshold);
+    
+    for (; i + 4 <= count; i += 4) {
+        const uint32x4_t mask = vcgtq_f32(vabsq_f32(vld1q_f32(values + i)), threshold_vec);
+        if (!vmaxvq_u32(mask)) continue;
+        
+        uint32_t lanes[4];
+        vst1q_u32(lanes, mask);
+        for (int j = 0; j < 4; j++) {
+            indices[found] = (uint32_t) (i + j);
+            found += lanes[j] & 1;
+        }
+    }
+#endif
+    
+    for (; i < count; i++) {
+        indices[found] = (uint32_t) i;
+        found += std::fabs(values[i]) > threshold;
+    }
+    return found;
+}
+
+// Adds or finds the concept nodes of state elements at the positions, in one bulk call.
+static void add_state_nodes(
+    struct rwkv_atomspace * atomspace,
+    const uint32_t * positions,
+    size_t count,
+    rwkv_atom_handle_t * handles
+) {
+    // "state_" and a 32-bit index fit a fixed stride, so names need a single buffer
+    const size_t name_size = 32;
+    std::vector<char> name_data(count * name_size);
+    std::vector<const char *> names(count);
+    
+    for (size_t i = 0; i < count; i++) {
+        names[i] = &name_data[i * name_size];
+        snprintf(&name_data[i * name_size], name_size, "state_%u", (unsigned) positions[i]);
+    }
+    
+    rwkv_atomspace_add_nodes(atomspace, RWKV_ATOM_CONCEPT_NODE, names.data(), count, handles);
+}
+
+// Stores a state element in the values of its node, see rwkv_state_bridge_to_atoms.
+static void set_state_values(struct rwkv_atom * atom, float value, float confidence) {
+    const size_t i = atom_index(atom);
+    atom->block->tvs[i] = {std::min(std::fabs(value), 1.0f), confidence};
+    atom->block->avs[i].sti = value;
+    log_values(atom, true, true);
+}
+
+// RWKV integration functions
+bool rwkv_context_to_atoms(
+    struct rwkv_context * rwkv_ctx,
+    struct rwkv_atomspace * atomspace,
+    const float * state,
+    size_t state_len
+) {
+    // rwkv_ctx can be NULL for standalone AtomSpace usage
+    if (!atomspace || !state) return false;
+    
+    // Convert significant state values to concept nodes
+    // Positions are 32-bit like names of state nodes, which covers states of any model
+    const size_t length = std::min(state_len, size_t(UINT32_MAX));
+    std::vector<uint32_t> positions(length);
+    positions.resize(find_significant(state, length, 0.1f, positions.data()));  // Only consider significant activations
+    
+    std::vector<rwkv_atom_handle_t> handles(positions.size());
+    add_state_nodes(atomspace, positions.data(), positions.size(), handles.data());
+    
+    for (size_t i = 0; i < positions.size(); i++) {
+        struct rwkv_atom * atom = find_atom(atomspace, handles[i]);
+        if (!atom) continue;
+        
+        const float value = state[positions[i]];
+        rwkv_truth_value_t tv = {std::abs(value), 0.8f};
+        rwkv_atom_set_truth_value(atom, &tv);
+        
+        rwkv_attention_value_t av = {value > 0 ? value : 0.0f, 0.0f, 0.0f};
+        rwkv_atom_set_attention_value(atom, &av);
+    }
+    
+    return true;
+}
+
+bool rwkv_atoms_to_context(
+    struct rwkv_atomspace * atomspace,
+    struct rwkv_context * rwkv_ctx,
+    float * state,
+    size_t state_len
+) {
+    // rwkv_ctx can be NULL for standalone AtomSpace usage
+    if (!atomspace || !state) return false;
+    
+    // Initialize state to zeros
+    memset(state, 0, state_len * sizeof(float));
+    
+    // Convert atoms back to state values
+    // Only concept nodes can hold state values, so the others are never looked at.
+    std::vector<rwkv_atom_handle_t> concepts;
+    {
+        rwkv_atom_type_index & index = atomspace->type_indexes[RWKV_ATOM_CONCEPT_NODE];
+        std::lock_guard<std::mutex> lock(index.mutex);
+        concepts = index.handles;
+    }
+    
+    for (rwkv_atom_handle_t handle : concepts) {
+        const struct rwkv_atom * atom = find_atom(atomspace, handle);
+        if (!atom) continue;
+        
+        const size_t i = atom_index(atom);
+        const rwkv_atom_block * block = atom->block;
+        if (strncmp(block->names[i], "state_", 6) != 0) continue;
+        
+        const char * digits = block->names[i] + 6;  // Remove "state_" prefix
+        char * digits_end = nullptr;
+        const unsigned long index = strtoul(digits, &digits_end, 10);
+        if (digits_end == digits || *digits_end != '\0' || index >= state_len) continue;
+        
+        state[index] = block->tvs[i].strength * (block->avs[i].sti > 0 ? 1.0f : -1.0f);
+    }
+    
+    return true;
+}
+
+// A contiguous slice of states mirrored by a bridge, and where its handles start in the table.
+struct rwkv_state_range {
+    size_t state_offset;
+    size_t length;
+    size_t table_offset;
+};
+
+struct rwkv_state_bridge {
+    struct rwkv_atomspace * atomspace;
+    std::vector<rwkv_state_range> ranges;
+    size_t min_state_len;
+    float threshold;
+    float confidence;
+    
+    // Handle of the node of each mirrored element, or the invalid handle if it has none yet
+    std::vector<rwkv_atom_handle_t> handles;
+    // Table indices of elements significant in the last call, and scratch space for the next one
+    std::vector<uint32_t> active;
+    std::vector<uint32_t> significant;
+    std::vector<uint32_t> range_indices;
+    std::vector<uint32_t> missing_positions;
+    std::vector<uint32_t> missing_indices;
+    std::vector<rwkv_atom_handle_t> missing_handles;
+};
+
+bool rwkv_get_state_layout(const struct rwkv_context * rwkv_ctx, rwkv_state_layout_t * layout) {
+    if (!rwkv_ctx || !layout) return false;
+    
+    layout->n_embed = rwkv_get_n_embed(rwkv_ctx);
+    layout->n_layer = rwkv_get_n_layer(rwkv_ctx);
+    
+    // A layer of RWKV v4 has 5 vectors of n_embed elements; a layer of RWKV v5+ has 2 and head_size of them,
+    // and heads are never as small as 3.
+    const size_t vectors_per_layer = rwkv_get_state_len(rwkv_ctx) / (layout->n_embed * layout->n_layer);
+    layout->head_size = vectors_per_layer == 5 ? 0 : vectors_per_layer - 2;
+    return true;
+}
+
+struct rwkv_state_bridge * rwkv_state_bridge_create(
+    struct rwkv_atomspace * atomspace,
+    const rwkv_state_layout_t * layout,
+    const rwkv_state_projection_t * projection
+) {
+    if (!atomspace || !layout || !projection || layout->n_embed == 0) return nullptr;
+    
+    const size_t n_embed = layout->n_embed;
+    const size_t head_size = layout->head_size;
+    const bool has_heads = head_size > 0;
+    if (has_heads && n_embed % head_size != 0) return nullptr;
+    
+    const size_t vectors_per_layer = has_heads ? 2 + head_size : 5;
+    const size_t total_heads = has_heads ? n_embed / head_size : 0;
+    
+    // States must be indexable by the 32-bit positions in names and tables
+    if ((uint64_t) n_embed * vectors_per_layer * layout->n_layer > UINT32_MAX) return nullptr;
+    
+    const size_t first_layer = projection->first_layer;
+    if (first_layer >= layout->n_layer) return nullptr;
+    const size_t layer_end = projection->layer_count ? std::min(layout->n_layer, first_layer + projection->layer_count) : layout->n_layer;
+    
+    const size_t first_head = projection->first_head;
+    const size_t head_end = projection->head_count ? std::min(total_heads, first_head + projection->head_count) : total_heads;
+    
+    std::unique_ptr<rwkv_state_bridge> bridge(new(std::nothrow) rwkv_state_bridge());
+    if (!bridge) return nullptr;
+    
+    bridge->atomspace = atomspace;
+    bridge->threshold = projection->threshold;
+    bridge->confidence = projection->confidence;
+    
+    size_t table_size = 0;
+    auto add_range = [&](size_t state_offset, size_t length) {
+        if (length == 0) return;
+        
+        // Adjacent slices are merged, so that the threshold kernel runs over long spans
+        if (!bridge->ranges.empty() && bridge->ranges.back().state_offset + bridge->ranges.back().length == state_offset) {
+            bridge->ranges.back().length += length;
+        } else {
+            bridge->ranges.push_back({state_offset, length, table_size});
+        }
+        table_size += length;
+    };
+    
+    // Parts of a layer in the order of the state, see rwkv_create_input_and_output_views in rwkv_graph.inc
+    const uint32_t v4_parts[5] = {
+        RWKV_STATE_PART_FFN_XX, RWKV_STATE_PART_ATT_XX, RWKV_STATE_PART_ATT_AA, RWKV_STATE_PART_ATT_BB, RWKV_STATE_PART_ATT_PP
+    };
+    
+    for (size_t layer = first_layer; layer < layer_end; layer++) {
+        const size_t base = layer * vectors_per_layer * n_embed;
+        
+        for (size_t part = 0; part < (has_heads ? 2 : 5); part++) {
+            if (projection->parts & v4_parts[part]) add_range(base + part * n_embed, n_embed);
+        }
+        
+        if (has_heads && (projection->parts & RWKV_STATE_PART_ATT_HEADS) && first_head < head_end) {
+            add_range(base + 2 * n_embed + first_head * head_size * head_size, (head_end - first_head) * head_size * head_size);
+        }
+    }
+    
+    if (table_size == 0) return nullptr;
+    
+    size_t max_range_length = 0;
+    for (const rwkv_state_range & range : bridge->ranges) {
+        max_range_length = std::max(max_range_length, range.length);
+    }
+    
+    try {
+        bridge->handles.assign(table_size, RWKV_INVALID_ATOM_HANDLE);
+        bridge->range_indices.resize(max_range_length);
+    } catch (...) {
+        return nullptr;
+    }
+    
+    bridge->min_state_len = bridge->ranges.back().state_offset + bridge->ranges.back().length;
+    return bridge.release();
+}
+
+void rwkv_state_bridge_free(struct rwkv_state_bridge * bridge) {
+    delete bridge;
+}
+
+bool rwkv_state_bridge_to_atoms(
+    struct rwkv_state_bridge * bridge,
+    const float * state,
+    size_t state_len
+) {
+    if (!bridge || !state || state_len < bridge->min_state_len) return false;
+    
+    struct rwkv_atomspace * atomspace = bridge->atomspace;
+    std::vector<uint32_t> & significant = bridge->significant;
+    std::vector<uint32_t> & missing_positions = bridge->missing_positions;
+    std::vector<uint32_t> & missing_indices = bridge->missing_indices;
+    
+    significant.clear();
+    missing_positions.clear();
+    missing_indices.clear();
+    
+    try {
+        for (const rwkv_state_range & range : bridge->ranges) {
+            const size_t found = find_significant(state + range.state_offset, range.length, bridge->threshold, bridge->range_indices.data());
+            
+            for (size_t i = 0; i < found; i++) {
+                const uint32_t index = (uint32_t) range.table_offset + bridge->range_indices[i];
+                significant.push_back(index);
+                
+                // Handles become invalid if the AtomSpace was cleared
+                if (!find_atom(atomspace, bridge->handles[index])) {
+                    missing_positions.push_back((uint32_t) range.state_offset + bridge->range_indices[i]);
+                    missing_indices.push_back(index);
+                }
+            }
+        }
+        
+        bridge->missing_handles.resize(missing_positions.size());
+        add_state_nodes(atomspace, missing_positions.data(), missing_positions.size(), bridge->missing_handles.data());
+    } catch (...) {
+        return false;
+    }
+    
+    for (size_t i = 0; i < missing_indices.size(); i++) {
+        bridge->handles[missing_indices[i]] = bridge->missing_handles[i];
+    }
+    
+    // Nodes are written directly, since their handles are known and the values have been checked already.
+    // Elements stay in table order, so states are read in the order of their ranges.
+    size_t range = 0;
+    for (uint32_t index : significant) {
+        while (index >= bridge->ranges[range].table_offset + bridge->ranges[range].length) range++;
+        
+        struct rwkv_atom * atom = find_atom(atomspace, bridge->handles[index]);
+        if (atom) {
+            const float value = state[bridge->ranges[range].state_offset + (index - bridge->ranges[range].table_offset)];
+            set_state_values(atom, value, bridge->confidence);
+        }
+    }
+    
+    // Elements which are not significant anymore are exactly the ones of the last call missing from this one,
+    // as both lists are sorted.
+    std::vector<uint32_t>::const_iterator next = significant.begin();
+    for (uint32_t index : bridge->active) {
+        next = std::lower_bound(next, significant.cend(), index);
+        if (next != significant.cend() && *next == index) continue;
+        
+        struct rwkv_atom * atom = find_atom(atomspace, bridge->handles[index]);
+        if (atom) set_state_values(atom, 0.0f, bridge->confidence);
+    }
+    
+    bridge->active.swap(significant);
+    return true;
+}
+
+size_t rwkv_state_bridge_get_active(
+    struct rwkv_state_bridge * bridge,
+    rwkv_atom_handle_t * handles,
+    size_t max_count
+) {
+    if (!bridge) return 0;
+    
+    if (handles) {
+        const size_t count = std::min(max_count, bridge->active.size());
+        for (size_t i = 0; i < count; i++) {
+            handles[i] = bridge->handles[bridge->active[i]];
+        }
+    }
+    return bridge->active.size();
+}
+
+bool rwkv_state_bridge_to_state(
+    struct rwkv_state_bridge * bridge,
+    float * state,
+    size_t state_len
+) {
+    if (!bridge || !state || state_len < bridge->min_state_len) return false;
+    
+    for (const rwkv_state_range & range : bridge->ranges) {
+        const rwkv_atom_handle_t * handles = &bridge->handles[range.table_offset];
+        float * values = state + range.state_offset;
+        
+        for (size_t i = 0; i < range.length; i++) {
+            const struct rwkv_atom * atom = find_atom(bridge->atomspace, handles[i]);
+            values[i] = atom ? atom->block->avs[atom_index(atom)].sti : 0.0f;
+        }
+    }
+    
+    return true;
+}
+
+// Simple forward inference
+bool rwkv_atomspace_forward_inference(
+    struct rwkv_atomspace * atomspace,
+    rwkv_atom_handle_t premise,
+    rwkv_atom_handle_t * conclusions,
+    size_t max_conclusions,
+    size_t * num_conclusions
+) {
+    if (!atomspace || premise == RWKV_INVALID_ATOM_HANDLE || !conclusions || !num_conclusions) {
+        return false;
+    }
+    
+    *num_conclusions = 0;
+    
+    const struct rwkv_atom * premise_atom = find_atom(atomspace, premise);
+    if (!premise_atom) return true;
+    
+    // Simple inference: if we have an implication link A -> B and we know A, infer B
+    // Only links containing A are looked at, through its incoming set.
+    for_each_implication(atomspace, premise_atom, [&](rwkv_atom_handle_t conclusion) -> bool {
+        if (*num_conclusions >= max_conclusions) return false;
+        
+        conclusions[(*num_conclusions)++] = conclusion;
+        return true;
+    });
+    
+    return true;
+}
+
+// Forward chaining over implication links
+bool rwkv_atomspace_forward_chain(
+    struct rwkv_atomspace * atomspace,
+    rwkv_atom_handle_t premise,
+    size_t max_steps,
+    rwkv_atom_handle_t * conclusions,
+    size_t max_conclusions,
+    size_t * num_conclusions
+) {
+    if (!atomspace || premise == RWKV_INVALID_ATOM_HANDLE || !conclusions || !num_conclusions) {
+        return false;
+    }
+    
+    *num_conclusions = 0;
+    
+    if (!find_atom(atomspace, premise)) return true;
+    
+    // Breadth-first worklist: each atom is expanded once, through its incoming set, so the cost is in proportion
+    // to the implications reachable from the premise. Conclusions of step n + 1 start at the end of step n.
+    std::unordered_set<rwkv_atom_handle_t> seen;
+    std::vector<rwkv_atom_handle_t> worklist;
+    seen.insert(premise);
+    worklist.push_back(premise);
+    
+    size_t step_begin = 0;
+    
+    for (size_t step = 0; (max_steps == 0 || step < max_steps) && step_begin < worklist.size(); step++) {
+        const size_t step_end = worklist.size();
+        
+        for (size_t i = step_begin; i < step_end && *num_conclusions < max_conclusions; i++) {
+            const struct rwkv_atom * atom = find_atom(atomspace, worklist[i]);
+            if (!atom) continue;  // Merged meanwhile
+            
+            for_each_implication(atomspace, atom, [&](rwkv_atom_handle_t conclusion) -> bool {
+                if (*num_conclusions >= max_conclusions) return false;
+                
+                if (seen.insert(conclusion).second) {
+                    worklist.push_back(conclusion);
+                    conclusions[(*num_conclusions)++] = conclusion;
+                }
+                return true;
+            });
+        }
+        
+        step_begin = step_end;
+    }
+    
+    return true;
+}
+
+// Memory consolidation
+
+// Locks all shards, so that no atoms are added while atoms are removed. Lookups go on without locks.
+struct rwkv_atomspace_write_lock {
+    struct rwkv_atomspace * atomspace;
+    
+    explicit rwkv_atomspace_write_lock(struct rwkv_atomspace * atomspace) : atomspace(atomspace) {
+        for (rwkv_atomspace_shard & shard : atomspace->shards) shard.mutex.lock();
+    }
+    
+    ~rwkv_atomspace_write_lock() {
+        for (rwkv_atomspace_shard & shard : atomspace->shards) shard.mutex.unlock();
+    }
+};
+
+// Weight of truth and attention values against embeddings in similarity; embeddings have unit length.
+static const float value_feature_weight = 0.25f;
+
+static void get_value_features(const struct rwkv_atom * atom, float features[5]) {
+    const size_t i = atom_index(atom);
+    const rwkv_truth_value_t & tv = atom->block->tvs[i];
+    const rwkv_attention_value_t & av = atom->block->avs[i];
+    
+    // Importance is unbounded, so it is squashed into the range of truth values
+    features[0] = tv.strength;
+    features[1] = tv.confidence;
+    features[2] = std::tanh(av.sti);
+    features[3] = std::tanh(av.lti);
+    features[4] = std::tanh(av.vlti);
+    
+    for (size_t j = 0; j < 5; j++) features[j] *= value_feature_weight;
+}
+
+// Cosine similarity of embeddings extended by truth and attention values.
+static float get_similarity(
+    const struct rwkv_atom * a,
+    const rwkv_atom_embedding & a_embedding,
+    const struct rwkv_atom * b,
+    const rwkv_atom_embedding & b_embedding
+) {
+    float dot = 0.0f;
+    for (size_t i = 0; i < a_embedding.values.size(); i++) {
+        dot += a_embedding.values[i] * b_embedding.values[i];
+    }
+    
+    float a_features[5];
+    float b_features[5];
+    get_value_features(a, a_features);
+    get_value_features(b, b_features);
+    
+    float a_norm = 1.0f;
+    float b_norm = 1.0f;
+    for (size_t i = 0; i < 5; i++) {
+        dot += a_features[i] * b_features[i];
+        a_norm += a_features[i] * a_features[i];
+        b_norm += b_features[i] * b_features[i];
+    }
+    return dot / std::sqrt(a_norm * b_norm);
+}
+
+static void compute_lsh_codes(const rwkv_atom_similarity_index & index, rwkv_atom_embedding & embedding) {
+    const float * hyperplane = index.hyperplanes.data();
+    
+    for (size_t t = 0; t < lsh_table_count; t++) {
+        uint32_t code = 0;
+        for (size_t bit = 0; bit < lsh_hyperplane_count; bit++, hyperplane += index.dimension) {
+            float projection = 0.0f;
+            for (size_t i = 0; i < index.dimension; i++) projection += hyperplane[i] * embedding.values[i];
+            code |= uint32_t(projection >= 0.0f) << bit;
+        }
+        embedding.codes[t] = code;
+    }
+}
+
+static uint64_t get_bucket_key(size_t table, uint32_t code) {
+    return ((uint64_t) table << 32) | code;
+}
+
+static void unindex_embedding(rwkv_atom_similarity_index & index, rwkv_atom_handle_t handle, rwkv_atom_embedding & embedding) {
+    if (!embedding.indexed) return;
+    
+    for (size_t t = 0; t < lsh_table_count; t++) {
+        auto bucket = index.buckets.find(get_bucket_key(t, embedding.codes[t]));
+        if (bucket == index.buckets.end()) continue;
+        
+        std::vector<rwkv_atom_handle_t> & handles = bucket->second;
+        handles.erase(std::remove(handles.begin(), handles.end(), handle), handles.end());
+        if (handles.empty()) index.buckets.erase(bucket);
+    }
+    embedding.indexed = false;
+}
+
+// Removes an atom whose incoming set is empty. All shards and the similarity index must be locked.
+static void remove_atom_locked(struct rwkv_atomspace * atomspace, rwkv_atom_handle_t handle) {
+    struct rwkv_atom * atom = find_atom(atomspace, handle);
+    if (!atom) return;
+    
+    const size_t i = atom_index(atom);
+    rwkv_atom_block * block = atom->block;
+    const rwkv_atom_type_t type = atom_type(atom);
+    const rwkv_atom_handle_t * outgoing = block->outgoing[i];
+    const size_t outgoing_count = block->outgoing_counts[i];
+    
+    const uint64_t hash = is_node_type(type) ? hash_name(block->names[i]) : hash_link(type, outgoing, outgoing_count);
+    atomspace->shards[get_shard_index(hash)].atoms.erase(hash, handle);
+    
+    for (size_t j = 0; j < outgoing_count; j++) {
+        if (std::find(outgoing, outgoing + j, outgoing[j]) != outgoing + j) continue;  // Repeated target
+        
+        struct rwkv_atom * target = find_atom(atomspace, outgoing[j]);
+        if (!target) continue;
+        
+        std::lock_guard<std::mutex> incoming_lock(get_incoming_mutex(atomspace, outgoing[j]));
+        std::vector<rwkv_atom_handle_t> & incoming = target->block->incoming[atom_index(target)];
+        incoming.erase(std::remove(incoming.begin(), incoming.end(), handle), incoming.end());
+    }
+    
+    // The storage of the atom is kept, so that pointers to it from lookups which raced with the removal stay valid;
+    // rwkv_atomspace_compact frees blocks and arena data of removed atoms once no other thread uses the AtomSpace
+    block->ready[i].store(false, std::memory_order_release);
+    atomspace->atom_count.fetch_sub(1, std::memory_order_relaxed);
+    log_op(atomspace, LOG_OP_REMOVE, handle);
+    
+    rwkv_atom_similarity_index & index = atomspace->similarity_index;
+    auto embedding = index.embeddings.find(handle);
+    if (embedding != index.embeddings.end()) {
+        unindex_embedding(index, handle, embedding->second);
+        index.embeddings.erase(embedding);
+    }
+}
+
+// Replaces an atom by another one: values of the atom are revised into it, links containing the atom are replaced
+// by links containing the other one, and the atom is removed. All shards and the similarity index must be locked.
+static void merge_atom_locked(struct rwkv_atomspace * atomspace, rwkv_atom_handle_t from, rwkv_atom_handle_t into, bool copy_values) {
+    struct rwkv_atom * from_atom = find_atom(atomspace, from);
+    struct rwkv_atom * into_atom = find_atom(atomspace, into);
+    if (!from_atom || !into_atom) return;
+    
+    const rwkv_truth_value_t from_tv = from_atom->block->tvs[atom_index(from_atom)];
+    const rwkv_attention_value_t from_av = from_atom->block->avs[atom_index(from_atom)];
+    rwkv_truth_value_t & into_tv = into_atom->block->tvs[atom_index(into_atom)];
+    rwkv_attention_value_t & into_av = into_atom->block->avs[atom_index(into_atom)];
+    
+    if (copy_values) {
+        into_tv = from_tv;
+        into_av = from_av;
+    } else {
+        // Strengths are averaged by confidence, and both atoms count as independent evidence
+        const float confidence_sum = from_tv.confidence + into_tv.confidence;
+        if (confidence_sum > 0.0f) {
+            into_tv.strength = (from_tv.strength * from_tv.confidence + into_tv.strength * into_tv.confidence) / confidence_sum;
+        }
+        into_tv.confidence = from_tv.confidence + into_tv.confidence - from_tv.confidence * into_tv.confidence;
+        into_av.sti += from_av.sti;
+        into_av.lti += from_av.lti;
+        into_av.vlti = std::max(into_av.vlti, from_av.vlti);
+    }
+    log_values(into_atom, true, true);
+    
+    std::vector<rwkv_atom_handle_t> incoming;
+    {
+        std::lock_guard<std::mutex> lock(get_incoming_mutex(atomspace, from));
+        incoming = from_atom->block->incoming[atom_index(from_atom)];
+    }
+    
+    for (rwkv_atom_handle_t link : incoming) {
+        const struct rwkv_atom * link_atom = find_atom(atomspace, link);
+        if (!link_atom) continue;
+        
+        const size_t i = atom_index(link_atom);
+        const rwkv_atom_type_t type = atom_type(link_atom);
+        std::vector<rwkv_atom_handle_t> outgoing(link_atom->block->outgoing[i], link_atom->block->outgoing[i] + link_atom->block->outgoing_counts[i]);
+        std::replace(outgoing.begin(), outgoing.end(), from, into);
+        
+        // The rewritten link may exist already; a new one gets the values of the old one as they are
+        const rwkv_atom_handle_t first_new_handle = atomspace->next_handle.load();
+        const uint64_t hash = hash_link(type, outgoing.data(), outgoing.size());
+        const rwkv_atom_handle_t rewritten = add_link_locked(
+            atomspace, atomspace->shards[get_shard_index(hash)], hash, type, outgoing.data(), outgoing.size()
+        );
+        
+        if (rewritten != RWKV_INVALID_ATOM_HANDLE) {
+            merge_atom_locked(atomspace, link, rewritten, rewritten >= first_new_handle);
+        }
+    }
+    
+    remove_atom_locked(atomspace, from);
+}
+
+bool rwkv_atomspace_set_embedding(
+    struct rwkv_atomspace * atomspace,
+    rwkv_atom_handle_t handle,
+    const float * embedding,
+    size_t dimension
+) {
+    if (!atomspace || !embedding || dimension == 0) return false;
+    
+    const struct rwkv_atom * atom = find_atom(atomspace, handle);
+    if (!atom || !is_node_type(atom_type(atom))) return false;
+    
+    float norm = 0.0f;
+    for (size_t i = 0; i < dimension; i++) norm += embedding[i] * embedding[i];
+    norm = std::sqrt(norm);
+    if (!(norm > 0.0f) || !std::isfinite(norm)) return false;
+    
+    rwkv_atom_similarity_index & index = atomspace->similarity_index;
+    std::lock_guard<std::mutex> lock(index.mutex);
+    
+    if (index.dimension == 0) {
+        // Hyperplanes are fixed by the dimension, so that codes do not change across runs
+        index.dimension = dimension;
+        index.hyperplanes.resize(lsh_table_count * lsh_hyperplane_count * dimension);
+        
+        uint64_t state = 0x2545F4914F6CDD1DULL;
+        for (float & value : index.hyperplanes) {
+            state = hash_combine(state, 0);
+            value = (float) (state >> 40) / (float) (1 << 23) - 1.0f;
+        }
+    } else if (dimension != index.dimension) {
         return false;
     }
     
-    *num_conclusions = 0;
+    rwkv_atom_embedding & entry = index.embeddings[handle];
+    unindex_embedding(index, handle, entry);
+    entry.values.assign(embedding, embedding + dimension);
+    for (float & value : entry.values) value /= norm;
+    
+    index.pending.push_back(handle);
+    return true;
+}
+
+size_t rwkv_atomspace_consolidate_step(
+    struct rwkv_atomspace * atomspace,
+    float similarity_threshold,
+    size_t max_atoms,
+    size_t * num_merged
+) {
+    if (num_merged) *num_merged = 0;
+    if (!atomspace) return 0;
     
-    std::lock_guard<std::mutex> lock(atomspace->mutex);
+    rwkv_atomspace_write_lock write_lock(atomspace);
+    rwkv_atom_similarity_index & index = atomspace->similarity_index;
+    std::lock_guard<std::mutex> lock(index.mutex);
     
-    // Simple inference: if we have an implication link A -> B and we know A, infer B
-    for (auto it = atomspace->atoms.begin(); it != atomspace->atoms.end(); ++it) {
-        if (*num_conclusions >= max_conclusions) break;
+    size_t merged = 0;
+    bool merged_types[atom_type_count] = {};
+    std::unordered_set<rwkv_atom_handle_t> compared;
+    
+    for (size_t processed = 0; processed < max_atoms && !index.pending.empty(); processed++) {
+        const rwkv_atom_handle_t handle = index.pending.front();
+        index.pending.pop_front();
+        
+        // Atoms are queued again when their embeddings change, and may have been merged meanwhile
+        auto entry = index.embeddings.find(handle);
+        if (entry == index.embeddings.end() || entry->second.indexed) continue;
+        
+        const struct rwkv_atom * atom = find_atom(atomspace, handle);
+        if (!atom) {
+            index.embeddings.erase(entry);
+            continue;
+        }
+        
+        rwkv_atom_embedding & embedding = entry->second;
+        compute_lsh_codes(index, embedding);
         
-        const std::unique_ptr<rwkv_atom>& atom = it->second;
-        if (atom->type == RWKV_ATOM_IMPLICATION_LINK && atom->outgoing.size() == 2) {
-            if (atom->outgoing[0] == premise) {
-                conclusions[(*num_conclusions)++] = atom->outgoing[1];
+        // Nodes of the same type sharing a bucket in any table are compared exactly; the most similar one is kept
+        rwkv_atom_handle_t best = RWKV_INVALID_ATOM_HANDLE;
+        float best_similarity = similarity_threshold;
+        compared.clear();
+        
+        for (size_t t = 0; t < lsh_table_count; t++) {
+            auto bucket = index.buckets.find(get_bucket_key(t, embedding.codes[t]));
+            if (bucket == index.buckets.end()) continue;
+            
+            for (rwkv_atom_handle_t candidate : bucket->second) {
+                if (!compared.insert(candidate).second) continue;
+                
+                const struct rwkv_atom * candidate_atom = find_atom(atomspace, candidate);
+                if (!candidate_atom || atom_type(candidate_atom) != atom_type(atom)) continue;
+                
+                const float similarity = get_similarity(atom, embedding, candidate_atom, index.embeddings.at(candidate));
+                if (similarity >= best_similarity) {
+                    best = candidate;
+                    best_similarity = similarity;
+                }
             }
         }
+        
+        if (best != RWKV_INVALID_ATOM_HANDLE) {
+            merged_types[atom_type(atom)] = true;
+            merge_atom_locked(atomspace, handle, best, false);
+            merged++;
+            continue;
+        }
+        
+        for (size_t t = 0; t < lsh_table_count; t++) {
+            index.buckets[get_bucket_key(t, embedding.codes[t])].push_back(handle);
+        }
+        embedding.indexed = true;
     }
     
-    return true;
+    // Links replaced by rewritten ones have the types of the links, so all link types are compacted after merges
+    for (size_t type = 0; type < atom_type_count && merged > 0; type++) {
+        if (!merged_types[type] && !is_link_type((rwkv_atom_type_t) type)) continue;
+        
+        rwkv_atom_type_index & type_index = atomspace->type_indexes[type];
+        std::lock_guard<std::mutex> type_lock(type_index.mutex);
+        type_index.handles.erase(std::remove_if(type_index.handles.begin(), type_index.handles.end(), [&](rwkv_atom_handle_t h) -> bool {
+            return !find_atom(atomspace, h);
+        }), type_index.handles.end());
+    }
+    
+    if (num_merged) *num_merged = merged;
+    return index.pending.size();
 }
 
-// Memory consolidation
 bool rwkv_atomspace_consolidate_memory(
     struct rwkv_atomspace * atomspace,
-    float /* similarity_threshold */
+    float similarity_threshold
 ) {
     if (!atomspace) return false;
     
-    // This is a placeholder for memory consolidation
-    // In a full implementation, you would:
-    // 1. Find similar atoms based on truth values and attention
-    // 2. Merge atoms that are above the similarity threshold
-    // 3. Update links that reference merged atoms
+    // Steps are bounded, so that threads adding atoms wait for one step at a time rather than for the whole pass
+    while (rwkv_atomspace_consolidate_step(atomspace, similarity_threshold, 256, nullptr) > 0) {}
+    
+    return true;
+}
+
+// Index of the snapshot holding the data, or the count of snapshots if it is in an arena
+static size_t find_snapshot(const struct rwkv_atomspace * atomspace, const void * data) {
+    size_t s = 0;
+    for (; s < atomspace->snapshots.size(); s++) {
+        const char * begin = (const char *) atomspace->snapshots[s]->addr;
+        if ((const char *) data >= begin && (const char *) data < begin + atomspace->snapshots[s]->size) break;
+    }
+    return s;
+}
+
+bool rwkv_atomspace_compact(struct rwkv_atomspace * atomspace) {
+    if (!atomspace) return false;
+    
+    rwkv_atomspace_write_lock write_lock(atomspace);
+    rwkv_atom_similarity_index & index = atomspace->similarity_index;
+    std::lock_guard<std::mutex> lock(index.mutex);
+    
+    // Data of remaining atoms is copied into new arenas and hash tables first, so that a failed allocation changes nothing
+    std::vector<rwkv_atom_arena> arenas;
+    std::vector<rwkv_atom_hash_table> tables;
+    std::vector<std::pair<struct rwkv_atom *, const void *>> moves;
+    std::vector<bool> used_snapshots;
+    
+    try {
+        arenas.resize(atomspace_shard_count);
+        tables.resize(atomspace_shard_count);
+        used_snapshots.resize(atomspace->snapshots.size());
+        std::unordered_map<const char *, const char *> interned_names;
+        
+        for_each_atom(atomspace, [&](struct rwkv_atom * atom) -> bool {
+            const size_t i = atom_index(atom);
+            const rwkv_atom_block * block = atom->block;
+            const rwkv_atom_type_t type = atom_type(atom);
+            const bool node = is_node_type(type);
+            const size_t outgoing_count = block->outgoing_counts[i];
+            
+            const uint64_t hash = node ? hash_name(block->names[i]) : hash_link(type, block->outgoing[i], outgoing_count);
+            const size_t shard = get_shard_index(hash);
+            tables[shard].insert(hash, atom_handle(atom));
+            
+            const void * data = node ? (const void *) block->names[i] : (const void *) block->outgoing[i];
+            const size_t snapshot = find_snapshot(atomspace, data);
+            if (snapshot < used_snapshots.size()) {
+                used_snapshots[snapshot] = true;
+                return true;
+            }
+            
+            if (node) {
+                // Nodes with the same name keep sharing it
+                const char *& name = interned_names[block->names[i]];
+                if (!name) {
+                    const size_t size = strlen(block->names[i]) + 1;
+                    char * copy = (char *) arenas[shard].allocate(size, 1);
+                    memcpy(copy, block->names[i], size);
+                    name = copy;
+                }
+                moves.emplace_back(atom, name);
+            } else {
+                rwkv_atom_handle_t * copy = (rwkv_atom_handle_t *) arenas[shard].allocate(
+                    outgoing_count * sizeof(rwkv_atom_handle_t), alignof(rwkv_atom_handle_t)
+                );
+                std::copy_n(block->outgoing[i], outgoing_count, copy);
+                moves.emplace_back(atom, copy);
+            }
+            return true;
+        });
+    } catch (...) {
+        return false;
+    }
+    
+    for (const auto & move : moves) {
+        rwkv_atom_block * block = move.first->block;
+        const size_t i = atom_index(move.first);
+        if (is_node_type(atom_type(move.first))) {
+            block->names[i] = (const char *) move.second;
+        } else {
+            block->outgoing[i] = (const rwkv_atom_handle_t *) move.second;
+        }
+    }
+    
+    for (size_t s = 0; s < atomspace_shard_count; s++) {
+        std::swap(atomspace->shards[s].arena, arenas[s]);
+        std::swap(atomspace->shards[s].atoms, tables[s]);
+    }
+    
+    // Blocks without atoms are freed, and are allocated again if handles in them are ever used
+    const rwkv_atom_handle_t end = atomspace->next_handle.load();
+    for (size_t b = 0; b < max_atom_blocks && (rwkv_atom_handle_t) (b << atom_block_bits) < end; b++) {
+        rwkv_atom_block * block = atomspace->blocks[b].load();
+        if (!block) continue;
+        
+        bool empty = true;
+        for (size_t i = 0; i < atom_block_size; i++) {
+            if (block->ready[i].load()) {
+                empty = false;
+            } else {
+                std::vector<rwkv_atom_handle_t>().swap(block->incoming[i]);
+            }
+        }
+        
+        if (empty) delete atomspace->blocks[b].exchange(nullptr);
+    }
+    
+    for (rwkv_atom_type_index & type_index : atomspace->type_indexes) {
+        std::lock_guard<std::mutex> type_lock(type_index.mutex);
+        type_index.handles.erase(std::remove_if(type_index.handles.begin(), type_index.handles.end(), [&](rwkv_atom_handle_t h) -> bool {
+            return !find_atom(atomspace, h);
+        }), type_index.handles.end());
+    }
+    
+    index.pending.erase(std::remove_if(index.pending.begin(), index.pending.end(), [&](rwkv_atom_handle_t h) -> bool {
+        return index.embeddings.find(h) == index.embeddings.end();
+    }), index.pending.end());
+    
+    // Snapshots are closed once no atom uses their data
+    size_t kept = 0;
+    for (size_t s = 0; s < atomspace->snapshots.size(); s++) {
+        if (used_snapshots[s]) atomspace->snapshots[kept++] = std::move(atomspace->snapshots[s]);
+    }
+    atomspace->snapshots.resize(kept);
+    return true;
+}
+
+// Persistence
+
+// Snapshots hold atoms in order of handles, as a header and arrays in native byte order:
+// handles, references (offsets of names into the names, or of outgoing sets into the outgoing pool), truth values,
+// attention values, outgoing counts and types, then the outgoing pool and NUL-terminated names. Arrays start at multiples of 8.
+static const uint32_t snapshot_magic = 0x73617772;  // "rwas"
+static const uint32_t snapshot_version = 1;
+static const uint32_t log_magic = 0x6C617772;  // "rwal"
+static const uint32_t log_version = 1;
+
+struct rwkv_atomspace_file_header {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t next_handle;
+    uint64_t atom_count;
+    uint64_t outgoing_size;  // In handles
+    uint64_t names_size;     // In bytes
+};
+
+struct rwkv_atomspace_snapshot_layout {
+    size_t handles;
+    size_t refs;
+    size_t tvs;
+    size_t avs;
+    size_t counts;
+    size_t types;
+    size_t outgoing;
+    size_t names;
+    size_t end;
+};
+
+static size_t align_to_8(size_t offset) {
+    return (offset + 7) & ~size_t(7);
+}
+
+// Returns false if sizes in the header are out of range.
+static bool get_snapshot_layout(const rwkv_atomspace_file_header & header, rwkv_atomspace_snapshot_layout & layout) {
+    const uint64_t max_atoms = (uint64_t) max_atom_blocks * atom_block_size;
+    if (header.atom_count > max_atoms || header.outgoing_size > (uint64_t(1) << 40) || header.names_size > (uint64_t(1) << 40)) {
+        return false;
+    }
+    
+    const size_t n = (size_t) header.atom_count;
+    layout.handles = align_to_8(sizeof(rwkv_atomspace_file_header));
+    layout.refs = layout.handles + n * sizeof(uint64_t);
+    layout.tvs = layout.refs + n * sizeof(uint64_t);
+    layout.avs = layout.tvs + n * sizeof(rwkv_truth_value_t);
+    layout.counts = align_to_8(layout.avs + n * sizeof(rwkv_attention_value_t));
+    layout.types = layout.counts + n * sizeof(uint32_t);
+    layout.outgoing = align_to_8(layout.types + n);
+    layout.names = layout.outgoing + (size_t) header.outgoing_size * sizeof(rwkv_atom_handle_t);
+    layout.end = layout.names + (size_t) header.names_size;
+    return true;
+}
+
+// Adds an atom with a known handle while loading; nothing else may use the AtomSpace meanwhile.
+// The name or outgoing set is used in place, or stored in the arena of the shard if copy is set.
+static bool restore_atom(
+    struct rwkv_atomspace * atomspace,
+    rwkv_atom_handle_t handle,
+    rwkv_atom_type_t type,
+    const char * name,
+    const rwkv_atom_handle_t * outgoing,
+    size_t outgoing_count,
+    const rwkv_truth_value_t & tv,
+    const rwkv_attention_value_t & av,
+    bool copy
+) {
+    if (!is_valid_type(type) || handle == RWKV_INVALID_ATOM_HANDLE || (handle >> atom_block_bits) >= max_atom_blocks) return false;
+    if (find_atom(atomspace, handle)) return false;
+    
+    const bool node = is_node_type(type);
+    if (node ? !name : outgoing_count == 0) return false;
     
+    // Outgoing atoms always have smaller handles, since they existed when the link was added
+    for (size_t i = 0; i < outgoing_count; i++) {
+        if (outgoing[i] >= handle || !find_atom(atomspace, outgoing[i])) return false;
+    }
+    
+    const uint64_t hash = node ? hash_name(name) : hash_link(type, outgoing, outgoing_count);
+    rwkv_atomspace_shard & shard = atomspace->shards[get_shard_index(hash)];
+    
+    if (copy && node) {
+        const char * interned_name = nullptr;
+        shard.atoms.find(hash, [&](rwkv_atom_handle_t candidate) -> bool {
+            const struct rwkv_atom * atom = find_atom(atomspace, candidate);
+            if (strcmp(atom->block->names[atom_index(atom)], name) == 0) interned_name = atom->block->names[atom_index(atom)];
+            return !interned_name;
+        });
+        
+        if (!interned_name) {
+            const size_t size = strlen(name) + 1;
+            char * data = (char *) shard.arena.allocate(size, 1);
+            memcpy(data, name, size);
+            interned_name = data;
+        }
+        name = interned_name;
+    } else if (copy) {
+        rwkv_atom_handle_t * stored_outgoing = (rwkv_atom_handle_t *) shard.arena.allocate(
+            outgoing_count * sizeof(rwkv_atom_handle_t), alignof(rwkv_atom_handle_t)
+        );
+        std::copy_n(outgoing, outgoing_count, stored_outgoing);
+        outgoing = stored_outgoing;
+    }
+    
+    if (atomspace->next_handle.load() <= handle) atomspace->next_handle.store(handle + 1);
+    place_atom(atomspace, handle, type, node ? name : nullptr, node ? nullptr : outgoing, node ? 0 : outgoing_count, tv, av);
+    shard.atoms.insert(hash, handle);
+    
+    for (size_t i = 0; i < outgoing_count; i++) {
+        if (std::find(outgoing, outgoing + i, outgoing[i]) != outgoing + i) continue;  // Repeated target
+        
+        struct rwkv_atom * target = find_atom(atomspace, outgoing[i]);
+        target->block->incoming[atom_index(target)].push_back(handle);
+    }
+    return true;
+}
+
+// Starts the log file anew; the log mutex must be held.
+static bool restart_log(struct rwkv_atomspace * atomspace) {
+    FILE * file = fopen(atomspace->log_path.c_str(), "wb");
+    if (!file) return false;
+    
+    fclose(atomspace->log_file);
+    atomspace->log_file = file;
+    
+    const uint32_t header[2] = {log_magic, log_version};
+    return fwrite(header, sizeof(header), 1, file) == 1 && fflush(file) == 0;
+}
+
+bool rwkv_atomspace_save(struct rwkv_atomspace * atomspace, const char * path) {
+    if (!atomspace || !path) return false;
+    
+    // No atoms are added or removed while saving
+    rwkv_atomspace_write_lock write_lock(atomspace);
+    
+    std::vector<const struct rwkv_atom *> atoms;
+    std::vector<rwkv_atom_handle_t> outgoing_pool;
+    std::vector<char> names;
+    std::unordered_map<const char *, uint64_t> name_offsets;  // Names are interned, so they are written once
+    
+    try {
+        atoms.reserve(atomspace->atom_count.load());
+        for_each_atom(atomspace, [&](const struct rwkv_atom * atom) -> bool {
+            atoms.push_back(atom);
+            return true;
+        });
+    } catch (...) {
+        return false;
+    }
+    
+    const size_t n = atoms.size();
+    std::vector<uint64_t> handles(n);
+    std::vector<uint64_t> refs(n);
+    std::vector<rwkv_truth_value_t> tvs(n);
+    std::vector<rwkv_attention_value_t> avs(n);
+    std::vector<uint32_t> counts(n);
+    std::vector<uint8_t> types(n);
+    
+    // Held from copying values until the log starts over, so that a value set meanwhile is either in the snapshot,
+    // or logged after the restart; setting values waits for the save to finish.
+    std::unique_lock<std::mutex> log_lock(atomspace->log_mutex);
+    
+    for (size_t j = 0; j < n; j++) {
+        const size_t i = atom_index(atoms[j]);
+        const rwkv_atom_block * block = atoms[j]->block;
+        handles[j] = atom_handle(atoms[j]);
+        tvs[j] = block->tvs[i];
+        avs[j] = block->avs[i];
+        types[j] = block->types[i];
+        counts[j] = block->outgoing_counts[i];
+        
+        if (block->names[i]) {
+            auto inserted = name_offsets.insert(std::make_pair(block->names[i], (uint64_t) names.size()));
+            if (inserted.second) names.insert(names.end(), block->names[i], block->names[i] + strlen(block->names[i]) + 1);
+            refs[j] = inserted.first->second;
+        } else {
+            refs[j] = outgoing_pool.size();
+            outgoing_pool.insert(outgoing_pool.end(), block->outgoing[i], block->outgoing[i] + counts[j]);
+        }
+    }
+    
+    rwkv_atomspace_file_header header = {
+        snapshot_magic, snapshot_version, atomspace->next_handle.load(), n, outgoing_pool.size(), names.size()
+    };
+    rwkv_atomspace_snapshot_layout layout;
+    if (!get_snapshot_layout(header, layout)) return false;
+    
+    // Written next to the old snapshot and renamed over it, so that a failed save keeps the old one
+    const std::string temp_path = std::string(path) + ".tmp";
+    FILE * file = fopen(temp_path.c_str(), "wb");
+    if (!file) return false;
+    
+    size_t offset = 0;
+    bool written = true;
+    auto write = [&](size_t at, const void * data, size_t size) {
+        static const char padding[8] = {0};
+        if (at > offset) written = written && fwrite(padding, 1, at - offset, file) == at - offset;
+        if (size) written = written && fwrite(data, 1, size, file) == size;
+        offset = at + size;
+    };
+    
+    write(0, &header, sizeof(header));
+    write(layout.handles, handles.data(), n * sizeof(uint64_t));
+    write(layout.refs, refs.data(), n * sizeof(uint64_t));
+    write(layout.tvs, tvs.data(), n * sizeof(rwkv_truth_value_t));
+    write(layout.avs, avs.data(), n * sizeof(rwkv_attention_value_t));
+    write(layout.counts, counts.data(), n * sizeof(uint32_t));
+    write(layout.types, types.data(), n);
+    write(layout.outgoing, outgoing_pool.data(), outgoing_pool.size() * sizeof(rwkv_atom_handle_t));
+    write(layout.names, names.data(), names.size());
+    
+    written = fclose(file) == 0 && written;
+    
+#if defined(_WIN32)
+    if (written) remove(path);
+#endif
+    if (!written || rename(temp_path.c_str(), path) != 0) {
+        remove(temp_path.c_str());
+        return false;
+    }
+    
+    // The snapshot holds all changes so far, so the log starts over
+    return !atomspace->log_file || restart_log(atomspace);
+}
+
+struct rwkv_atomspace * rwkv_atomspace_load(const char * path, bool use_mmap) {
+    if (!path) return nullptr;
+    
+    FILE * file = fopen(path, "rb");
+    if (!file) return nullptr;
+    
+    rwkv_atomspace_file_header header;
+    rwkv_atomspace_snapshot_layout layout;
+    
+    if (fread(&header, sizeof(header), 1, file) != 1 || header.magic != snapshot_magic || header.version != snapshot_version ||
+        !get_snapshot_layout(header, layout)) {
+        fclose(file);
+        return nullptr;
+    }
+    
+    std::unique_ptr<rwkv_atomspace_snapshot> snapshot(new(std::nothrow) rwkv_atomspace_snapshot());
+    if (!snapshot) {
+        fclose(file);
+        return nullptr;
+    }
+    
+#ifdef RWKV_OPENCOG_MMAP_SUPPORTED
+    struct stat file_stat;
+    if (use_mmap && fstat(fileno(file), &file_stat) == 0 && (uint64_t) file_stat.st_size >= layout.end) {
+        void * addr = mmap(nullptr, layout.end, PROT_READ, MAP_SHARED, fileno(file), 0);
+        if (addr != MAP_FAILED) {
+            snapshot->addr = addr;
+            snapshot->size = layout.end;
+        }
+    }
+#else
+    (void) use_mmap;
+#endif
+    
+    // If the file can not be mapped, it is read as usual
+    if (!snapshot->addr) {
+        snapshot->buffer.reset(new(std::nothrow) uint64_t[layout.end / 8 + 1]);
+        if (!snapshot->buffer || fseek(file, 0, SEEK_SET) != 0 || fread(snapshot->buffer.get(), 1, layout.end, file) != layout.end) {
+            fclose(file);
+            return nullptr;
+        }
+        snapshot->addr = snapshot->buffer.get();
+        snapshot->size = layout.end;
+    }
+    fclose(file);
+    
+    const char * base = (const char *) snapshot->addr;
+    const char * names = base + layout.names;
+    const uint64_t * handles = (const uint64_t *) (base + layout.handles);
+    const uint64_t * refs = (const uint64_t *) (base + layout.refs);
+    const uint32_t * counts = (const uint32_t *) (base + layout.counts);
+    const uint8_t * types = (const uint8_t *) (base + layout.types);
+    const rwkv_atom_handle_t * outgoing_pool = (const rwkv_atom_handle_t *) (base + layout.outgoing);
+    
+    // Names are used in place, so each has to end within the names
+    if (header.names_size > 0 && names[header.names_size - 1] != '\0') return nullptr;
+    
+    std::unique_ptr<rwkv_atomspace> atomspace(rwkv_atomspace_create());
+    if (!atomspace) return nullptr;
+    
+    try {
+        for (size_t j = 0; j < header.atom_count; j++) {
+            const rwkv_atom_type_t type = (rwkv_atom_type_t) types[j];
+            if (!is_valid_type(type) || handles[j] >= header.next_handle) return nullptr;
+            
+            rwkv_truth_value_t tv;
+            rwkv_attention_value_t av;
+            memcpy(&tv, base + layout.tvs + j * sizeof(tv), sizeof(tv));
+            memcpy(&av, base + layout.avs + j * sizeof(av), sizeof(av));
+            
+            bool restored;
+            if (is_node_type(type)) {
+                restored = refs[j] < header.names_size &&
+                    restore_atom(atomspace.get(), handles[j], type, names + refs[j], nullptr, 0, tv, av, false);
+            } else {
+                restored = refs[j] <= header.outgoing_size && counts[j] <= header.outgoing_size - refs[j] &&
+                    restore_atom(atomspace.get(), handles[j], type, nullptr, outgoing_pool + refs[j], counts[j], tv, av, false);
+            }
+            if (!restored) return nullptr;
+        }
+    } catch (...) {
+        return nullptr;
+    }
+    
+    atomspace->next_handle.store(header.next_handle);
+    atomspace->snapshots.push_back(std::move(snapshot));
+    return atomspace.release();
+}
+
+bool rwkv_atomspace_open_log(struct rwkv_atomspace * atomspace, const char * path) {
+    if (!atomspace || !path) return false;
+    
+    std::lock_guard<std::mutex> lock(atomspace->log_mutex);
+    
+    FILE * file = fopen(path, "ab");
+    if (!file) return false;
+    
+    if (ftell(file) == 0) {
+        const uint32_t header[2] = {log_magic, log_version};
+        if (fwrite(header, sizeof(header), 1, file) != 1) {
+            fclose(file);
+            return false;
+        }
+    }
+    
+    if (atomspace->log_file) fclose(atomspace->log_file);
+    atomspace->log_file = file;
+    atomspace->log_path = path;
     return true;
 }
 
+bool rwkv_atomspace_flush_log(struct rwkv_atomspace * atomspace) {
+    if (!atomspace) return false;
+    
+    std::lock_guard<std::mutex> lock(atomspace->log_mutex);
+    return atomspace->log_file && fflush(atomspace->log_file) == 0 && !ferror(atomspace->log_file);
+}
+
+bool rwkv_atomspace_close_log(struct rwkv_atomspace * atomspace) {
+    if (!atomspace) return false;
+    
+    std::lock_guard<std::mutex> lock(atomspace->log_mutex);
+    if (!atomspace->log_file) return false;
+    
+    const bool written = !ferror(atomspace->log_file);
+    const bool closed = fclose(atomspace->log_file) == 0;
+    atomspace->log_file = nullptr;
+    return written && closed;
+}
+
+bool rwkv_atomspace_replay_log(struct rwkv_atomspace * atomspace, const char * path) {
+    if (!atomspace || !path || atomspace->log_file) return false;
+    
+    FILE * file = fopen(path, "rb");
+    if (!file) return false;
+    
+    uint32_t header[2];
+    if (fread(header, sizeof(header), 1, file) != 1 || header[0] != log_magic || header[1] != log_version) {
+        fclose(file);
+        return false;
+    }
+    
+    // A record cut short by a crash ends the log
+    bool valid = true;
+    uint8_t op;
+    std::string name;
+    std::vector<rwkv_atom_handle_t> outgoing;
+    
+    while (valid && fread(&op, 1, 1, file) == 1) {
+        rwkv_atom_handle_t handle = RWKV_INVALID_ATOM_HANDLE;
+        if (op != LOG_OP_CLEAR && fread(&handle, sizeof(handle), 1, file) != 1) break;
+        
+        if (op == LOG_OP_NODE || op == LOG_OP_LINK) {
+            uint8_t type;
+            uint32_t count;
+            if (fread(&type, 1, 1, file) != 1 || fread(&count, sizeof(count), 1, file) != 1) break;
+            
+            try {
+                if (op == LOG_OP_NODE) {
+                    name.resize(count);
+                    if (count && fread(&name[0], 1, count, file) != count) break;
+                } else {
+                    outgoing.resize(count);
+                    if (count && fread(outgoing.data(), sizeof(rwkv_atom_handle_t), count, file) != count) break;
+                }
+                
+                const bool node = op == LOG_OP_NODE;
+                valid = node == is_node_type((rwkv_atom_type_t) type) && restore_atom(
+                    atomspace, handle, (rwkv_atom_type_t) type, node ? name.c_str() : nullptr, node ? nullptr : outgoing.data(),
+                    node ? 0 : count, {0.5f, 0.1f}, {0.0f, 0.0f, 0.0f}, true
+                );
+            } catch (...) {
+                valid = false;
+            }
+        } else if (op == LOG_OP_TRUTH || op == LOG_OP_ATTENTION) {
+            rwkv_truth_value_t tv;
+            rwkv_attention_value_t av;
+            if (op == LOG_OP_TRUTH ? fread(&tv, sizeof(tv), 1, file) != 1 : fread(&av, sizeof(av), 1, file) != 1) break;
+            
+            struct rwkv_atom * atom = find_atom(atomspace, handle);
+            if (atom && op == LOG_OP_TRUTH) atom->block->tvs[atom_index(atom)] = tv;
+            if (atom && op == LOG_OP_ATTENTION) atom->block->avs[atom_index(atom)] = av;
+        } else if (op == LOG_OP_REMOVE) {
+            rwkv_atomspace_write_lock write_lock(atomspace);
+            std::lock_guard<std::mutex> lock(atomspace->similarity_index.mutex);
+            remove_atom_locked(atomspace, handle);
+        } else if (op == LOG_OP_CLEAR) {
+            rwkv_atomspace_clear(atomspace);
+        } else {
+            valid = false;
+        }
+    }
+    
+    fclose(file);
+    
+    // Removed atoms are left in type indexes by remove_atom_locked
+    for (rwkv_atom_type_index & type_index : atomspace->type_indexes) {
+        type_index.handles.erase(std::remove_if(type_index.handles.begin(), type_index.handles.end(), [&](rwkv_atom_handle_t h) -> bool {
+            return !find_atom(atomspace, h);
+        }), type_index.handles.end());
+    }
+    return valid;
+}
+
 // Statistics
 size_t rwkv_atomspace_get_size(struct rwkv_atomspace * atomspace) {
     if (!atomspace) return 0;
-    std::lock_guard<std::mutex> lock(atomspace->mutex);
-    return atomspace->atoms.size();
+    return atomspace->atom_count.load(std::memory_order_relaxed);
 }
 
 size_t rwkv_atomspace_get_node_count(struct rwkv_atomspace * atomspace) {
     if (!atomspace) return 0;
-    
-    std::lock_guard<std::mutex> lock(atomspace->mutex);
-    size_t count = 0;
-    for (auto it = atomspace->atoms.begin(); it != atomspace->atoms.end(); ++it) {
-        const std::unique_ptr<rwkv_atom>& atom = it->second;
-        if (is_node_type(atom->type)) count++;
-    }
-    return count;
+    return count_atoms(atomspace, is_node_type);
 }
 
 size_t rwkv_atomspace_get_link_count(struct rwkv_atomspace * atomspace) {
     if (!atomspace) return 0;
+    return count_atoms(atomspace, is_link_type);
+}
+
+size_t rwkv_atomspace_get_type_count(struct rwkv_atomspace * atomspace, rwkv_atom_type_t type) {
+    if (!atomspace || !is_valid_type(type)) return 0;
+    
+    rwkv_atom_type_index & index = atomspace->type_indexes[type];
+    std::lock_guard<std::mutex> lock(index.mutex);
+    return index.handles.size();
+}
+
+size_t rwkv_atomspace_get_memory_size(struct rwkv_atomspace * atomspace) {
+    if (!atomspace) return 0;
     
-    std::lock_guard<std::mutex> lock(atomspace->mutex);
-    size_t count = 0;
-    for (auto it = atomspace->atoms.begin(); it != atomspace->atoms.end(); ++it) {
-        const std::unique_ptr<rwkv_atom>& atom = it->second;
-        if (is_link_type(atom->type)) count++;
+    rwkv_atomspace_write_lock write_lock(atomspace);
+    for (std::mutex & mutex : atomspace->incoming_mutexes) mutex.lock();
+    
+    size_t size = max_atom_blocks * sizeof(std::atomic<rwkv_atom_block *>);
+    for (size_t b = 0; b < max_atom_blocks; b++) {
+        const rwkv_atom_block * block = atomspace->blocks[b].load(std::memory_order_acquire);
+        if (!block) continue;
+        
+        size += sizeof(rwkv_atom_block);
+        for (size_t i = 0; i < atom_block_size; i++) size += block->incoming[i].capacity() * sizeof(rwkv_atom_handle_t);
     }
-    return count;
-}
\ No newline at end of file
+    
+    for (std::mutex & mutex : atomspace->incoming_mutexes) mutex.unlock();
+    
+    for (const rwkv_atomspace_shard & shard : atomspace->shards) {
+        size += shard.arena.allocated + shard.atoms.slots.capacity() * sizeof(shard.atoms.slots[0]);
+    }
+    
+    for (rwkv_atom_type_index & index : atomspace->type_indexes) {
+        std::lock_guard<std::mutex> lock(index.mutex);
+        size += index.handles.capacity() * sizeof(rwkv_atom_handle_t);
+    }
+    
+    for (const auto & snapshot : atomspace->snapshots) size += snapshot->size;
+    return size;
+}
@@ -51,11 +51,18 @@ typedef uint64_t rwkv_atom_handle_t;
 #define RWKV_INVALID_ATOM_HANDLE 0
 
 // Create a new AtomSpace for cognitive operations
+// All AtomSpace functions may be called from several threads at once. Lookups take no locks,
+// and atoms are added under the lock of one of several shards, so that adding distinct atoms scales with threads.
 RWKV_API struct rwkv_atomspace * rwkv_atomspace_create(void);
 
 // Free an AtomSpace
 RWKV_API void rwkv_atomspace_free(struct rwkv_atomspace * atomspace);
 
+// Remove all atoms, freeing their storage at once
+// Handles and atoms obtained before become invalid; new atoms get new handles.
+// Must not be called while other threads use the AtomSpace.
+RWKV_API void rwkv_atomspace_clear(struct rwkv_atomspace * atomspace);
+
 // Create a node atom with given type and name
 RWKV_API rwkv_atom_handle_t rwkv_atomspace_add_node(
     struct rwkv_atomspace * atomspace,
@@ -71,12 +78,45 @@ RWKV_API rwkv_atom_handle_t rwkv_atomspace_add_link(
     size_t outgoing_count
 );
 
+// Create node atoms of a type, one for each name, locking each part of the AtomSpace once
+// Handles of the nodes are written to handles, which must fit count of them; names which are NULL get the invalid handle.
+// Returns the count of valid handles written.
+RWKV_API size_t rwkv_atomspace_add_nodes(
+    struct rwkv_atomspace * atomspace,
+    rwkv_atom_type_t type,
+    const char * const * names,
+    size_t count,
+    rwkv_atom_handle_t * handles
+);
+
+// Create link atoms of a type, locking each part of the AtomSpace once
+// Outgoing sets of the links follow each other in outgoing, with their sizes in outgoing_counts.
+// Links with an empty outgoing set or atoms that do not exist get the invalid handle. Returns the count of valid handles written.
+RWKV_API size_t rwkv_atomspace_add_links(
+    struct rwkv_atomspace * atomspace,
+    rwkv_atom_type_t type,
+    const rwkv_atom_handle_t * outgoing,
+    const size_t * outgoing_counts,
+    size_t count,
+    rwkv_atom_handle_t * handles
+);
+
 // Get atom by handle
+// The atom stays valid until the AtomSpace is cleared, compacted or freed, even if it is merged by consolidation meanwhile.
 RWKV_API struct rwkv_atom * rwkv_atomspace_get_atom(
     struct rwkv_atomspace * atomspace,
     rwkv_atom_handle_t handle
 );
 
+// Get links which have the atom in their outgoing set, in order of their creation
+// Returns the size of the incoming set; at most max_count handles are written to incoming, which may be NULL.
+RWKV_API size_t rwkv_atomspace_get_incoming(
+    struct rwkv_atomspace * atomspace,
+    rwkv_atom_handle_t handle,
+    rwkv_atom_handle_t * incoming,
+    size_t max_count
+);
+
 // Set truth value for an atom
 RWKV_API bool rwkv_atom_set_truth_value(
     struct rwkv_atom * atom,
@@ -115,6 +155,7 @@ RWKV_API size_t rwkv_atom_get_outgoing(
 );
 
 // Pattern matching: find atoms matching a pattern
+// Atoms of the pattern's type are kept in an index, so the cost is in proportion to max_results.
 RWKV_API size_t rwkv_atomspace_pattern_match(
     struct rwkv_atomspace * atomspace,
     rwkv_atom_handle_t pattern,
@@ -125,6 +166,7 @@ RWKV_API size_t rwkv_atomspace_pattern_match(
 // Integration with RWKV language model
 
 // Convert RWKV context state to cognitive atoms
+// Every element of the state is looked at; see rwkv_state_bridge for parts of states and repeated conversions.
 RWKV_API bool rwkv_context_to_atoms(
     struct rwkv_context * rwkv_ctx,
     struct rwkv_atomspace * atomspace,
@@ -140,6 +182,79 @@ RWKV_API bool rwkv_atoms_to_context(
     size_t state_len
 );
 
+// Parts of the state of a layer, as bits of rwkv_state_projection_t::parts
+// RWKV v4 states have token shifts and aa, bb, pp vectors; RWKV v5+ states have token shifts and attention heads.
+typedef enum {
+    RWKV_STATE_PART_FFN_XX = 1 << 0,
+    RWKV_STATE_PART_ATT_XX = 1 << 1,
+    RWKV_STATE_PART_ATT_AA = 1 << 2,
+    RWKV_STATE_PART_ATT_BB = 1 << 3,
+    RWKV_STATE_PART_ATT_PP = 1 << 4,
+    RWKV_STATE_PART_ATT_HEADS = 1 << 5,
+    RWKV_STATE_PART_ALL = (1 << 6) - 1
+} rwkv_state_part_t;
+
+// Layout of an RWKV state, as in rwkv_get_state_len
+typedef struct {
+    size_t n_embed;
+    size_t n_layer;
+    size_t head_size;  // 0 for RWKV v4
+} rwkv_state_layout_t;
+
+// Slices of a state which are mirrored as atoms, and how
+typedef struct {
+    size_t first_layer;
+    size_t layer_count;  // 0 for all layers from first_layer
+    uint32_t parts;      // Bits of rwkv_state_part_t; parts which the layout does not have are skipped
+    size_t first_head;   // Attention heads of RWKV v5+
+    size_t head_count;   // 0 for all heads from first_head
+    float threshold;     // Elements with an absolute value above it are significant
+    float confidence;    // Confidence of truth values of the atoms
+} rwkv_state_projection_t;
+
+// Maps elements of states to concept nodes named "state_<index of the element>", keeping their handles in a table by element
+struct rwkv_state_bridge;
+
+// Get the state layout of the model of a context
+RWKV_API bool rwkv_get_state_layout(const struct rwkv_context * rwkv_ctx, rwkv_state_layout_t * layout);
+
+// Create a bridge between states of the layout and an AtomSpace
+// Returns NULL if the projection selects no elements of the layout.
+RWKV_API struct rwkv_state_bridge * rwkv_state_bridge_create(
+    struct rwkv_atomspace * atomspace,
+    const rwkv_state_layout_t * layout,
+    const rwkv_state_projection_t * projection
+);
+
+// Free a bridge; its atoms stay in the AtomSpace
+RWKV_API void rwkv_state_bridge_free(struct rwkv_state_bridge * bridge);
+
+// Mirror significant elements of the slices of a state
+// A node of each significant element gets strength min(|x|, 1), the confidence of the projection, and short-term
+// importance x. Nodes of elements which were significant in the previous call but are not anymore get 0 for both.
+// Missing nodes are added in bulk, and a bridge must not be used by several threads at once.
+RWKV_API bool rwkv_state_bridge_to_atoms(
+    struct rwkv_state_bridge * bridge,
+    const float * state,
+    size_t state_len
+);
+
+// Get handles of the nodes of elements which were significant in the last call of rwkv_state_bridge_to_atoms
+// Returns the count of them, which may be more than max_count.
+RWKV_API size_t rwkv_state_bridge_get_active(
+    struct rwkv_state_bridge * bridge,
+    rwkv_atom_handle_t * handles,
+    size_t max_count
+);
+
+// Write the short-term importance of the node of each element of the slices of a state, or 0 if it has no node
+// Elements outside of the slices are left as they are.
+RWKV_API bool rwkv_state_bridge_to_state(
+    struct rwkv_state_bridge * bridge,
+    float * state,
+    size_t state_len
+);
+
 // Cognitive reasoning: simple inference engine
 RWKV_API bool rwkv_atomspace_forward_inference(
     struct rwkv_atomspace * atomspace,
@@ -149,16 +264,91 @@ RWKV_API bool rwkv_atomspace_forward_inference(
     size_t * num_conclusions
 );
 
+// Multi-step forward inference: atoms reachable from the premise through chains of implication links,
+// that is, their transitive closure, nearest first and each once. The premise is not a conclusion even on a cycle.
+// Stops after max_steps links in a chain, or never if it is 0, and when max_conclusions are found.
+RWKV_API bool rwkv_atomspace_forward_chain(
+    struct rwkv_atomspace * atomspace,
+    rwkv_atom_handle_t premise,
+    size_t max_steps,
+    rwkv_atom_handle_t * conclusions,
+    size_t max_conclusions,
+    size_t * num_conclusions
+);
+
+// Set the embedding of a node, such as a row of the embedding matrix from rwkv_get_token_embedding
+// Only nodes with embeddings are consolidated, since truth and attention values alone do not tell concepts apart.
+// All embeddings of an AtomSpace must have the dimension of the first one.
+RWKV_API bool rwkv_atomspace_set_embedding(
+    struct rwkv_atomspace * atomspace,
+    rwkv_atom_handle_t handle,
+    const float * embedding,
+    size_t dimension
+);
+
 // Memory consolidation: merge similar concepts
+// Similarity is the cosine similarity of embeddings extended by truth and attention values. Candidates are found with
+// locality-sensitive hashing, so each node is compared with few others. A node with a similarity of at least the threshold
+// to an older node of its type is merged into it: values are revised, and links containing it are replaced by links
+// containing the older node. Merged atoms are no longer found by their handles.
+// Handles are never reused, so that links always refer to older atoms; merges use up handles for rewritten links as well.
+// Memory of merged atoms is kept until rwkv_atomspace_compact, or until the AtomSpace is saved and loaded.
 RWKV_API bool rwkv_atomspace_consolidate_memory(
     struct rwkv_atomspace * atomspace,
     float similarity_threshold
 );
 
+// Consolidate incrementally: index or merge up to max_atoms nodes whose embeddings were set since they were last looked at
+// Atoms cannot be added during a step, but lookups go on, so steps can run in a background thread.
+// num_merged, if not NULL, receives the count of merged nodes. Returns the count of nodes still waiting.
+RWKV_API size_t rwkv_atomspace_consolidate_step(
+    struct rwkv_atomspace * atomspace,
+    float similarity_threshold,
+    size_t max_atoms,
+    size_t * num_merged
+);
+
+// Free memory of removed and merged atoms: storage of their names and outgoing sets, and blocks of handles which have
+// no atoms left. Handles of remaining atoms do not change, but pointers to atoms from rwkv_atomspace_get_atom are invalidated.
+// Must not be done while other threads use the AtomSpace. Returns false, changing nothing, if memory can not be allocated.
+RWKV_API bool rwkv_atomspace_compact(struct rwkv_atomspace * atomspace);
+
+// Persistence
+
+// Save all atoms with their handles, names, outgoing sets, truth values and attention values to a snapshot file
+// Embeddings are not saved. The file is replaced only once it is complete.
+// If a log is open, it starts over, since the snapshot holds all changes so far.
+RWKV_API bool rwkv_atomspace_save(struct rwkv_atomspace * atomspace, const char * path);
+
+// Create an AtomSpace from a snapshot file, with the same handles; returns NULL on any error
+// If use_mmap is set, the file is mapped read-only and names and outgoing sets are used from the mapping without copying.
+// The file must not be changed while the AtomSpace uses the mapping; saving replaces it with a new file, which is safe.
+RWKV_API struct rwkv_atomspace * rwkv_atomspace_load(const char * path, bool use_mmap);
+
+// Append changes from now on to a log file: added, removed and merged atoms, truth values and attention values
+// Replaying the log on the AtomSpace loaded from the last snapshot restores the state at the last flush.
+// Opening, closing and replaying logs must not be done while other threads use the AtomSpace.
+RWKV_API bool rwkv_atomspace_open_log(struct rwkv_atomspace * atomspace, const char * path);
+
+// Write buffered log records to the file
+RWKV_API bool rwkv_atomspace_flush_log(struct rwkv_atomspace * atomspace);
+
+// Flush and close the log; returns false if any record could not be written
+RWKV_API bool rwkv_atomspace_close_log(struct rwkv_atomspace * atomspace);
+
+// Apply the changes in a log file, such as after loading the snapshot it follows
+// The AtomSpace must have no open log. A record cut short, as by a crash, ends the log.
+RWKV_API bool rwkv_atomspace_replay_log(struct rwkv_atomspace * atomspace, const char * path);
+
 // Statistics and introspection
 RWKV_API size_t rwkv_atomspace_get_size(struct rwkv_atomspace * atomspace);
 RWKV_API size_t rwkv_atomspace_get_node_count(struct rwkv_atomspace * atomspace);
 RWKV_API size_t rwkv_atomspace_get_link_count(struct rwkv_atomspace * atomspace);
+RWKV_API size_t rwkv_atomspace_get_type_count(struct rwkv_atomspace * atomspace, rwkv_atom_type_t type);
+
+// Bytes of memory held for atoms: blocks, incoming sets, names, outgoing sets, indexes and snapshots; embeddings are not counted
+// Waits for atoms being added, like consolidation.
+RWKV_API size_t rwkv_atomspace_get_memory_size(struct rwkv_atomspace * atomspace);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,117 @@
+// Tests that eval with device-resident states gives results identical to eval with host buffers.
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <rwkv.h>
+
+#include "assertions.inc"
+
+void test_model(const char * model_path) {
+    fprintf(stderr, "Testing %s\n", model_path);
+
+    struct rwkv_context * ctx = rwkv_init_from_file(model_path, 2, 0);
+
+    ASSERT(ctx != NULL, "Unexpected error 0x%.8X", rwkv_get_last_error(NULL));
+
+    const size_t state_len = rwkv_get_state_len(ctx);
+    const size_t logits_len = rwkv_get_logits_len(ctx);
+
+    float * expected_state = calloc(state_len, sizeof(float));
+    float * expected_logits = calloc(logits_len, sizeof(float));
+    float * state = calloc(state_len, sizeof(float));
+    float * logits = calloc(logits_len, sizeof(float));
+
+    ASSERT(expected_state != NULL && state != NULL, "Failed to allocate state");
+    ASSERT(expected_logits != NULL && logits != NULL, "Failed to allocate logits");
+
+    struct rwkv_state * device_state = rwkv_state_init(ctx);
+
+    ASSERT(device_state != NULL, "Unexpected error 0x%.8X", rwkv_get_last_error(ctx));
+
+    // A new state is the initial state.
+    rwkv_init_state(ctx, expected_state);
+
+    ASSERT(rwkv_state_download(ctx, device_state, state), "Failed to download state");
+    ASSERT(memcmp(expected_state, state, state_len * sizeof(float)) == 0, "New state is not initialized");
+
+    const uint32_t prompt[6] = { 'h', 'e', 'l', 'l', 'o', ' ' };
+
+    ASSERT(rwkv_eval_sequence(ctx, prompt, 6, NULL, expected_state, expected_logits), "Sequence eval failed");
+    ASSERT(rwkv_eval_sequence_with_state(ctx, prompt, 6, device_state, logits), "Sequence eval with state failed");
+
+    ASSERT(memcmp(expected_logits, logits, logits_len * sizeof(float)) == 0, "Sequence logits are not identical");
+
+    const uint32_t tokens[5] = { 'w', 'o', 'r', 'l', 'd' };
+
+    for (size_t i = 0; i < 5; i++) {
+        ASSERT(rwkv_eval(ctx, tokens[i], expected_state, expected_state, expected_logits), "Eval failed");
+        ASSERT(rwkv_eval_with_state(ctx, tokens[i], device_state, logits), "Eval with state failed");
+
+        ASSERT(memcmp(expected_logits, logits, logits_len * sizeof(float)) == 0, "Logits are not identical at token %zd", i);
+    }
+
+    ASSERT(rwkv_state_download(ctx, device_state, state), "Failed to download state");
+    ASSERT(memcmp(expected_state, state, state_len * sizeof(float)) == 0, "States are not identical");
+
+    // Uploaded states continue from where host states are.
+    ASSERT(rwkv_state_upload(ctx, device_state, expected_state), "Failed to upload state");
+    ASSERT(rwkv_eval(ctx, '!', expected_state, expected_state, expected_logits), "Eval failed");
+    ASSERT(rwkv_eval_with_state(ctx, '!', device_state, logits), "Eval with state failed");
+
+    ASSERT(memcmp(expected_logits, logits, logits_len * sizeof(float)) == 0, "Logits after upload are not identical");
+
+    ASSERT(rwkv_state_upload(ctx, device_state, NULL), "Failed to reset state");
+    ASSERT(rwkv_state_download(ctx, device_state, state), "Failed to download state");
+
+    rwkv_init_state(ctx, expected_state);
+
+    ASSERT(memcmp(expected_state, state, state_len * sizeof(float)) == 0, "State was not reset");
+
+    // A cloned context shares the model, and so can use the state.
+    struct rwkv_context * clone = rwkv_clone_context(ctx, 2);
+
+    ASSERT(clone != NULL, "Unexpected error 0x%.8X", rwkv_get_last_error(ctx));
+    ASSERT(rwkv_eval_with_state(clone, 'a', device_state, NULL), "Eval with state in cloned context failed");
+
+    rwkv_free(clone);
+
+    rwkv_state_free(device_state);
+
+    rwkv_free(ctx);
+
+    free(expected_state);
+    free(expected_logits);
+    free(state);
+    free(logits);
+}
+
+int main(void) {
+    test_model("tiny-rwkv-4v0-660K-FP32.bin");
+    test_model("tiny-rwkv-5v2-730K-FP32.bin");
+    test_model("tiny-rwkv-6v0-3m-FP32.bin");
+    test_model("tiny-rwkv-7v0-834K-FP32.bin");
+
+    // ---
+
+    struct rwkv_context * ctx = rwkv_init_from_file("tiny-rwkv-5v2-730K-FP32.bin", 2, 0);
+    struct rwkv_context * other_ctx = rwkv_init_from_file("tiny-rwkv-5v2-730K-FP32.bin", 2, 0);
+
+    ASSERT(ctx != NULL && other_ctx != NULL, "Unexpected error 0x%.8X", rwkv_get_last_error(NULL));
+
+    struct rwkv_state * device_state = rwkv_state_init(ctx);
+
+    ASSERT(device_state != NULL, "Unexpected error 0x%.8X", rwkv_get_last_error(ctx));
+
+    // States of one model can not be used with another one, even if it was loaded from the same file.
+    rwkv_set_print_errors(other_ctx, false);
+    ASSERT(!rwkv_eval_with_state(other_ctx, 'a', device_state, NULL), "State of another model was accepted");
+    ASSERT(rwkv_get_last_error(other_ctx) & RWKV_ERROR_ARGS, "Unexpected error flags");
+
+    rwkv_state_free(device_state);
+
+    rwkv_free(other_ctx);
+    rwkv_free(ctx);
+
+    return 0;
+}
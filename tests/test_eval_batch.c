@@ -0,0 +1,169 @@
+// Tests that eval_batch gives results equivalent to serial eval of each state.
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include <rwkv.h>
+
+#include "assertions.inc"
+
+#define BATCH_SIZE 3
+
+// Batched matrix multiplication may accumulate in a different order than matrix-vector multiplication.
+#define MAX_DIFFERENCE 0.0001F
+
+float max_difference(const float * a, const float * b, const size_t length) {
+    float result = 0.0F;
+
+    for (size_t i = 0; i < length; i++) {
+        float difference = fabsf(a[i] - b[i]);
+
+        if (difference > result) {
+            result = difference;
+        }
+    }
+
+    return result;
+}
+
+void test_model(const char * model_path) {
+    fprintf(stderr, "Testing %s\n", model_path);
+
+    struct rwkv_context * ctx = rwkv_init_from_file(model_path, 2, 0);
+
+    ASSERT(ctx != NULL, "Unexpected error 0x%.8X", rwkv_get_last_error(NULL));
+
+    const size_t state_len = rwkv_get_state_len(ctx);
+    const size_t logits_len = rwkv_get_logits_len(ctx);
+
+    const char * prompts[BATCH_SIZE] = {
+        "This is a port of",
+        "RWKV is an RNN with transformer-level LLM performance",
+        "T"
+    };
+
+    float * expected_states[BATCH_SIZE];
+    float * expected_logits[BATCH_SIZE];
+    float * states[BATCH_SIZE];
+    float * logits[BATCH_SIZE];
+
+    for (size_t b = 0; b < BATCH_SIZE; b++) {
+        expected_states[b] = calloc(state_len, sizeof(float));
+        expected_logits[b] = calloc(logits_len, sizeof(float));
+        states[b] = calloc(state_len, sizeof(float));
+        logits[b] = calloc(logits_len, sizeof(float));
+
+        ASSERT(expected_states[b] != NULL && states[b] != NULL, "Failed to allocate state");
+        ASSERT(expected_logits[b] != NULL && logits[b] != NULL, "Failed to allocate logits");
+    }
+
+    size_t max_length = 0;
+
+    for (size_t b = 0; b < BATCH_SIZE; b++) {
+        size_t length = strlen(prompts[b]);
+
+        if (length > max_length) {
+            max_length = length;
+        }
+    }
+
+    // Sequences are of different lengths; shorter ones are padded by repeating their last token.
+    for (size_t i = 0; i < max_length; i++) {
+        uint32_t tokens[BATCH_SIZE];
+
+        for (size_t b = 0; b < BATCH_SIZE; b++) {
+            size_t length = strlen(prompts[b]);
+
+            tokens[b] = (uint32_t) (unsigned char) prompts[b][i < length ? i : length - 1];
+
+            ASSERT(rwkv_eval(ctx, tokens[b], i == 0 ? NULL : expected_states[b], expected_states[b], expected_logits[b]), "Serial eval failed");
+        }
+
+        // The first call uses NULL states to also test initialization of states.
+        const float * const * states_in = i == 0 ? NULL : (const float * const *) states;
+
+        ASSERT(rwkv_eval_batch(ctx, tokens, BATCH_SIZE, states_in, states, logits), "Batch eval failed");
+
+        for (size_t b = 0; b < BATCH_SIZE; b++) {
+            float state_difference = max_difference(expected_states[b], states[b], state_len);
+            float logits_difference = max_difference(expected_logits[b], logits[b], logits_len);
+
+            ASSERT(state_difference <= MAX_DIFFERENCE, "State %zd differs by %f at token %zd", b, state_difference, i);
+            ASSERT(logits_difference <= MAX_DIFFERENCE, "Logits %zd differ by %f at token %zd", b, logits_difference, i);
+        }
+    }
+
+    // Skipping logits for some of the states must not change the rest.
+    {
+        uint32_t tokens[BATCH_SIZE] = { 'a', 'b', 'c' };
+        float * partial_logits[BATCH_SIZE] = { NULL, logits[1], NULL };
+
+        for (size_t b = 0; b < BATCH_SIZE; b++) {
+            ASSERT(rwkv_eval(ctx, tokens[b], expected_states[b], expected_states[b], expected_logits[b]), "Serial eval failed");
+        }
+
+        ASSERT(rwkv_eval_batch(ctx, tokens, BATCH_SIZE, (const float * const *) states, states, partial_logits), "Batch eval failed");
+
+        float logits_difference = max_difference(expected_logits[1], logits[1], logits_len);
+
+        ASSERT(logits_difference <= MAX_DIFFERENCE, "Logits differ by %f", logits_difference);
+    }
+
+    // Switching between batch sizes must give the same results with cached graphs.
+    {
+        ASSERT(rwkv_get_batch_graph_cache_capacity(ctx) > 0, "Default cache capacity is 0");
+
+        rwkv_set_print_errors(ctx, false);
+        ASSERT(!rwkv_set_batch_graph_cache_capacity(ctx, 0), "Cache capacity of 0 was accepted");
+        ASSERT(rwkv_get_last_error(ctx) & RWKV_ERROR_ARGS, "Unexpected error flags");
+        rwkv_set_print_errors(ctx, true);
+
+        ASSERT(rwkv_set_batch_graph_cache_capacity(ctx, 1), "Failed to set cache capacity");
+        ASSERT(rwkv_get_batch_graph_cache_capacity(ctx) == 1, "Cache capacity was not set");
+
+        // With a capacity of 1, every other size is evicted; with 2, both stay cached.
+        const size_t sizes[6] = { 2, BATCH_SIZE, 2, BATCH_SIZE, 2, BATCH_SIZE };
+
+        for (size_t i = 0; i < 6; i++) {
+            if (i == 3) {
+                ASSERT(rwkv_set_batch_graph_cache_capacity(ctx, 2), "Failed to set cache capacity");
+            }
+
+            uint32_t tokens[BATCH_SIZE] = { 'd', 'e', 'f' };
+
+            for (size_t b = 0; b < sizes[i]; b++) {
+                ASSERT(rwkv_eval(ctx, tokens[b], expected_states[b], expected_states[b], expected_logits[b]), "Serial eval failed");
+            }
+
+            ASSERT(rwkv_eval_batch(ctx, tokens, sizes[i], (const float * const *) states, states, logits), "Batch eval failed");
+
+            for (size_t b = 0; b < sizes[i]; b++) {
+                float logits_difference = max_difference(expected_logits[b], logits[b], logits_len);
+
+                ASSERT(logits_difference <= MAX_DIFFERENCE, "Logits %zd differ by %f with batch size %zd", b, logits_difference, sizes[i]);
+            }
+        }
+    }
+
+    // ---
+
+    rwkv_free(ctx);
+
+    for (size_t b = 0; b < BATCH_SIZE; b++) {
+        free(expected_states[b]);
+        free(expected_logits[b]);
+        free(states[b]);
+        free(logits[b]);
+    }
+}
+
+int main(void) {
+    test_model("tiny-rwkv-4v0-660K-FP32.bin");
+    test_model("tiny-rwkv-5v1-730K-FP32.bin");
+    test_model("tiny-rwkv-5v2-730K-FP32.bin");
+    test_model("tiny-rwkv-6v0-3m-FP32.bin");
+    test_model("tiny-rwkv-7v0-834K-FP32.bin");
+
+    return 0;
+}
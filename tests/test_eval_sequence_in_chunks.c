@@ -42,9 +42,10 @@ void test_on_prompt(const char * prompt, const size_t prompt_length) {
     ASSERT(state != NULL, "Failed to allocate state");
     ASSERT(logits != NULL, "Failed to allocate logits");
 
-    const size_t chunk_sizes[4] = {1, 2, 8, 10};
+    // 0 chooses the chunk size automatically.
+    const size_t chunk_sizes[5] = {1, 2, 8, 10, 0};
 
-    for (int i = 0; i < 4; i++) {
+    for (int i = 0; i < 5; i++) {
         size_t chunk_size = chunk_sizes[i];
 
         fprintf(stderr, "Testing chunk_size = %zd\n", chunk_size);
@@ -56,6 +57,21 @@ void test_on_prompt(const char * prompt, const size_t prompt_length) {
 
     // ---
 
+    const size_t auto_chunk_size = rwkv_get_auto_chunk_size(ctx);
+
+    ASSERT(auto_chunk_size >= 4 && auto_chunk_size <= 64, "Unexpected auto chunk size %zd", auto_chunk_size);
+    ASSERT((auto_chunk_size & (auto_chunk_size - 1)) == 0, "Auto chunk size %zd is not a power of two", auto_chunk_size);
+    ASSERT(rwkv_get_sequence_graph_cache_capacity(ctx) >= 4, "Sequence graph cache capacity was lowered");
+
+    struct rwkv_context * clone = rwkv_clone_context(ctx, 2);
+
+    ASSERT(clone != NULL, "Unexpected error 0x%.8X", rwkv_get_last_error(ctx));
+    ASSERT(rwkv_get_auto_chunk_size(clone) == auto_chunk_size, "Auto chunk size is not shared by clones");
+
+    rwkv_free(clone);
+
+    // ---
+
     rwkv_free(ctx);
 
     free(logits);
@@ -0,0 +1,109 @@
+// Tests that files of version 2 have an aligned tensor directory, keep metadata of the source files, and load the same with and without mmap.
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <rwkv.h>
+
+#include "assertions.inc"
+
+// Sizes of the file header, the directory header, and the fixed part of a directory entry.
+#define FILE_HEADER_SIZE 24
+#define DIRECTORY_HEADER_SIZE 16
+#define ENTRY_HEADER_SIZE 24
+
+void assert_data_aligned(const char * path, const struct rwkv_file_info * info) {
+    FILE * file = fopen(path, "rb");
+
+    ASSERT(file != NULL, "Failed to open %s", path);
+    ASSERT(fseek(file, FILE_HEADER_SIZE + DIRECTORY_HEADER_SIZE, SEEK_SET) == 0, "Failed to seek");
+
+    for (uint32_t i = 0; i < info->tensor_count; i++) {
+        uint32_t header[6];
+        uint64_t offset;
+
+        ASSERT(fread(header, ENTRY_HEADER_SIZE, 1, file) == 1, "Failed to read entry header");
+        ASSERT(fread(&offset, sizeof(offset), 1, file) == 1, "Failed to read entry offset");
+        ASSERT(offset % info->alignment == 0, "Tensor %d is at unaligned offset %lld", (int) i, (long long) offset);
+        ASSERT(fseek(file, header[1], SEEK_CUR) == 0, "Failed to skip entry name");
+    }
+
+    fclose(file);
+}
+
+void eval_prompt(const char * path, const bool use_mmap, float * logits) {
+    struct rwkv_init_params params = rwkv_init_params_default();
+    params.use_mmap = use_mmap;
+
+    struct rwkv_context * ctx = rwkv_init_from_file_with_params(path, &params);
+
+    ASSERT(ctx != NULL, "Unexpected error 0x%.8X", rwkv_get_last_error(NULL));
+
+    const uint32_t prompt[4] = { 'T', 'e', 's', 't' };
+
+    ASSERT(rwkv_eval_sequence(ctx, prompt, 4, NULL, NULL, logits), "Sequence eval failed");
+
+    rwkv_free(ctx);
+}
+
+void test_model(const char * source_path, const uint32_t arch_version_major, const uint32_t arch_version_minor) {
+    fprintf(stderr, "Testing %s\n", source_path);
+
+    const char * path = "tiny-rwkv-file-format.bin";
+
+    struct rwkv_file_info source_info;
+    struct rwkv_file_info info;
+
+    ASSERT(rwkv_read_file_info(source_path, &source_info), "Failed to read file info");
+    ASSERT(source_info.file_version < RWKV_FILE_VERSION_2, "Unexpected file version %d", (int) source_info.file_version);
+    ASSERT(source_info.alignment == 1, "Unexpected alignment");
+    ASSERT(source_info.arch_version_major == arch_version_major && source_info.arch_version_minor == arch_version_minor, "Unexpected inferred architecture version");
+
+    ASSERT(rwkv_quantize_model_file(source_path, path, "Q5_1"), "Quantization failed");
+
+    ASSERT(rwkv_read_file_info(path, &info), "Failed to read file info");
+    ASSERT(info.file_version == RWKV_FILE_VERSION_2, "Unexpected file version %d", (int) info.file_version);
+    ASSERT(info.alignment == 4096, "Unexpected alignment %d", (int) info.alignment);
+    ASSERT(info.arch_version_major == arch_version_major && info.arch_version_minor == arch_version_minor, "Unexpected stored architecture version");
+    ASSERT(info.n_vocab == source_info.n_vocab && info.n_embed == source_info.n_embed && info.n_layer == source_info.n_layer, "Dimensions differ");
+    ASSERT(info.tensor_count == source_info.tensor_count, "Tensor counts differ");
+    ASSERT(strcmp(info.data_type, "Q5_1") == 0, "Unexpected data type %s", info.data_type);
+
+    assert_data_aligned(path, &info);
+
+    float * mapped_logits = calloc(source_info.n_vocab, sizeof(float));
+    float * logits = calloc(source_info.n_vocab, sizeof(float));
+
+    ASSERT(mapped_logits != NULL && logits != NULL, "Failed to allocate logits");
+
+    eval_prompt(path, true, mapped_logits);
+    eval_prompt(path, false, logits);
+
+    ASSERT(memcmp(mapped_logits, logits, source_info.n_vocab * sizeof(float)) == 0, "Logits are not identical");
+
+    free(mapped_logits);
+    free(logits);
+
+    remove(path);
+}
+
+int main(void) {
+    test_model("tiny-rwkv-4v0-660K-FP32.bin", 4, 0);
+    test_model("tiny-rwkv-5v1-730K-FP16.bin", 5, 1);
+    test_model("tiny-rwkv-5v2-730K-FP32.bin", 5, 2);
+    test_model("tiny-rwkv-6v0-3m-FP16.bin", 6, 0);
+    test_model("tiny-rwkv-7v0-834K-FP32.bin", 7, 0);
+
+    // ---
+
+    rwkv_set_print_errors(NULL, false);
+
+    struct rwkv_file_info info;
+
+    ASSERT(!rwkv_read_file_info("tiny-rwkv-missing.bin", &info), "Missing file was read");
+    ASSERT(rwkv_get_last_error(NULL) & RWKV_ERROR_FILE_OPEN, "Unexpected error flags");
+
+    rwkv_set_print_errors(NULL, true);
+
+    return 0;
+}
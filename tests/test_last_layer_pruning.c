@@ -0,0 +1,103 @@
+// Tests that sequence mode, which computes channel mixing of the last layer only for the last tokens,
+// gives results bit-identical to serial eval, and close to the expected logits.
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <rwkv.h>
+
+#include "logit_difference_validator.inc"
+
+#define VERSION_COUNT 5
+
+void test_prompt(struct rwkv_context * ctx, const char * prompt, float * expected_state, float * expected_logits, float * state, float * logits) {
+    const size_t prompt_length = strlen(prompt);
+    const size_t state_len = rwkv_get_state_len(ctx);
+
+    uint32_t * tokens = calloc(prompt_length, sizeof(uint32_t));
+
+    ASSERT(tokens != NULL, "Failed to allocate tokens");
+
+    for (size_t i = 0; i < prompt_length; i++) {
+        tokens[i] = (uint32_t) (unsigned char) prompt[i];
+    }
+
+    rwkv_init_state(ctx, expected_state);
+
+    for (size_t i = 0; i < prompt_length; i++) {
+        rwkv_eval(ctx, tokens[i], expected_state, expected_state, expected_logits);
+    }
+
+    rwkv_init_state(ctx, state);
+    rwkv_eval_sequence(ctx, tokens, prompt_length, state, state, logits);
+
+    ASSERT(memcmp(expected_state, state, state_len * sizeof(float)) == 0, "States are not identical for prompt of size %zd", prompt_length);
+    ASSERT(memcmp(expected_logits, logits, N_VOCAB * sizeof(float)) == 0, "Logits are not identical for prompt of size %zd", prompt_length);
+
+    free(tokens);
+}
+
+int main(void) {
+    const char * versions[VERSION_COUNT] = {
+        "4v0-660K",
+        "5v1-730K",
+        "5v2-730K",
+        "6v0-3m",
+        "7v0-834K"
+    };
+
+    // Same as in test_tiny_rwkv.
+    const float max_diff = 0.001000F;
+
+    float * expected_logits = calloc(N_VOCAB, sizeof(float));
+    float * serial_logits = calloc(N_VOCAB, sizeof(float));
+    float * logits = calloc(N_VOCAB, sizeof(float));
+
+    ASSERT(expected_logits != NULL && serial_logits != NULL && logits != NULL, "Failed to allocate logits");
+
+    for (int i = 0; i < VERSION_COUNT; i++) {
+        char file_name[128];
+        snprintf(file_name, sizeof(file_name), "tiny-rwkv-%s-FP32.bin", versions[i]);
+
+        fprintf(stderr, "Testing %s\n", file_name);
+
+        struct rwkv_context * ctx = rwkv_init_from_file(file_name, N_THREADS, N_GPU_LAYERS);
+
+        ASSERT(ctx != NULL, "Unexpected error 0x%.8X", rwkv_get_last_error(NULL));
+
+        float * serial_state = calloc(rwkv_get_state_len(ctx), sizeof(float));
+        float * state = calloc(rwkv_get_state_len(ctx), sizeof(float));
+
+        ASSERT(serial_state != NULL && state != NULL, "Failed to allocate state");
+
+        // Expected logits were calculated for this prompt.
+        test_prompt(ctx, "\"in", serial_state, serial_logits, state, logits);
+
+        load_expected_logits(expected_logits, versions[i]);
+
+        float diff_sum = 0.0F;
+
+        for (uint32_t j = 0; j < N_VOCAB; j++) {
+            diff_sum += logits[j] - expected_logits[j];
+        }
+
+        fprintf(stderr, "Sequence difference sum: %f, expected %f\n", (double) diff_sum, (double) max_diff);
+
+        ASSERT(fabsf(diff_sum) <= fabsf(max_diff) * 1.05F, "Too big sequence difference %f, expected no more than %f", (double) diff_sum, (double) max_diff);
+
+        // Also test sequences of two tokens, where nothing is pruned, and longer sequences.
+        test_prompt(ctx, "in", serial_state, serial_logits, state, logits);
+        test_prompt(ctx, "This is a port of BlinkDL/RWKV-LM", serial_state, serial_logits, state, logits);
+
+        rwkv_free(ctx);
+
+        free(serial_state);
+        free(state);
+    }
+
+    free(expected_logits);
+    free(serial_logits);
+    free(logits);
+
+    return 0;
+}
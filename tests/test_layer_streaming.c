@@ -0,0 +1,87 @@
+// Tests that streaming layers through GPU slots does not change results. Without a GPU backend, streaming is ignored.
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include <rwkv.h>
+
+#include "assertions.inc"
+
+void eval_prompt(const char * path, const uint32_t n_gpu_layers, const uint32_t n_stream_slots, float * logits) {
+    struct rwkv_init_params params = rwkv_init_params_default();
+    params.n_gpu_layers = n_gpu_layers;
+    params.n_stream_slots = n_stream_slots;
+
+    struct rwkv_context * ctx = rwkv_init_from_file_with_params(path, &params);
+
+    ASSERT(ctx != NULL, "Unexpected error 0x%.8X", rwkv_get_last_error(NULL));
+
+    const uint32_t prompt[4] = { 'T', 'e', 's', 't' };
+    const size_t n_vocab = rwkv_get_logits_len(ctx);
+
+    float * state = calloc(rwkv_get_state_len(ctx), sizeof(float));
+
+    ASSERT(state != NULL, "Failed to allocate state");
+
+    // Slots are reused between evals, so both sequence and single token evals are checked.
+    ASSERT(rwkv_eval_sequence(ctx, prompt, 4, NULL, state, logits), "Sequence eval failed");
+    ASSERT(rwkv_eval(ctx, 'x', state, state, logits + n_vocab), "Eval failed");
+
+    free(state);
+
+    rwkv_free(ctx);
+}
+
+void test_model(const char * path) {
+    fprintf(stderr, "Testing %s\n", path);
+
+    struct rwkv_context * ctx = rwkv_init_from_file(path, 1, 0);
+
+    ASSERT(ctx != NULL, "Unexpected error 0x%.8X", rwkv_get_last_error(NULL));
+
+    const size_t n_vocab = rwkv_get_logits_len(ctx);
+
+    rwkv_free(ctx);
+
+    float * expected_logits = calloc(n_vocab * 2, sizeof(float));
+    float * logits = calloc(n_vocab * 2, sizeof(float));
+
+    ASSERT(expected_logits != NULL && logits != NULL, "Failed to allocate logits");
+
+    eval_prompt(path, 1, 0, expected_logits);
+
+    // With 2 slots, layers are uploaded during evals; with more slots than layers, only once.
+    const uint32_t slot_counts[2] = { 2, 16 };
+
+    for (int i = 0; i < 2; i++) {
+        eval_prompt(path, 1, slot_counts[i], logits);
+
+        for (size_t j = 0; j < n_vocab * 2; j++) {
+            ASSERT(fabsf(logits[j] - expected_logits[j]) <= 1e-5F, "Logit %zd differs with %d slots: %f != %f", j, (int) slot_counts[i], (double) logits[j], (double) expected_logits[j]);
+        }
+    }
+
+    free(expected_logits);
+    free(logits);
+}
+
+int main(void) {
+    test_model("tiny-rwkv-5v2-730K-FP32.bin");
+    test_model("tiny-rwkv-6v0-3m-FP16.bin");
+    test_model("tiny-rwkv-7v0-834K-FP32.bin");
+
+    // ---
+
+    rwkv_set_print_errors(NULL, false);
+
+    struct rwkv_init_params params = rwkv_init_params_default();
+    params.n_stream_slots = 1;
+
+    ASSERT(rwkv_init_from_file_with_params("tiny-rwkv-5v2-730K-FP32.bin", &params) == NULL, "Single stream slot was accepted");
+    ASSERT(rwkv_get_last_error(NULL) & RWKV_ERROR_ARGS, "Unexpected error flags");
+
+    rwkv_set_print_errors(NULL, true);
+
+    return 0;
+}
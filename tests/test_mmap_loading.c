@@ -0,0 +1,69 @@
+// Tests that a model loaded with mmap gives results identical to a model loaded by reading the file.
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <rwkv.h>
+
+#include "assertions.inc"
+
+void eval_prompt(const char * model_path, const bool use_mmap, float * state, float * logits) {
+    struct rwkv_init_params params = rwkv_init_params_default();
+    params.n_threads = 2;
+    params.use_mmap = use_mmap;
+
+    struct rwkv_context * ctx = rwkv_init_from_file_with_params(model_path, &params);
+
+    ASSERT(ctx != NULL, "Unexpected error 0x%.8X", rwkv_get_last_error(NULL));
+
+    const uint8_t prompt[12] = "hello world";
+
+    rwkv_eval(ctx, prompt[0], NULL, state, logits);
+
+    for (size_t i = 1; prompt[i] != 0; i++) {
+        rwkv_eval(ctx, prompt[i], state, state, logits);
+    }
+
+    rwkv_free(ctx);
+}
+
+void test_model(const char * model_path) {
+    fprintf(stderr, "Testing %s\n", model_path);
+
+    struct rwkv_context * ctx = rwkv_init_from_file(model_path, 1, 0);
+
+    ASSERT(ctx != NULL, "Unexpected error 0x%.8X", rwkv_get_last_error(NULL));
+
+    const size_t state_len = rwkv_get_state_len(ctx);
+    const size_t logits_len = rwkv_get_logits_len(ctx);
+
+    rwkv_free(ctx);
+
+    float * expected_state = calloc(state_len, sizeof(float));
+    float * expected_logits = calloc(logits_len, sizeof(float));
+    float * state = calloc(state_len, sizeof(float));
+    float * logits = calloc(logits_len, sizeof(float));
+
+    ASSERT(expected_state != NULL && state != NULL, "Failed to allocate state");
+    ASSERT(expected_logits != NULL && logits != NULL, "Failed to allocate logits");
+
+    eval_prompt(model_path, false, expected_state, expected_logits);
+    eval_prompt(model_path, true, state, logits);
+
+    ASSERT(memcmp(expected_state, state, state_len * sizeof(float)) == 0, "States are not identical");
+    ASSERT(memcmp(expected_logits, logits, logits_len * sizeof(float)) == 0, "Logits are not identical");
+
+    free(expected_state);
+    free(expected_logits);
+    free(state);
+    free(logits);
+}
+
+int main(void) {
+    test_model("tiny-rwkv-4v0-660K-FP32.bin");
+    test_model("tiny-rwkv-5v2-730K-FP16.bin");
+    test_model("tiny-rwkv-6v0-3m-Q5_1.bin");
+    test_model("tiny-rwkv-7v0-834K-FP32.bin");
+
+    return 0;
+}
@@ -0,0 +1,106 @@
+// Tests that offload plans follow n_gpu_layers and the GPU memory budget. Without a GPU backend, nothing is offloaded.
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+
+#include <rwkv.h>
+
+#include "assertions.inc"
+
+struct rwkv_context * load(const char * path, const uint32_t n_gpu_layers, const size_t gpu_memory_budget, struct rwkv_offload_info * info) {
+    struct rwkv_init_params params = rwkv_init_params_default();
+    params.n_gpu_layers = n_gpu_layers;
+    params.gpu_memory_budget = gpu_memory_budget;
+
+    struct rwkv_context * ctx = rwkv_init_from_file_with_params(path, &params);
+
+    ASSERT(ctx != NULL, "Unexpected error 0x%.8X", rwkv_get_last_error(NULL));
+    ASSERT(rwkv_get_offload_info(ctx, info), "Failed to get offload info");
+    ASSERT(info->n_graph_splits >= 1, "Graph has no splits");
+
+    return ctx;
+}
+
+void test_model(const char * path) {
+    fprintf(stderr, "Testing %s\n", path);
+
+    struct rwkv_offload_info info;
+
+    struct rwkv_context * ctx = load(path, 0, 0, &info);
+    const uint32_t n_layer = (uint32_t) rwkv_get_n_layer(ctx);
+    const size_t weights_size = info.cpu_weights_size;
+    rwkv_free(ctx);
+
+    ASSERT(info.n_gpu_layers == 0 && !info.head_offloaded && info.n_streamed_layers == 0, "Parameters were offloaded");
+    ASSERT(info.gpu_weights_size == 0 && weights_size > 0, "Unexpected weights sizes");
+    ASSERT(info.n_graph_copies == 0 && info.graph_copy_size == 0, "Values are copied between backends");
+
+    // Whether there is a GPU backend.
+    ctx = load(path, 1, 0, &info);
+    const int gpu = info.n_gpu_layers > 0;
+    rwkv_free(ctx);
+
+    ASSERT(info.gpu_weights_size + info.cpu_weights_size == weights_size, "Weights sizes do not add up");
+
+    ctx = load(path, n_layer + 1, 0, &info);
+    rwkv_free(ctx);
+
+    ASSERT(info.n_gpu_layers == (gpu ? n_layer : 0) && info.head_offloaded == gpu, "Unexpected plan of n_gpu_layers");
+    ASSERT(info.n_gpu_devices == (uint32_t) gpu, "Unexpected GPU device count %d", (int) info.n_gpu_devices);
+
+    // A budget that nothing fits into.
+    ctx = load(path, n_layer + 1, 1, &info);
+    rwkv_free(ctx);
+
+    ASSERT(info.n_gpu_layers == 0 && !info.head_offloaded && info.gpu_weights_size == 0, "Parameters were offloaded beyond the budget");
+
+    // A budget that the tiny model fits into.
+    ctx = load(path, 0, SIZE_MAX, &info);
+    rwkv_free(ctx);
+
+    ASSERT(info.n_gpu_layers == (gpu ? n_layer : 0) && info.head_offloaded == gpu, "Unexpected plan of budget");
+    ASSERT(info.gpu_weights_size + info.cpu_weights_size == weights_size, "Weights sizes do not add up");
+
+    if (gpu) {
+        ctx = load(path, n_layer, 0, &info);
+        const size_t layers_size = info.gpu_weights_size;
+        rwkv_free(ctx);
+
+        ctx = load(path, n_layer + 1, 0, &info);
+        const size_t head_size = info.gpu_weights_size - layers_size;
+        rwkv_free(ctx);
+
+        // The head goes first.
+        ctx = load(path, 0, head_size, &info);
+        rwkv_free(ctx);
+
+        ASSERT(info.n_gpu_layers == 0 && info.head_offloaded && info.gpu_weights_size == head_size, "Head was not offloaded first");
+
+        // All layers without the head copy fewer values between backends than the head with only some of the layers.
+        ctx = load(path, 0, layers_size, &info);
+        rwkv_free(ctx);
+
+        ASSERT(info.n_gpu_layers == n_layer && !info.head_offloaded, "Layers were not offloaded instead of the head");
+    }
+}
+
+int main(void) {
+    test_model("tiny-rwkv-5v2-730K-FP32.bin");
+    test_model("tiny-rwkv-6v0-3m-FP16.bin");
+    test_model("tiny-rwkv-7v0-834K-FP32.bin");
+
+    // ---
+
+    rwkv_set_print_errors(NULL, false);
+
+    struct rwkv_init_params params = rwkv_init_params_default();
+    params.n_gpu_devices = 0;
+
+    ASSERT(rwkv_init_from_file_with_params("tiny-rwkv-5v2-730K-FP32.bin", &params) == NULL, "GPU device count of 0 was accepted");
+    ASSERT(rwkv_get_last_error(NULL) & RWKV_ERROR_ARGS, "Unexpected error flags");
+
+    rwkv_set_print_errors(NULL, true);
+
+    return 0;
+}
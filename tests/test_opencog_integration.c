@@ -146,6 +146,134 @@ int test_links() {
     return 0;
 }
 
+int test_incoming_sets() {
+    printf("Testing incoming sets...\n");
+    
+    struct rwkv_atomspace * atomspace = rwkv_atomspace_create();
+    ASSERT_NOT_NULL(atomspace);
+    
+    rwkv_atom_handle_t cat = rwkv_atomspace_add_node(
+        atomspace, RWKV_ATOM_CONCEPT_NODE, "Cat"
+    );
+    rwkv_atom_handle_t animal = rwkv_atomspace_add_node(
+        atomspace, RWKV_ATOM_CONCEPT_NODE, "Animal"
+    );
+    rwkv_atom_handle_t pet = rwkv_atomspace_add_node(
+        atomspace, RWKV_ATOM_CONCEPT_NODE, "Pet"
+    );
+    
+    rwkv_atom_handle_t cat_animal_outgoing[2] = {cat, animal};
+    rwkv_atom_handle_t cat_animal = rwkv_atomspace_add_link(
+        atomspace, RWKV_ATOM_INHERITANCE_LINK, cat_animal_outgoing, 2
+    );
+    rwkv_atom_handle_t cat_pet_outgoing[2] = {cat, pet};
+    rwkv_atom_handle_t cat_pet = rwkv_atomspace_add_link(
+        atomspace, RWKV_ATOM_INHERITANCE_LINK, cat_pet_outgoing, 2
+    );
+    
+    // Same type and outgoing set is the same link; another type or order is not
+    ASSERT_EQUAL(rwkv_atomspace_add_link(atomspace, RWKV_ATOM_INHERITANCE_LINK, cat_animal_outgoing, 2), cat_animal);
+    rwkv_atom_handle_t similarity = rwkv_atomspace_add_link(
+        atomspace, RWKV_ATOM_SIMILARITY_LINK, cat_animal_outgoing, 2
+    );
+    ASSERT_NOT_EQUAL(similarity, cat_animal);
+    
+    // Repeated targets are in the incoming set once
+    rwkv_atom_handle_t cat_cat_outgoing[2] = {cat, cat};
+    rwkv_atom_handle_t cat_cat = rwkv_atomspace_add_link(
+        atomspace, RWKV_ATOM_LIST_LINK, cat_cat_outgoing, 2
+    );
+    ASSERT_NOT_EQUAL(cat_cat, RWKV_INVALID_ATOM_HANDLE);
+    
+    rwkv_atom_handle_t incoming[10];
+    ASSERT_EQUAL(rwkv_atomspace_get_incoming(atomspace, cat, incoming, 10), 4);
+    ASSERT_EQUAL(incoming[0], cat_animal);
+    ASSERT_EQUAL(incoming[1], cat_pet);
+    ASSERT_EQUAL(incoming[2], similarity);
+    ASSERT_EQUAL(incoming[3], cat_cat);
+    
+    // The size of the set is returned even if it does not fit
+    ASSERT_EQUAL(rwkv_atomspace_get_incoming(atomspace, cat, NULL, 0), 4);
+    ASSERT_EQUAL(rwkv_atomspace_get_incoming(atomspace, animal, incoming, 1), 2);
+    ASSERT_EQUAL(incoming[0], cat_animal);
+    ASSERT_EQUAL(rwkv_atomspace_get_incoming(atomspace, pet, incoming, 10), 1);
+    ASSERT_EQUAL(incoming[0], cat_pet);
+    ASSERT_EQUAL(rwkv_atomspace_get_incoming(atomspace, cat_pet, incoming, 10), 0);
+    ASSERT_EQUAL(rwkv_atomspace_get_incoming(atomspace, RWKV_INVALID_ATOM_HANDLE, incoming, 10), 0);
+    
+    ASSERT_EQUAL(rwkv_atomspace_get_size(atomspace), 7);
+    ASSERT_EQUAL(rwkv_atomspace_get_link_count(atomspace), 4);
+    
+    rwkv_atomspace_free(atomspace);
+    printf("Incoming sets: PASSED\n");
+    return 0;
+}
+
+int test_bulk_operations() {
+    printf("Testing bulk operations...\n");
+    
+    struct rwkv_atomspace * atomspace = rwkv_atomspace_create();
+    ASSERT_NOT_NULL(atomspace);
+    
+    rwkv_atom_handle_t cat = rwkv_atomspace_add_node(
+        atomspace, RWKV_ATOM_CONCEPT_NODE, "Cat"
+    );
+    
+    // Existing and repeated names get the same node; NULL names get the invalid handle
+    const char * names[5] = {"Dog", "Cat", "Bird", NULL, "Dog"};
+    rwkv_atom_handle_t nodes[5];
+    ASSERT_EQUAL(rwkv_atomspace_add_nodes(atomspace, RWKV_ATOM_CONCEPT_NODE, names, 5, nodes), 4);
+    ASSERT_EQUAL(nodes[1], cat);
+    ASSERT_EQUAL(nodes[4], nodes[0]);
+    ASSERT_EQUAL(nodes[3], RWKV_INVALID_ATOM_HANDLE);
+    ASSERT_EQUAL(strcmp(rwkv_atom_get_name(rwkv_atomspace_get_atom(atomspace, nodes[2])), "Bird"), 0);
+    ASSERT_EQUAL(rwkv_atomspace_get_node_count(atomspace), 3);
+    
+    // A name of another type is another node with the same name
+    rwkv_atom_handle_t predicate = rwkv_atomspace_add_node(
+        atomspace, RWKV_ATOM_PREDICATE_NODE, "Dog"
+    );
+    ASSERT_NOT_EQUAL(predicate, nodes[0]);
+    ASSERT_EQUAL(strcmp(rwkv_atom_get_name(rwkv_atomspace_get_atom(atomspace, predicate)), "Dog"), 0);
+    
+    // Outgoing sets follow each other; empty sets and missing atoms get the invalid handle
+    rwkv_atom_handle_t outgoing[7] = {nodes[0], cat, cat, nodes[2], nodes[0], cat, 12345};
+    size_t outgoing_counts[4] = {2, 2, 0, 3};
+    rwkv_atom_handle_t links[4];
+    ASSERT_EQUAL(rwkv_atomspace_add_links(atomspace, RWKV_ATOM_SIMILARITY_LINK, outgoing, outgoing_counts, 4, links), 2);
+    ASSERT_EQUAL(links[2], RWKV_INVALID_ATOM_HANDLE);
+    ASSERT_EQUAL(links[3], RWKV_INVALID_ATOM_HANDLE);
+    ASSERT_EQUAL(rwkv_atomspace_add_link(atomspace, RWKV_ATOM_SIMILARITY_LINK, outgoing + 2, 2), links[1]);
+    
+    rwkv_atom_handle_t link_outgoing[2];
+    ASSERT_EQUAL(rwkv_atom_get_outgoing(rwkv_atomspace_get_atom(atomspace, links[0]), link_outgoing, 2), 2);
+    ASSERT_EQUAL(link_outgoing[0], nodes[0]);
+    ASSERT_EQUAL(link_outgoing[1], cat);
+    
+    rwkv_atom_handle_t incoming[4];
+    ASSERT_EQUAL(rwkv_atomspace_get_incoming(atomspace, cat, incoming, 4), 2);
+    ASSERT_EQUAL(rwkv_atomspace_get_size(atomspace), 6);
+    
+    // Clearing frees all atoms at once; old handles no longer find atoms
+    rwkv_atomspace_clear(atomspace);
+    ASSERT_EQUAL(rwkv_atomspace_get_size(atomspace), 0);
+    ASSERT_EQUAL(rwkv_atomspace_get_node_count(atomspace), 0);
+    ASSERT_EQUAL(rwkv_atomspace_get_type_count(atomspace, RWKV_ATOM_SIMILARITY_LINK), 0);
+    ASSERT_NULL(rwkv_atomspace_get_atom(atomspace, cat));
+    ASSERT_NULL(rwkv_atomspace_get_atom(atomspace, links[0]));
+    
+    rwkv_atom_handle_t new_cat = rwkv_atomspace_add_node(
+        atomspace, RWKV_ATOM_CONCEPT_NODE, "Cat"
+    );
+    ASSERT_NOT_EQUAL(new_cat, RWKV_INVALID_ATOM_HANDLE);
+    ASSERT_NOT_EQUAL(new_cat, cat);
+    ASSERT_EQUAL(rwkv_atomspace_get_size(atomspace), 1);
+    
+    rwkv_atomspace_free(atomspace);
+    printf("Bulk operations: PASSED\n");
+    return 0;
+}
+
 int test_pattern_matching() {
     printf("Testing pattern matching...\n");
     
@@ -211,14 +339,353 @@ int test_inference() {
     return 0;
 }
 
+int test_forward_chaining() {
+    printf("Testing forward chaining...\n");
+    
+    struct rwkv_atomspace * atomspace = rwkv_atomspace_create();
+    ASSERT_NOT_NULL(atomspace);
+    
+    // Cat -> Mammal -> Animal -> LivingThing -> Cat, and Cat -> Pet
+    const char * names[5] = {"Cat", "Mammal", "Animal", "LivingThing", "Pet"};
+    rwkv_atom_handle_t nodes[5];
+    for (int i = 0; i < 5; i++) {
+        nodes[i] = rwkv_atomspace_add_node(atomspace, RWKV_ATOM_CONCEPT_NODE, names[i]);
+    }
+    
+    for (int i = 0; i < 4; i++) {
+        rwkv_atom_handle_t outgoing[2] = {nodes[i], nodes[(i + 1) % 4]};
+        ASSERT_NOT_EQUAL(rwkv_atomspace_add_link(atomspace, RWKV_ATOM_IMPLICATION_LINK, outgoing, 2), RWKV_INVALID_ATOM_HANDLE);
+    }
+    
+    rwkv_atom_handle_t pet_outgoing[2] = {nodes[0], nodes[4]};
+    ASSERT_NOT_EQUAL(rwkv_atomspace_add_link(atomspace, RWKV_ATOM_IMPLICATION_LINK, pet_outgoing, 2), RWKV_INVALID_ATOM_HANDLE);
+    
+    // Not an implication, so not followed
+    rwkv_atom_handle_t similarity_outgoing[2] = {nodes[4], nodes[1]};
+    ASSERT_NOT_EQUAL(rwkv_atomspace_add_link(atomspace, RWKV_ATOM_SIMILARITY_LINK, similarity_outgoing, 2), RWKV_INVALID_ATOM_HANDLE);
+    
+    rwkv_atom_handle_t conclusions[10];
+    size_t num_conclusions;
+    
+    // One step is the same as forward inference
+    ASSERT_TRUE(rwkv_atomspace_forward_chain(atomspace, nodes[0], 1, conclusions, 10, &num_conclusions));
+    ASSERT_EQUAL(num_conclusions, 2);
+    ASSERT_EQUAL(conclusions[0], nodes[1]);
+    ASSERT_EQUAL(conclusions[1], nodes[4]);
+    
+    // The whole closure, nearest first, without the premise
+    ASSERT_TRUE(rwkv_atomspace_forward_chain(atomspace, nodes[0], 0, conclusions, 10, &num_conclusions));
+    ASSERT_EQUAL(num_conclusions, 4);
+    ASSERT_EQUAL(conclusions[0], nodes[1]);
+    ASSERT_EQUAL(conclusions[1], nodes[4]);
+    ASSERT_EQUAL(conclusions[2], nodes[2]);
+    ASSERT_EQUAL(conclusions[3], nodes[3]);
+    
+    ASSERT_TRUE(rwkv_atomspace_forward_chain(atomspace, nodes[0], 0, conclusions, 3, &num_conclusions));
+    ASSERT_EQUAL(num_conclusions, 3);
+    
+    ASSERT_TRUE(rwkv_atomspace_forward_chain(atomspace, nodes[4], 0, conclusions, 10, &num_conclusions));
+    ASSERT_EQUAL(num_conclusions, 0);
+    
+    // Counts come from the type index
+    ASSERT_EQUAL(rwkv_atomspace_get_type_count(atomspace, RWKV_ATOM_CONCEPT_NODE), 5);
+    ASSERT_EQUAL(rwkv_atomspace_get_type_count(atomspace, RWKV_ATOM_IMPLICATION_LINK), 5);
+    ASSERT_EQUAL(rwkv_atomspace_get_type_count(atomspace, RWKV_ATOM_SIMILARITY_LINK), 1);
+    ASSERT_EQUAL(rwkv_atomspace_get_node_count(atomspace), 5);
+    ASSERT_EQUAL(rwkv_atomspace_get_link_count(atomspace), 6);
+    
+    rwkv_atomspace_free(atomspace);
+    printf("Forward chaining: PASSED\n");
+    return 0;
+}
+
+int test_memory_consolidation() {
+    printf("Testing memory consolidation...\n");
+    
+    struct rwkv_atomspace * atomspace = rwkv_atomspace_create();
+    ASSERT_NOT_NULL(atomspace);
+    
+    rwkv_atom_handle_t cat = rwkv_atomspace_add_node(atomspace, RWKV_ATOM_CONCEPT_NODE, "Cat");
+    rwkv_atom_handle_t kitten = rwkv_atomspace_add_node(atomspace, RWKV_ATOM_CONCEPT_NODE, "Kitten");
+    rwkv_atom_handle_t dog = rwkv_atomspace_add_node(atomspace, RWKV_ATOM_CONCEPT_NODE, "Dog");
+    rwkv_atom_handle_t animal = rwkv_atomspace_add_node(atomspace, RWKV_ATOM_CONCEPT_NODE, "Animal");
+    rwkv_atom_handle_t likes = rwkv_atomspace_add_node(atomspace, RWKV_ATOM_PREDICATE_NODE, "likes");
+    
+    rwkv_truth_value_t kitten_tv = {0.9f, 0.5f};
+    rwkv_atom_set_truth_value(rwkv_atomspace_get_atom(atomspace, kitten), &kitten_tv);
+    
+    const float cat_embedding[4] = {1.0f, 0.0f, 0.0f, 0.0f};
+    const float kitten_embedding[4] = {0.99f, 0.1f, 0.0f, 0.0f};
+    const float dog_embedding[4] = {0.0f, 1.0f, 0.0f, 0.0f};
+    ASSERT_TRUE(rwkv_atomspace_set_embedding(atomspace, cat, cat_embedding, 4));
+    ASSERT_TRUE(rwkv_atomspace_set_embedding(atomspace, kitten, kitten_embedding, 4));
+    ASSERT_TRUE(rwkv_atomspace_set_embedding(atomspace, dog, dog_embedding, 4));
+    ASSERT_FALSE(rwkv_atomspace_set_embedding(atomspace, animal, dog_embedding, 3));
+    
+    rwkv_atom_handle_t cat_animal_outgoing[2] = {cat, animal};
+    rwkv_atom_handle_t cat_animal = rwkv_atomspace_add_link(atomspace, RWKV_ATOM_INHERITANCE_LINK, cat_animal_outgoing, 2);
+    rwkv_atom_handle_t kitten_animal_outgoing[2] = {kitten, animal};
+    rwkv_atomspace_add_link(atomspace, RWKV_ATOM_INHERITANCE_LINK, kitten_animal_outgoing, 2);
+    rwkv_atom_handle_t kitten_dog_outgoing[2] = {kitten, dog};
+    rwkv_atom_handle_t kitten_dog = rwkv_atomspace_add_link(atomspace, RWKV_ATOM_LIST_LINK, kitten_dog_outgoing, 2);
+    rwkv_atom_handle_t evaluation_outgoing[2] = {likes, kitten_dog};
+    rwkv_atomspace_add_link(atomspace, RWKV_ATOM_EVALUATION_LINK, evaluation_outgoing, 2);
+    
+    // Links cannot have embeddings
+    ASSERT_FALSE(rwkv_atomspace_set_embedding(atomspace, cat_animal, cat_embedding, 4));
+    ASSERT_EQUAL(rwkv_atomspace_get_size(atomspace), 9);
+    
+    // Kitten is merged into Cat, which is older; Dog is not similar to either
+    ASSERT_TRUE(rwkv_atomspace_consolidate_memory(atomspace, 0.9f));
+    ASSERT_NULL(rwkv_atomspace_get_atom(atomspace, kitten));
+    ASSERT_NOT_NULL(rwkv_atomspace_get_atom(atomspace, dog));
+    ASSERT_EQUAL(rwkv_atomspace_get_node_count(atomspace), 4);
+    ASSERT_EQUAL(rwkv_atomspace_get_link_count(atomspace), 3);
+    ASSERT_EQUAL(rwkv_atomspace_get_size(atomspace), 7);
+    
+    rwkv_truth_value_t tv;
+    ASSERT_TRUE(rwkv_atom_get_truth_value(rwkv_atomspace_get_atom(atomspace, cat), &tv));
+    ASSERT_TRUE(fabs(tv.strength - (0.5f * 0.1f + 0.9f * 0.5f) / 0.6f) < 1e-5f);
+    ASSERT_TRUE(fabs(tv.confidence - 0.55f) < 1e-5f);
+    
+    // The duplicate inheritance link is gone, and links to links are rewritten as well
+    rwkv_atom_handle_t incoming[4];
+    ASSERT_EQUAL(rwkv_atomspace_get_incoming(atomspace, animal, incoming, 4), 1);
+    ASSERT_EQUAL(incoming[0], cat_animal);
+    ASSERT_NULL(rwkv_atomspace_get_atom(atomspace, kitten_dog));
+    
+    rwkv_atom_handle_t cat_dog_outgoing[2] = {cat, dog};
+    rwkv_atom_handle_t cat_dog = rwkv_atomspace_add_link(atomspace, RWKV_ATOM_LIST_LINK, cat_dog_outgoing, 2);
+    ASSERT_EQUAL(rwkv_atomspace_get_size(atomspace), 7);
+    ASSERT_EQUAL(rwkv_atomspace_get_incoming(atomspace, cat_dog, incoming, 4), 1);
+    rwkv_atom_handle_t outgoing[2];
+    ASSERT_EQUAL(rwkv_atom_get_outgoing(rwkv_atomspace_get_atom(atomspace, incoming[0]), outgoing, 2), 2);
+    ASSERT_EQUAL(outgoing[0], likes);
+    ASSERT_EQUAL(outgoing[1], cat_dog);
+    
+    // Steps look at a bounded count of nodes
+    rwkv_atom_handle_t puppy = rwkv_atomspace_add_node(atomspace, RWKV_ATOM_CONCEPT_NODE, "Puppy");
+    rwkv_atom_handle_t teacup = rwkv_atomspace_add_node(atomspace, RWKV_ATOM_CONCEPT_NODE, "Teacup");
+    const float puppy_embedding[4] = {0.1f, 0.99f, 0.0f, 0.0f};
+    const float teacup_embedding[4] = {0.0f, 0.0f, 1.0f, 0.0f};
+    ASSERT_TRUE(rwkv_atomspace_set_embedding(atomspace, puppy, puppy_embedding, 4));
+    ASSERT_TRUE(rwkv_atomspace_set_embedding(atomspace, teacup, teacup_embedding, 4));
+    
+    size_t merged = 0;
+    ASSERT_EQUAL(rwkv_atomspace_consolidate_step(atomspace, 0.9f, 1, &merged), 1);
+    ASSERT_EQUAL(merged, 1);
+    ASSERT_NULL(rwkv_atomspace_get_atom(atomspace, puppy));
+    ASSERT_EQUAL(rwkv_atomspace_consolidate_step(atomspace, 0.9f, 1, &merged), 0);
+    ASSERT_EQUAL(merged, 0);
+    ASSERT_NOT_NULL(rwkv_atomspace_get_atom(atomspace, teacup));
+    
+    rwkv_atomspace_free(atomspace);
+    printf("Memory consolidation: PASSED\n");
+    return 0;
+}
+
+int test_compaction_after_merges() {
+    printf("Testing compaction after merges...\n");
+    
+    struct rwkv_atomspace * atomspace = rwkv_atomspace_create();
+    ASSERT_NOT_NULL(atomspace);
+    
+    const float embedding[4] = {1.0f, 0.0f, 0.0f, 0.0f};
+    rwkv_atom_handle_t cat = rwkv_atomspace_add_node(atomspace, RWKV_ATOM_CONCEPT_NODE, "Cat");
+    rwkv_atom_handle_t animal = rwkv_atomspace_add_node(atomspace, RWKV_ATOM_CONCEPT_NODE, "Animal");
+    ASSERT_TRUE(rwkv_atomspace_set_embedding(atomspace, cat, embedding, 4));
+    rwkv_atom_handle_t cat_animal_outgoing[2] = {cat, animal};
+    rwkv_atom_handle_t cat_animal = rwkv_atomspace_add_link(atomspace, RWKV_ATOM_INHERITANCE_LINK, cat_animal_outgoing, 2);
+    
+    // Each round adds more atoms than fit in a block and merges all of them, along with their links, into existing atoms
+    size_t first_round_size = 0;
+    for (int round = 0; round < 3; round++) {
+        char name[32];
+        for (int i = 0; i < 10000; i++) {
+            snprintf(name, sizeof(name), "Cat %d %d", round, i);
+            rwkv_atom_handle_t copy = rwkv_atomspace_add_node(atomspace, RWKV_ATOM_CONCEPT_NODE, name);
+            ASSERT_TRUE(rwkv_atomspace_set_embedding(atomspace, copy, embedding, 4));
+            rwkv_atom_handle_t outgoing[2] = {copy, animal};
+            ASSERT_NOT_EQUAL(rwkv_atomspace_add_link(atomspace, RWKV_ATOM_INHERITANCE_LINK, outgoing, 2), RWKV_INVALID_ATOM_HANDLE);
+        }
+        
+        ASSERT_TRUE(rwkv_atomspace_consolidate_memory(atomspace, 0.9f));
+        ASSERT_EQUAL(rwkv_atomspace_get_size(atomspace), 3);
+        
+        const size_t merged_size = rwkv_atomspace_get_memory_size(atomspace);
+        ASSERT_TRUE(rwkv_atomspace_compact(atomspace));
+        const size_t compacted_size = rwkv_atomspace_get_memory_size(atomspace);
+        ASSERT_TRUE(compacted_size < merged_size);
+        
+        // Memory of merged atoms does not build up across rounds
+        if (round == 0) first_round_size = compacted_size;
+        ASSERT_TRUE(compacted_size <= first_round_size);
+    }
+    
+    // Remaining atoms keep their handles, names and links
+    ASSERT_EQUAL(strcmp(rwkv_atom_get_name(rwkv_atomspace_get_atom(atomspace, cat)), "Cat"), 0);
+    ASSERT_EQUAL(rwkv_atomspace_add_node(atomspace, RWKV_ATOM_CONCEPT_NODE, "Animal"), animal);
+    ASSERT_EQUAL(rwkv_atomspace_add_link(atomspace, RWKV_ATOM_INHERITANCE_LINK, cat_animal_outgoing, 2), cat_animal);
+    rwkv_atom_handle_t incoming[2];
+    ASSERT_EQUAL(rwkv_atomspace_get_incoming(atomspace, animal, incoming, 2), 1);
+    ASSERT_EQUAL(incoming[0], cat_animal);
+    ASSERT_EQUAL(rwkv_atomspace_get_type_count(atomspace, RWKV_ATOM_INHERITANCE_LINK), 1);
+    
+    // Atoms can still be added after their blocks were freed
+    rwkv_atom_handle_t dog = rwkv_atomspace_add_node(atomspace, RWKV_ATOM_CONCEPT_NODE, "Dog");
+    ASSERT_NOT_EQUAL(dog, RWKV_INVALID_ATOM_HANDLE);
+    ASSERT_EQUAL(strcmp(rwkv_atom_get_name(rwkv_atomspace_get_atom(atomspace, dog)), "Dog"), 0);
+    ASSERT_EQUAL(rwkv_atomspace_get_size(atomspace), 4);
+    
+    rwkv_atomspace_free(atomspace);
+    printf("Compaction after merges: PASSED\n");
+    return 0;
+}
+
+int test_persistence() {
+    printf("Testing persistence...\n");
+    
+    const char * snapshot_path = "test-atomspace.snapshot";
+    const char * log_path = "test-atomspace.log";
+    
+    struct rwkv_atomspace * atomspace = rwkv_atomspace_create();
+    ASSERT_NOT_NULL(atomspace);
+    
+    rwkv_atom_handle_t cat = rwkv_atomspace_add_node(atomspace, RWKV_ATOM_CONCEPT_NODE, "Cat");
+    rwkv_atom_handle_t animal = rwkv_atomspace_add_node(atomspace, RWKV_ATOM_CONCEPT_NODE, "Animal");
+    rwkv_atom_handle_t predicate = rwkv_atomspace_add_node(atomspace, RWKV_ATOM_PREDICATE_NODE, "Cat");
+    rwkv_atom_handle_t outgoing[2] = {cat, animal};
+    rwkv_atom_handle_t cat_animal = rwkv_atomspace_add_link(atomspace, RWKV_ATOM_INHERITANCE_LINK, outgoing, 2);
+    
+    rwkv_truth_value_t tv = {0.9f, 0.8f};
+    rwkv_atom_set_truth_value(rwkv_atomspace_get_atom(atomspace, cat_animal), &tv);
+    
+    ASSERT_TRUE(rwkv_atomspace_save(atomspace, snapshot_path));
+    
+    // Changes after the snapshot go to the log
+    ASSERT_TRUE(rwkv_atomspace_open_log(atomspace, log_path));
+    rwkv_atom_handle_t pet = rwkv_atomspace_add_node(atomspace, RWKV_ATOM_CONCEPT_NODE, "Pet");
+    rwkv_atom_handle_t cat_pet_outgoing[2] = {cat, pet};
+    rwkv_atom_handle_t cat_pet = rwkv_atomspace_add_link(atomspace, RWKV_ATOM_INHERITANCE_LINK, cat_pet_outgoing, 2);
+    rwkv_attention_value_t av = {2.0f, 1.0f, 0.5f};
+    rwkv_atom_set_attention_value(rwkv_atomspace_get_atom(atomspace, cat), &av);
+    ASSERT_TRUE(rwkv_atomspace_close_log(atomspace));
+    
+    for (int use_mmap = 0; use_mmap <= 1; use_mmap++) {
+        struct rwkv_atomspace * loaded = rwkv_atomspace_load(snapshot_path, use_mmap);
+        ASSERT_NOT_NULL(loaded);
+        ASSERT_EQUAL(rwkv_atomspace_get_size(loaded), 4);
+        ASSERT_EQUAL(strcmp(rwkv_atom_get_name(rwkv_atomspace_get_atom(loaded, predicate)), "Cat"), 0);
+        ASSERT_EQUAL(rwkv_atom_get_type(rwkv_atomspace_get_atom(loaded, predicate)), RWKV_ATOM_PREDICATE_NODE);
+        ASSERT_EQUAL(rwkv_atomspace_add_node(loaded, RWKV_ATOM_CONCEPT_NODE, "Animal"), animal);
+        ASSERT_EQUAL(rwkv_atomspace_add_link(loaded, RWKV_ATOM_INHERITANCE_LINK, outgoing, 2), cat_animal);
+        
+        rwkv_truth_value_t loaded_tv;
+        ASSERT_TRUE(rwkv_atom_get_truth_value(rwkv_atomspace_get_atom(loaded, cat_animal), &loaded_tv));
+        ASSERT_EQUAL(loaded_tv.strength, 0.9f);
+        ASSERT_EQUAL(loaded_tv.confidence, 0.8f);
+        
+        rwkv_atom_handle_t incoming[4];
+        ASSERT_EQUAL(rwkv_atomspace_get_incoming(loaded, animal, incoming, 4), 1);
+        ASSERT_EQUAL(incoming[0], cat_animal);
+        
+        // Replaying the log restores later changes with their handles
+        ASSERT_TRUE(rwkv_atomspace_replay_log(loaded, log_path));
+        ASSERT_EQUAL(rwkv_atomspace_get_size(loaded), 6);
+        ASSERT_EQUAL(strcmp(rwkv_atom_get_name(rwkv_atomspace_get_atom(loaded, pet)), "Pet"), 0);
+        ASSERT_EQUAL(rwkv_atomspace_add_link(loaded, RWKV_ATOM_INHERITANCE_LINK, cat_pet_outgoing, 2), cat_pet);
+        
+        rwkv_attention_value_t loaded_av;
+        ASSERT_TRUE(rwkv_atom_get_attention_value(rwkv_atomspace_get_atom(loaded, cat), &loaded_av));
+        ASSERT_EQUAL(loaded_av.sti, 2.0f);
+        ASSERT_EQUAL(loaded_av.vlti, 0.5f);
+        
+        // New atoms get new handles
+        rwkv_atom_handle_t dog = rwkv_atomspace_add_node(loaded, RWKV_ATOM_CONCEPT_NODE, "Dog");
+        ASSERT_TRUE(dog > cat_pet);
+        
+        rwkv_atomspace_free(loaded);
+    }
+    
+    ASSERT_NULL(rwkv_atomspace_load("missing.snapshot", 0));
+    
+    remove(snapshot_path);
+    remove(log_path);
+    rwkv_atomspace_free(atomspace);
+    printf("Persistence: PASSED\n");
+    return 0;
+}
+
+int test_saving_with_open_log() {
+    printf("Testing saving with an open log...\n");
+    
+    const char * snapshot_path = "test-atomspace-logged.snapshot";
+    const char * log_path = "test-atomspace-logged.log";
+    
+    remove(log_path);
+    
+    struct rwkv_atomspace * atomspace = rwkv_atomspace_create();
+    ASSERT_NOT_NULL(atomspace);
+    ASSERT_TRUE(rwkv_atomspace_open_log(atomspace, log_path));
+    
+    rwkv_atom_handle_t cat = rwkv_atomspace_add_node(atomspace, RWKV_ATOM_CONCEPT_NODE, "Cat");
+    rwkv_atom_handle_t dog = rwkv_atomspace_add_node(atomspace, RWKV_ATOM_CONCEPT_NODE, "Dog");
+    rwkv_truth_value_t saved_tv = {0.25f, 0.5f};
+    ASSERT_TRUE(rwkv_atom_set_truth_value(rwkv_atomspace_get_atom(atomspace, cat), &saved_tv));
+    
+    // Saving starts the log over, and values set after it, also of atoms in the snapshot, go to the new log
+    ASSERT_TRUE(rwkv_atomspace_save(atomspace, snapshot_path));
+    
+    rwkv_truth_value_t tv = {0.75f, 0.9f};
+    rwkv_attention_value_t av = {3.0f, 2.0f, 1.0f};
+    ASSERT_TRUE(rwkv_atom_set_truth_value(rwkv_atomspace_get_atom(atomspace, cat), &tv));
+    ASSERT_TRUE(rwkv_atom_set_attention_value(rwkv_atomspace_get_atom(atomspace, dog), &av));
+    ASSERT_TRUE(rwkv_atomspace_flush_log(atomspace));
+    
+    // Saving again keeps values set between the saves
+    ASSERT_TRUE(rwkv_atomspace_save(atomspace, snapshot_path));
+    
+    rwkv_truth_value_t last_tv = {1.0f, 0.125f};
+    ASSERT_TRUE(rwkv_atom_set_truth_value(rwkv_atomspace_get_atom(atomspace, dog), &last_tv));
+    ASSERT_TRUE(rwkv_atomspace_close_log(atomspace));
+    
+    struct rwkv_atomspace * loaded = rwkv_atomspace_load(snapshot_path, 0);
+    ASSERT_NOT_NULL(loaded);
+    
+    rwkv_truth_value_t loaded_tv;
+    rwkv_attention_value_t loaded_av;
+    ASSERT_TRUE(rwkv_atom_get_truth_value(rwkv_atomspace_get_atom(loaded, cat), &loaded_tv));
+    ASSERT_EQUAL(loaded_tv.strength, 0.75f);
+    ASSERT_EQUAL(loaded_tv.confidence, 0.9f);
+    ASSERT_TRUE(rwkv_atom_get_attention_value(rwkv_atomspace_get_atom(loaded, dog), &loaded_av));
+    ASSERT_EQUAL(loaded_av.sti, 3.0f);
+    
+    // Only the value set after the last save is in the log
+    ASSERT_TRUE(rwkv_atomspace_replay_log(loaded, log_path));
+    ASSERT_EQUAL(rwkv_atomspace_get_size(loaded), 2);
+    ASSERT_TRUE(rwkv_atom_get_truth_value(rwkv_atomspace_get_atom(loaded, dog), &loaded_tv));
+    ASSERT_EQUAL(loaded_tv.strength, 1.0f);
+    ASSERT_EQUAL(loaded_tv.confidence, 0.125f);
+    ASSERT_TRUE(rwkv_atom_get_truth_value(rwkv_atomspace_get_atom(loaded, cat), &loaded_tv));
+    ASSERT_EQUAL(loaded_tv.strength, 0.75f);
+    
+    rwkv_atomspace_free(loaded);
+    
+    remove(snapshot_path);
+    remove(log_path);
+    rwkv_atomspace_free(atomspace);
+    printf("Saving with an open log: PASSED\n");
+    return 0;
+}
+
 int test_rwkv_integration() {
     printf("Testing RWKV integration...\n");
     
     struct rwkv_atomspace * atomspace = rwkv_atomspace_create();
     ASSERT_NOT_NULL(atomspace);
     
-    // Create a mock state array
-    const size_t state_len = 100;
+    // Create a mock state array; elements past the first 100 are converted as well
+    const size_t state_len = 300;
     float state[state_len];
     
     // Initialize with some test values
@@ -256,12 +723,95 @@ int test_rwkv_integration() {
         }
     }
     ASSERT_TRUE(significant_preserved > 0);
+    ASSERT_TRUE(fabs(recovered_state[250]) > 0.0f);
     
     rwkv_atomspace_free(atomspace);
     printf("RWKV integration: PASSED\n");
     return 0;
 }
 
+int test_state_bridge() {
+    printf("Testing state bridge...\n");
+    
+    struct rwkv_atomspace * atomspace = rwkv_atomspace_create();
+    ASSERT_NOT_NULL(atomspace);
+    
+    rwkv_state_layout_t layout;
+    ASSERT_FALSE(rwkv_get_state_layout(NULL, &layout));
+    
+    // RWKV v5+ layout with 2 layers of 2 heads of size 4: each layer has ffn_xx, att_xx, then 2 heads of 16 elements
+    layout.n_embed = 8;
+    layout.n_layer = 2;
+    layout.head_size = 4;
+    const size_t state_len = 96;
+    
+    // att_xx of layer 1 is at 56..63, and its head 1 at 80..95
+    rwkv_state_projection_t projection = {1, 0, RWKV_STATE_PART_ATT_XX | RWKV_STATE_PART_ATT_HEADS, 1, 1, 0.5f, 0.9f};
+    struct rwkv_state_bridge * bridge = rwkv_state_bridge_create(atomspace, &layout, &projection);
+    ASSERT_NOT_NULL(bridge);
+    
+    rwkv_state_projection_t empty_projection = {2, 0, RWKV_STATE_PART_ALL, 0, 0, 0.5f, 0.9f};
+    ASSERT_NULL(rwkv_state_bridge_create(atomspace, &layout, &empty_projection));
+    
+    float state[96] = {0};
+    state[10] = 1.0f;   // Layer 0
+    state[57] = 0.7f;
+    state[58] = 0.3f;   // Below the threshold
+    state[60] = -2.0f;
+    state[70] = 0.9f;   // Head 0
+    state[85] = 0.6f;
+    
+    ASSERT_FALSE(rwkv_state_bridge_to_atoms(bridge, state, state_len - 1));
+    ASSERT_TRUE(rwkv_state_bridge_to_atoms(bridge, state, state_len));
+    
+    rwkv_atom_handle_t active[8];
+    ASSERT_EQUAL(rwkv_state_bridge_get_active(bridge, active, 8), 3);
+    ASSERT_EQUAL(rwkv_atomspace_get_size(atomspace), 3);
+    ASSERT_EQUAL(strcmp(rwkv_atom_get_name(rwkv_atomspace_get_atom(atomspace, active[0])), "state_57"), 0);
+    ASSERT_EQUAL(strcmp(rwkv_atom_get_name(rwkv_atomspace_get_atom(atomspace, active[1])), "state_60"), 0);
+    ASSERT_EQUAL(strcmp(rwkv_atom_get_name(rwkv_atomspace_get_atom(atomspace, active[2])), "state_85"), 0);
+    
+    rwkv_truth_value_t tv;
+    rwkv_attention_value_t av;
+    ASSERT_TRUE(rwkv_atom_get_truth_value(rwkv_atomspace_get_atom(atomspace, active[1]), &tv));
+    ASSERT_TRUE(rwkv_atom_get_attention_value(rwkv_atomspace_get_atom(atomspace, active[1]), &av));
+    ASSERT_EQUAL(tv.strength, 1.0f);
+    ASSERT_EQUAL(tv.confidence, 0.9f);
+    ASSERT_EQUAL(av.sti, -2.0f);
+    
+    // Only the slices are written back, and their elements without nodes become 0
+    float recovered[96];
+    for (size_t i = 0; i < state_len; i++) recovered[i] = 5.0f;
+    ASSERT_TRUE(rwkv_state_bridge_to_state(bridge, recovered, state_len));
+    for (size_t i = 0; i < state_len; i++) {
+        const int in_slices = (i >= 56 && i < 64) || i >= 80;
+        ASSERT_EQUAL(recovered[i], in_slices ? state[i] * (fabs(state[i]) > 0.5f) : 5.0f);
+    }
+    
+    // Nodes are reused, and elements which are not significant anymore are reset
+    state[57] = 0.1f;
+    state[95] = -0.8f;
+    ASSERT_TRUE(rwkv_state_bridge_to_atoms(bridge, state, state_len));
+    ASSERT_EQUAL(rwkv_state_bridge_get_active(bridge, NULL, 0), 3);
+    ASSERT_EQUAL(rwkv_atomspace_get_size(atomspace), 4);
+    ASSERT_TRUE(rwkv_atom_get_truth_value(rwkv_atomspace_get_atom(atomspace, active[0]), &tv));
+    ASSERT_EQUAL(tv.strength, 0.0f);
+    
+    ASSERT_TRUE(rwkv_state_bridge_to_state(bridge, recovered, state_len));
+    ASSERT_EQUAL(recovered[57], 0.0f);
+    ASSERT_EQUAL(recovered[95], -0.8f);
+    
+    // Nodes are added again after the AtomSpace is cleared
+    rwkv_atomspace_clear(atomspace);
+    ASSERT_TRUE(rwkv_state_bridge_to_atoms(bridge, state, state_len));
+    ASSERT_EQUAL(rwkv_atomspace_get_size(atomspace), 3);
+    
+    rwkv_state_bridge_free(bridge);
+    rwkv_atomspace_free(atomspace);
+    printf("State bridge: PASSED\n");
+    return 0;
+}
+
 int main() {
     printf("Running OpenCog Integration Tests...\n\n");
     
@@ -270,9 +820,17 @@ int main() {
     result |= test_atomspace_basic_operations();
     result |= test_atom_properties();
     result |= test_links();
+    result |= test_incoming_sets();
+    result |= test_bulk_operations();
     result |= test_pattern_matching();
     result |= test_inference();
+    result |= test_forward_chaining();
+    result |= test_memory_consolidation();
+    result |= test_compaction_after_merges();
+    result |= test_persistence();
+    result |= test_saving_with_open_log();
     result |= test_rwkv_integration();
+    result |= test_state_bridge();
     
     if (result == 0) {
         printf("\nAll OpenCog integration tests PASSED!\n");
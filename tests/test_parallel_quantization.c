@@ -0,0 +1,138 @@
+// Tests that quantization gives identical files for any thread count and chunk size, and when resumed after an interruption.
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <rwkv.h>
+
+#include "assertions.inc"
+
+// Reads the whole file; the caller frees the result.
+unsigned char * read_file(const char * path, size_t * size_out) {
+    FILE * file = fopen(path, "rb");
+
+    ASSERT(file != NULL, "Failed to open %s", path);
+
+    fseek(file, 0, SEEK_END);
+    const size_t size = (size_t) ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    unsigned char * data = malloc(size);
+
+    ASSERT(data != NULL, "Failed to allocate file data");
+    ASSERT(fread(data, 1, size, file) == size, "Failed to read %s", path);
+
+    fclose(file);
+
+    *size_out = size;
+
+    return data;
+}
+
+void write_file(const char * path, const unsigned char * data, const size_t size) {
+    FILE * file = fopen(path, "wb");
+
+    ASSERT(file != NULL, "Failed to open %s", path);
+    ASSERT(fwrite(data, 1, size, file) == size, "Failed to write %s", path);
+
+    fclose(file);
+}
+
+void assert_files_equal(const char * expected_path, const char * path) {
+    size_t expected_size;
+    size_t size;
+
+    unsigned char * expected = read_file(expected_path, &expected_size);
+    unsigned char * actual = read_file(path, &size);
+
+    ASSERT(expected_size == size, "File sizes differ: %zd != %zd", expected_size, size);
+    ASSERT(memcmp(expected, actual, size) == 0, "Files are not identical");
+
+    free(expected);
+    free(actual);
+}
+
+size_t progress_call_count;
+size_t last_processed_bytes;
+size_t last_total_bytes;
+
+void on_progress(size_t processed_bytes, size_t total_bytes, void * data) {
+    ASSERT(data == &progress_call_count, "Unexpected callback data");
+    ASSERT(processed_bytes >= last_processed_bytes, "Progress went back");
+
+    progress_call_count++;
+    last_processed_bytes = processed_bytes;
+    last_total_bytes = total_bytes;
+}
+
+void test_model(const char * source_path, const char * format) {
+    fprintf(stderr, "Testing %s -> %s\n", source_path, format);
+
+    const char * expected_path = "tiny-rwkv-parallel-expected.bin";
+    const char * path = "tiny-rwkv-parallel.bin";
+
+    ASSERT(rwkv_quantize_model_file(source_path, expected_path, format), "Quantization failed");
+
+    struct rwkv_quantize_params params = rwkv_quantize_params_default();
+    params.n_threads = 4;
+    // Splits matrices into chunks of a few rows.
+    params.chunk_size = 4096;
+    params.progress_callback = on_progress;
+    params.progress_callback_data = &progress_call_count;
+
+    progress_call_count = 0;
+    last_processed_bytes = 0;
+
+    ASSERT(rwkv_quantize_model_file_with_params(source_path, path, format, &params), "Parallel quantization failed");
+    ASSERT(progress_call_count > 1, "Progress was not reported");
+    ASSERT(last_processed_bytes == last_total_bytes, "Progress did not reach the total");
+
+    assert_files_equal(expected_path, path);
+
+    // Interrupted in the middle of a tensor.
+    {
+        size_t size;
+        unsigned char * data = read_file(expected_path, &size);
+
+        write_file(path, data, size / 2);
+
+        free(data);
+    }
+
+    params.resume = true;
+    params.progress_callback = NULL;
+
+    ASSERT(rwkv_quantize_model_file_with_params(source_path, path, format, &params), "Resumed quantization failed");
+
+    assert_files_equal(expected_path, path);
+
+    // An unrelated output file is overwritten.
+    write_file(path, (const unsigned char *) "garbage", 7);
+
+    ASSERT(rwkv_quantize_model_file_with_params(source_path, path, format, &params), "Resumed quantization failed");
+
+    assert_files_equal(expected_path, path);
+
+    remove(expected_path);
+    remove(path);
+}
+
+int main(void) {
+    test_model("tiny-rwkv-5v2-730K-FP32.bin", "Q5_1");
+    test_model("tiny-rwkv-6v0-3m-FP16.bin", "Q4_0");
+    test_model("tiny-rwkv-7v0-834K-FP16.bin", "Q8_0");
+
+    // ---
+
+    rwkv_set_print_errors(NULL, false);
+
+    struct rwkv_quantize_params params = rwkv_quantize_params_default();
+    params.n_threads = 0;
+
+    ASSERT(!rwkv_quantize_model_file_with_params("tiny-rwkv-5v2-730K-FP32.bin", "tiny-rwkv-parallel.bin", "Q5_1", &params), "Zero threads were accepted");
+    ASSERT(rwkv_get_last_error(NULL) & RWKV_ERROR_ARGS, "Unexpected error flags");
+
+    rwkv_set_print_errors(NULL, true);
+
+    return 0;
+}
@@ -0,0 +1,209 @@
+// Tests that chunked eval resuming from cached prefix states gives results identical to chunked eval without the cache.
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <rwkv.h>
+
+#include "assertions.inc"
+
+#define CHUNK_SIZE 4
+
+void eval_prompt(struct rwkv_context * ctx, const char * prompt, float * state, float * logits) {
+    const size_t prompt_length = strlen(prompt);
+
+    uint32_t * tokens = calloc(prompt_length, sizeof(uint32_t));
+
+    ASSERT(tokens != NULL, "Failed to allocate tokens");
+
+    for (size_t i = 0; i < prompt_length; i++) {
+        tokens[i] = (uint32_t) (unsigned char) prompt[i];
+    }
+
+    ASSERT(rwkv_eval_sequence_in_chunks(ctx, tokens, prompt_length, CHUNK_SIZE, NULL, state, logits), "Chunked eval failed");
+
+    free(tokens);
+}
+
+void test_prompt(struct rwkv_context * reference_ctx, struct rwkv_context * ctx, const char * prompt, float * expected_state, float * expected_logits, float * state, float * logits) {
+    const size_t state_len = rwkv_get_state_len(ctx);
+    const size_t logits_len = rwkv_get_logits_len(ctx);
+
+    eval_prompt(reference_ctx, prompt, expected_state, expected_logits);
+    eval_prompt(ctx, prompt, state, logits);
+
+    ASSERT(memcmp(expected_state, state, state_len * sizeof(float)) == 0, "States are not identical for prompt '%s'", prompt);
+    ASSERT(memcmp(expected_logits, logits, logits_len * sizeof(float)) == 0, "Logits are not identical for prompt '%s'", prompt);
+}
+
+int main(void) {
+    struct rwkv_context * reference_ctx = rwkv_init_from_file("tiny-rwkv-5v2-730K-FP32.bin", 2, 0);
+    struct rwkv_context * ctx = rwkv_init_from_file("tiny-rwkv-5v2-730K-FP32.bin", 2, 0);
+
+    ASSERT(reference_ctx != NULL && ctx != NULL, "Unexpected error 0x%.8X", rwkv_get_last_error(NULL));
+
+    const size_t state_len = rwkv_get_state_len(ctx);
+    const size_t logits_len = rwkv_get_logits_len(ctx);
+
+    float * expected_state = calloc(state_len, sizeof(float));
+    float * expected_logits = calloc(logits_len, sizeof(float));
+    float * state = calloc(state_len, sizeof(float));
+    float * logits = calloc(logits_len, sizeof(float));
+
+    ASSERT(expected_state != NULL && state != NULL, "Failed to allocate state");
+    ASSERT(expected_logits != NULL && logits != NULL, "Failed to allocate logits");
+
+    struct rwkv_prefix_cache * cache = rwkv_prefix_cache_init(64 * 1024 * 1024);
+
+    ASSERT(cache != NULL, "Unexpected error 0x%.8X", rwkv_get_last_error(NULL));
+    ASSERT(rwkv_set_prefix_cache(ctx, cache), "Failed to set prefix cache");
+
+    const char * system_prompt = "You are a helpful assistant. ";
+
+    // States after each of 10 full chunks are cached.
+    test_prompt(reference_ctx, ctx, "You are a helpful assistant. What is RWKV?", expected_state, expected_logits, state, logits);
+
+    ASSERT(rwkv_prefix_cache_get_reused_token_count(cache) == 0, "Tokens were reused from an empty cache");
+    ASSERT(rwkv_prefix_cache_get_entry_count(cache) == 10, "Unexpected entry count %zd", rwkv_prefix_cache_get_entry_count(cache));
+
+    // Resumes after the shared prefix, which is rounded down to the chunk size.
+    test_prompt(reference_ctx, ctx, "You are a helpful assistant. Who are you?", expected_state, expected_logits, state, logits);
+
+    const size_t reused_token_count = rwkv_prefix_cache_get_reused_token_count(cache);
+
+    ASSERT(reused_token_count == strlen(system_prompt) / CHUNK_SIZE * CHUNK_SIZE, "Unexpected reused token count %zd", reused_token_count);
+
+    // The same prompt again resumes from the last chunk boundary before its end.
+    test_prompt(reference_ctx, ctx, "You are a helpful assistant. Who are you?", expected_state, expected_logits, state, logits);
+
+    ASSERT(rwkv_prefix_cache_get_reused_token_count(cache) - reused_token_count == 40, "Unexpected reused token count");
+
+    // Prompts that are not longer than a chunk are never resumed.
+    test_prompt(reference_ctx, ctx, "You ", expected_state, expected_logits, state, logits);
+
+    // Continuing from a state must not use the cache.
+    {
+        const uint32_t tokens[CHUNK_SIZE * 2] = { 'Y', 'o', 'u', ' ', 'a', 'r', 'e', ' ' };
+
+        ASSERT(rwkv_eval_sequence_in_chunks(reference_ctx, tokens, CHUNK_SIZE, CHUNK_SIZE, NULL, expected_state, NULL), "Chunked eval failed");
+        ASSERT(rwkv_eval_sequence_in_chunks(reference_ctx, tokens, CHUNK_SIZE * 2, CHUNK_SIZE, expected_state, expected_state, expected_logits), "Chunked eval failed");
+
+        ASSERT(rwkv_eval_sequence_in_chunks(ctx, tokens, CHUNK_SIZE, CHUNK_SIZE, NULL, state, NULL), "Chunked eval failed");
+        ASSERT(rwkv_eval_sequence_in_chunks(ctx, tokens, CHUNK_SIZE * 2, CHUNK_SIZE, state, state, logits), "Chunked eval failed");
+
+        ASSERT(memcmp(expected_state, state, state_len * sizeof(float)) == 0, "States are not identical");
+        ASSERT(memcmp(expected_logits, logits, logits_len * sizeof(float)) == 0, "Logits are not identical");
+    }
+
+    // ---
+
+    // Contexts of two models with states of different lengths share the cache, but never each other's states.
+    {
+        struct rwkv_context * other_reference_ctx = rwkv_init_from_file("tiny-rwkv-6v0-3m-FP32.bin", 2, 0);
+        struct rwkv_context * other_ctx = rwkv_init_from_file("tiny-rwkv-6v0-3m-FP32.bin", 2, 0);
+
+        ASSERT(other_reference_ctx != NULL && other_ctx != NULL, "Unexpected error 0x%.8X", rwkv_get_last_error(NULL));
+
+        const size_t other_state_len = rwkv_get_state_len(other_ctx);
+        const size_t other_logits_len = rwkv_get_logits_len(other_ctx);
+
+        ASSERT(other_state_len != state_len, "Models have states of the same length");
+
+        float * other_expected_state = calloc(other_state_len, sizeof(float));
+        float * other_expected_logits = calloc(other_logits_len, sizeof(float));
+        float * other_state = calloc(other_state_len, sizeof(float));
+        float * other_logits = calloc(other_logits_len, sizeof(float));
+
+        ASSERT(other_expected_state != NULL && other_state != NULL, "Failed to allocate state");
+        ASSERT(other_expected_logits != NULL && other_logits != NULL, "Failed to allocate logits");
+
+        ASSERT(rwkv_set_prefix_cache(other_ctx, cache), "Failed to set prefix cache");
+
+        const size_t entry_count = rwkv_prefix_cache_get_entry_count(cache);
+        const size_t reused_token_count = rwkv_prefix_cache_get_reused_token_count(cache);
+
+        // Prefixes cached by the first model are not reused.
+        test_prompt(other_reference_ctx, other_ctx, "You are a helpful assistant. Who are you?", other_expected_state, other_expected_logits, other_state, other_logits);
+
+        ASSERT(rwkv_prefix_cache_get_reused_token_count(cache) == reused_token_count, "States of another model were reused");
+        ASSERT(rwkv_prefix_cache_get_entry_count(cache) == entry_count + 10, "Unexpected entry count %zd", rwkv_prefix_cache_get_entry_count(cache));
+
+        // Both models resume from their own states.
+        test_prompt(other_reference_ctx, other_ctx, "You are a helpful assistant. Who are you?", other_expected_state, other_expected_logits, other_state, other_logits);
+
+        ASSERT(rwkv_prefix_cache_get_reused_token_count(cache) - reused_token_count == 40, "Unexpected reused token count");
+
+        test_prompt(reference_ctx, ctx, "You are a helpful assistant. Who are you?", expected_state, expected_logits, state, logits);
+
+        ASSERT(rwkv_prefix_cache_get_reused_token_count(cache) - reused_token_count == 80, "Unexpected reused token count");
+
+        // States of a freed model are never used by a model loaded after it.
+        ASSERT(rwkv_set_prefix_cache(other_ctx, NULL), "Failed to detach prefix cache");
+
+        rwkv_free(other_ctx);
+
+        other_ctx = rwkv_init_from_file("tiny-rwkv-6v0-3m-FP32.bin", 2, 0);
+
+        ASSERT(other_ctx != NULL, "Unexpected error 0x%.8X", rwkv_get_last_error(NULL));
+        ASSERT(rwkv_set_prefix_cache(other_ctx, cache), "Failed to set prefix cache");
+
+        test_prompt(other_reference_ctx, other_ctx, "You are a helpful assistant. Who are you?", other_expected_state, other_expected_logits, other_state, other_logits);
+
+        ASSERT(rwkv_prefix_cache_get_reused_token_count(cache) - reused_token_count == 80, "States of a freed model were reused");
+
+        // Clearing drops the states of all models.
+        rwkv_prefix_cache_clear(cache);
+
+        ASSERT(rwkv_prefix_cache_get_entry_count(cache) == 0, "Cleared cache has entries");
+        ASSERT(rwkv_prefix_cache_get_size(cache) == 0, "Cleared cache is not empty");
+
+        ASSERT(rwkv_set_prefix_cache(other_ctx, NULL), "Failed to detach prefix cache");
+
+        rwkv_free(other_ctx);
+        rwkv_free(other_reference_ctx);
+
+        free(other_expected_state);
+        free(other_expected_logits);
+        free(other_state);
+        free(other_logits);
+    }
+
+    ASSERT(rwkv_set_prefix_cache(ctx, NULL), "Failed to detach prefix cache");
+
+    rwkv_prefix_cache_free(cache);
+
+    // ---
+
+    // A small budget keeps only the most recently used states.
+    {
+        const size_t budget = (state_len + CHUNK_SIZE * 16) * sizeof(float) * 2;
+
+        cache = rwkv_prefix_cache_init(budget);
+
+        ASSERT(cache != NULL, "Unexpected error 0x%.8X", rwkv_get_last_error(NULL));
+        ASSERT(rwkv_set_prefix_cache(ctx, cache), "Failed to set prefix cache");
+
+        test_prompt(reference_ctx, ctx, "You are a helpful assistant. What is RWKV?", expected_state, expected_logits, state, logits);
+
+        ASSERT(rwkv_prefix_cache_get_entry_count(cache) == 2, "Unexpected entry count %zd", rwkv_prefix_cache_get_entry_count(cache));
+        ASSERT(rwkv_prefix_cache_get_size(cache) <= budget, "Cache is over the budget");
+
+        test_prompt(reference_ctx, ctx, "You are a helpful assistant. What is RWKV?", expected_state, expected_logits, state, logits);
+
+        ASSERT(rwkv_prefix_cache_get_reused_token_count(cache) == 40, "Unexpected reused token count");
+
+        ASSERT(rwkv_set_prefix_cache(ctx, NULL), "Failed to detach prefix cache");
+
+        rwkv_prefix_cache_free(cache);
+    }
+
+    rwkv_free(ctx);
+    rwkv_free(reference_ctx);
+
+    free(expected_state);
+    free(expected_logits);
+    free(state);
+    free(logits);
+
+    return 0;
+}
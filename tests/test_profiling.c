@@ -0,0 +1,129 @@
+// Tests that profiling counts parts of graphs and steps of evals, writes a trace, and does not change results.
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <rwkv.h>
+
+#include "assertions.inc"
+
+#define MAX_ENTRIES 1024
+
+const struct rwkv_profile_entry * find_entry(const struct rwkv_profile_entry * entries, const size_t count, const char * name) {
+    for (size_t i = 0; i < count; i++) {
+        if (strcmp(entries[i].name, name) == 0) {
+            return &entries[i];
+        }
+    }
+
+    return NULL;
+}
+
+void eval(struct rwkv_context * ctx, float * logits) {
+    const uint32_t prompt[4] = { 'T', 'e', 's', 't' };
+    const uint32_t tokens[2] = { 'a', 'b' };
+    float * batch_logits[2] = { logits + rwkv_get_logits_len(ctx) * 2, logits + rwkv_get_logits_len(ctx) * 3 };
+
+    ASSERT(rwkv_eval_sequence(ctx, prompt, 4, NULL, NULL, logits), "Sequence eval failed");
+    ASSERT(rwkv_eval(ctx, 'x', NULL, NULL, logits + rwkv_get_logits_len(ctx)), "Eval failed");
+    ASSERT(rwkv_eval_batch(ctx, tokens, 2, NULL, NULL, batch_logits), "Batch eval failed");
+}
+
+void test_model(const char * path, const bool has_wkv_node) {
+    fprintf(stderr, "Testing %s\n", path);
+
+    struct rwkv_context * ctx = rwkv_init_from_file(path, 2, 0);
+
+    ASSERT(ctx != NULL, "Unexpected error 0x%.8X", rwkv_get_last_error(NULL));
+
+    const size_t n_vocab = rwkv_get_logits_len(ctx);
+
+    float * expected_logits = calloc(n_vocab * 4, sizeof(float));
+    float * logits = calloc(n_vocab * 4, sizeof(float));
+
+    ASSERT(expected_logits != NULL && logits != NULL, "Failed to allocate logits");
+
+    eval(ctx, expected_logits);
+
+    ASSERT(rwkv_get_profile(ctx, NULL, 0) == 0, "Counted without profiling");
+
+    struct rwkv_context * profiled_ctx = rwkv_clone_context(ctx, 2);
+
+    ASSERT(profiled_ctx != NULL, "Unexpected error 0x%.8X", rwkv_get_last_error(NULL));
+    ASSERT(rwkv_set_profiling(profiled_ctx, true), "Failed to enable profiling");
+
+    // Graphs of the clone are built and allocated while profiling.
+    eval(profiled_ctx, logits);
+
+    ASSERT(memcmp(logits, expected_logits, n_vocab * 4 * sizeof(float)) == 0, "Profiling changed logits");
+
+    struct rwkv_profile_entry entries[MAX_ENTRIES];
+    const size_t count = rwkv_get_profile(profiled_ctx, entries, MAX_ENTRIES);
+
+    ASSERT(count > 0 && count <= MAX_ENTRIES, "Unexpected entry count %zd", count);
+
+    const char * names[10] = { "emb", "layer.0.att", "layer.0.ffn", "head", "op.MUL_MAT", "input", "output", "graph_build", "sched_alloc", "sampling" };
+
+    // The sampling stage is only computed with sampling parameters.
+    for (int i = 0; i < 9; i++) {
+        const struct rwkv_profile_entry * entry = find_entry(entries, count, names[i]);
+
+        ASSERT(entry != NULL, "Entry %s is missing", names[i]);
+        ASSERT(entry->count > 0, "Entry %s has no count", names[i]);
+    }
+
+    ASSERT(find_entry(entries, count, names[9]) == NULL, "Sampling was counted");
+
+    // WKV nodes are counted apart from the rest of time mixing.
+    const struct rwkv_profile_entry * wkv_entry = find_entry(entries, count, "layer.0.wkv");
+
+    if (has_wkv_node) {
+        ASSERT(wkv_entry != NULL && wkv_entry->count > 0, "WKV was not counted");
+    } else {
+        ASSERT(wkv_entry == NULL, "WKV was counted without a WKV node");
+    }
+    ASSERT(find_entry(entries, count, "input")->bytes > 0, "Input bytes were not counted");
+
+    const uint64_t emb_count = find_entry(entries, count, "emb")->count;
+
+    // Counters stop while profiling is disabled.
+    ASSERT(rwkv_set_profiling(profiled_ctx, false), "Failed to disable profiling");
+    eval(profiled_ctx, logits);
+
+    ASSERT(rwkv_get_profile(profiled_ctx, entries, MAX_ENTRIES) == count, "Entries changed without profiling");
+    ASSERT(find_entry(entries, count, "emb")->count == emb_count, "Counted without profiling");
+
+    const char * trace_path = "tiny-rwkv-profile-trace.json";
+
+    ASSERT(rwkv_write_profile_trace(profiled_ctx, trace_path), "Failed to write trace");
+
+    FILE * file = fopen(trace_path, "rb");
+    char header[16] = { 0 };
+
+    ASSERT(file != NULL, "Failed to open trace");
+    ASSERT(fread(header, 1, 15, file) == 15, "Failed to read trace");
+    ASSERT(strcmp(header, "{\"traceEvents\":") == 0, "Unexpected trace header %s", header);
+
+    fclose(file);
+    remove(trace_path);
+
+    rwkv_reset_profile(profiled_ctx);
+
+    ASSERT(rwkv_get_profile(profiled_ctx, NULL, 0) == 0, "Counters were not reset");
+
+    rwkv_free(profiled_ctx);
+    rwkv_free(ctx);
+
+    free(expected_logits);
+    free(logits);
+}
+
+int main(void) {
+    // WKV of v4 is built from ordinary operators.
+    test_model("tiny-rwkv-4v0-660K-FP32.bin", false);
+    test_model("tiny-rwkv-5v2-730K-FP32.bin", true);
+    test_model("tiny-rwkv-6v0-3m-FP16.bin", true);
+    test_model("tiny-rwkv-7v0-834K-FP32.bin", true);
+
+    return 0;
+}
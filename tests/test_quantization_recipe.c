@@ -0,0 +1,126 @@
+// Tests that quantization recipes select formats of tensors, and that models with mixed formats can be used.
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include <rwkv.h>
+
+#include "assertions.inc"
+
+// Offset of the data type in the file header.
+#define HEADER_DATA_TYPE_OFFSET 20
+
+unsigned char * read_file(const char * path, size_t * size_out) {
+    FILE * file = fopen(path, "rb");
+
+    ASSERT(file != NULL, "Failed to open %s", path);
+
+    fseek(file, 0, SEEK_END);
+    const size_t size = (size_t) ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    unsigned char * data = malloc(size);
+
+    ASSERT(data != NULL, "Failed to allocate file data");
+    ASSERT(fread(data, 1, size, file) == size, "Failed to read %s", path);
+
+    fclose(file);
+
+    *size_out = size;
+
+    return data;
+}
+
+void test_rules_override_default_format(void) {
+    struct rwkv_quantize_params params = rwkv_quantize_params_default();
+    // All quantized matrices of v5 are in layers.
+    params.recipe = "blocks.*=Q8_0";
+
+    ASSERT(rwkv_quantize_model_file("tiny-rwkv-5v2-730K-FP32.bin", "tiny-rwkv-recipe-expected.bin", "Q8_0"), "Quantization failed");
+    ASSERT(rwkv_quantize_model_file_with_params("tiny-rwkv-5v2-730K-FP32.bin", "tiny-rwkv-recipe.bin", "Q4_0", &params), "Quantization failed");
+
+    size_t expected_size;
+    size_t size;
+
+    unsigned char * expected = read_file("tiny-rwkv-recipe-expected.bin", &expected_size);
+    unsigned char * actual = read_file("tiny-rwkv-recipe.bin", &size);
+
+    ASSERT(expected_size == size, "File sizes differ: %zd != %zd", expected_size, size);
+
+    // Only the default format in the header differs.
+    ASSERT(memcmp(expected, actual, HEADER_DATA_TYPE_OFFSET) == 0, "File headers differ");
+    ASSERT(memcmp(expected + HEADER_DATA_TYPE_OFFSET + 4, actual + HEADER_DATA_TYPE_OFFSET + 4, size - HEADER_DATA_TYPE_OFFSET - 4) == 0, "Tensors are not identical");
+
+    free(expected);
+    free(actual);
+
+    remove("tiny-rwkv-recipe-expected.bin");
+    remove("tiny-rwkv-recipe.bin");
+}
+
+void test_mixed_formats(const char * source_path) {
+    fprintf(stderr, "Testing %s\n", source_path);
+
+    struct rwkv_quantize_params params = rwkv_quantize_params_default();
+    params.recipe = "*ffn*=Q4_K; *att.output*:0,-1=Q8_0\n head.weight=Q6_K; blocks.1.*=FP16";
+
+    ASSERT(rwkv_quantize_model_file_with_params(source_path, "tiny-rwkv-recipe.bin", "Q5_1", &params), "Quantization failed");
+
+    struct rwkv_context * ctx = rwkv_init_from_file("tiny-rwkv-recipe.bin", 2, 0);
+
+    ASSERT(ctx != NULL, "Unexpected error 0x%.8X", rwkv_get_last_error(NULL));
+
+    const size_t logits_len = rwkv_get_logits_len(ctx);
+
+    float * logits = calloc(logits_len, sizeof(float));
+
+    ASSERT(logits != NULL, "Failed to allocate logits");
+
+    const uint32_t prompt[4] = { 'T', 'e', 's', 't' };
+
+    ASSERT(rwkv_eval_sequence(ctx, prompt, 4, NULL, NULL, logits), "Sequence eval failed");
+
+    for (size_t i = 0; i < logits_len; i++) {
+        ASSERT(isfinite(logits[i]), "Logit %zd is not finite", i);
+    }
+
+    rwkv_free(ctx);
+
+    free(logits);
+
+    remove("tiny-rwkv-recipe.bin");
+}
+
+int main(void) {
+    test_rules_override_default_format();
+
+    test_mixed_formats("tiny-rwkv-5v2-730K-FP32.bin");
+    test_mixed_formats("tiny-rwkv-6v0-3m-FP16.bin");
+    test_mixed_formats("tiny-rwkv-7v0-834K-FP16.bin");
+
+    // ---
+
+    rwkv_set_print_errors(NULL, false);
+
+    const char * invalid_recipes[4] = {
+        "*ffn*",
+        "*ffn*=Q4_2",
+        "*ffn*:1..x=Q4_K",
+        "*ffn*=Q8_K"
+    };
+
+    for (int i = 0; i < 4; i++) {
+        struct rwkv_quantize_params params = rwkv_quantize_params_default();
+        params.recipe = invalid_recipes[i];
+
+        ASSERT(!rwkv_quantize_model_file_with_params("tiny-rwkv-5v2-730K-FP32.bin", "tiny-rwkv-recipe.bin", "Q5_1", &params), "Invalid recipe '%s' was accepted", invalid_recipes[i]);
+        ASSERT(rwkv_get_last_error(NULL) & RWKV_ERROR_ARGS, "Unexpected error flags");
+    }
+
+    rwkv_set_print_errors(NULL, true);
+
+    remove("tiny-rwkv-recipe.bin");
+
+    return 0;
+}
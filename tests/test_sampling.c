@@ -0,0 +1,203 @@
+// Tests that tokens sampled as a part of evaluation agree with logits returned by regular evaluation.
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include <rwkv.h>
+
+#include "assertions.inc"
+
+#define TOP_K 5
+
+uint32_t argmax(const float * logits, const size_t length) {
+    uint32_t result = 0;
+
+    for (uint32_t i = 1; i < length; i++) {
+        if (logits[i] > logits[result]) {
+            result = i;
+        }
+    }
+
+    return result;
+}
+
+void test_model(const char * model_path) {
+    fprintf(stderr, "Testing %s\n", model_path);
+
+    struct rwkv_context * ctx = rwkv_init_from_file(model_path, 2, 0);
+
+    ASSERT(ctx != NULL, "Unexpected error 0x%.8X", rwkv_get_last_error(NULL));
+
+    const size_t state_len = rwkv_get_state_len(ctx);
+    const size_t logits_len = rwkv_get_logits_len(ctx);
+
+    float * expected_state = calloc(state_len, sizeof(float));
+    float * expected_logits = calloc(logits_len, sizeof(float));
+    float * state = calloc(state_len, sizeof(float));
+
+    ASSERT(expected_state != NULL && state != NULL, "Failed to allocate state");
+    ASSERT(expected_logits != NULL, "Failed to allocate logits");
+
+    const uint32_t prompt[6] = { 'h', 'e', 'l', 'l', 'o', ' ' };
+
+    struct rwkv_sampling_params params = rwkv_sampling_params_default();
+    params.temperature = 0.0F;
+
+    uint32_t token;
+
+    // Greedy sampling selects the most probable token, and the state is the same as without sampling.
+    ASSERT(rwkv_eval_sequence(ctx, prompt, 6, NULL, expected_state, expected_logits), "Sequence eval failed");
+    ASSERT(rwkv_eval_sequence_and_sample(ctx, prompt, 6, NULL, state, &params, &token), "Sequence eval and sample failed");
+
+    ASSERT(memcmp(expected_state, state, state_len * sizeof(float)) == 0, "States are not identical");
+    ASSERT(token == argmax(expected_logits, logits_len), "Sampled token %d is not the most probable one", (int) token);
+
+    ASSERT(rwkv_eval(ctx, 'w', expected_state, expected_state, expected_logits), "Eval failed");
+    ASSERT(rwkv_eval_and_sample(ctx, 'w', state, state, &params, &token), "Eval and sample failed");
+
+    ASSERT(memcmp(expected_state, state, state_len * sizeof(float)) == 0, "States are not identical");
+    ASSERT(token == argmax(expected_logits, logits_len), "Sampled token %d is not the most probable one", (int) token);
+
+    // Logits for the next checks, which all evaluate the same token from the same state.
+    ASSERT(rwkv_eval(ctx, 'w', state, NULL, expected_logits), "Eval failed");
+
+    // Logit bias makes any token the most probable one.
+    {
+        const uint32_t bias_token = 'z';
+        const float bias_value = 1000.0F;
+
+        params.logit_bias_tokens = &bias_token;
+        params.logit_bias_values = &bias_value;
+        params.logit_bias_count = 1;
+
+        ASSERT(rwkv_eval_and_sample(ctx, 'w', state, NULL, &params, &token), "Eval and sample failed");
+        ASSERT(token == bias_token, "Logit bias was not applied");
+
+        // A penalty cancels the bias.
+        params.penalty_tokens = &bias_token;
+        params.penalty_token_count = 1;
+        params.presence_penalty = 500.0F;
+        params.frequency_penalty = 500.0F;
+
+        ASSERT(rwkv_eval_and_sample(ctx, 'w', state, NULL, &params, &token), "Eval and sample failed");
+        ASSERT(token == argmax(expected_logits, logits_len), "Penalty was not applied");
+
+        params = rwkv_sampling_params_default();
+    }
+
+    // Top-k keeps the most probable tokens, and the sampled one is one of them.
+    {
+        params.top_k = TOP_K;
+
+        ASSERT(rwkv_eval_and_sample(ctx, 'w', expected_state, NULL, &params, &token), "Eval and sample failed");
+
+        uint32_t ids[TOP_K + 1];
+        float probs[TOP_K + 1];
+
+        ASSERT(rwkv_get_sampling_candidates(ctx, ids, probs, TOP_K + 1) == TOP_K, "Unexpected candidate count");
+        ASSERT(ids[0] == argmax(expected_logits, logits_len), "The first candidate is not the most probable token");
+
+        float sum = 0.0F;
+        bool is_candidate = false;
+
+        for (size_t i = 0; i < TOP_K; i++) {
+            ASSERT(i == 0 || probs[i] <= probs[i - 1], "Candidates are not sorted");
+
+            sum += probs[i];
+            is_candidate = is_candidate || ids[i] == token;
+        }
+
+        ASSERT(fabsf(sum - 1.0F) < 0.001F, "Candidate probabilities sum up to %f", (double) sum);
+        ASSERT(is_candidate, "Sampled token is not a candidate");
+    }
+
+    // The same seed gives the same tokens.
+    {
+        params = rwkv_sampling_params_default();
+        params.top_p = 0.9F;
+
+        uint32_t tokens[2][8];
+
+        for (size_t run = 0; run < 2; run++) {
+            rwkv_set_sampling_seed(ctx, 42);
+
+            for (size_t i = 0; i < 8; i++) {
+                ASSERT(rwkv_eval_and_sample(ctx, 'w', expected_state, NULL, &params, &tokens[run][i]), "Eval and sample failed");
+            }
+        }
+
+        ASSERT(memcmp(tokens[0], tokens[1], sizeof(tokens[0])) == 0, "Tokens sampled with the same seed are different");
+    }
+
+    // Logits sampled on the host give the same tokens as sampling during evaluation with the same seed.
+    {
+        params = rwkv_sampling_params_default();
+        params.top_p = 0.9F;
+
+        uint32_t tokens[2][8];
+
+        rwkv_set_sampling_seed(ctx, 7);
+
+        for (size_t i = 0; i < 8; i++) {
+            ASSERT(rwkv_eval_and_sample(ctx, 'w', state, NULL, &params, &tokens[0][i]), "Eval and sample failed");
+        }
+
+        rwkv_set_sampling_seed(ctx, 7);
+
+        for (size_t i = 0; i < 8; i++) {
+            ASSERT(rwkv_sample_from_logits(ctx, expected_logits, &params, &tokens[1][i]), "Sample from logits failed");
+        }
+
+        ASSERT(memcmp(tokens[0], tokens[1], sizeof(tokens[0])) == 0, "Tokens sampled from logits are different");
+
+        params.temperature = 0.0F;
+
+        ASSERT(rwkv_sample_from_logits(ctx, expected_logits, &params, &token), "Sample from logits failed");
+        ASSERT(token == argmax(expected_logits, logits_len), "Sampled token %d is not the most probable one", (int) token);
+    }
+
+    // Sampling works with device-resident states too.
+    {
+        params = rwkv_sampling_params_default();
+        params.temperature = 0.0F;
+
+        struct rwkv_state * device_state = rwkv_state_init(ctx);
+
+        ASSERT(device_state != NULL, "Unexpected error 0x%.8X", rwkv_get_last_error(ctx));
+        ASSERT(rwkv_state_upload(ctx, device_state, expected_state), "Failed to upload state");
+        ASSERT(rwkv_eval(ctx, 'x', expected_state, NULL, expected_logits), "Eval failed");
+        ASSERT(rwkv_eval_with_state_and_sample(ctx, 'x', device_state, &params, &token), "Eval with state and sample failed");
+        ASSERT(token == argmax(expected_logits, logits_len), "Sampled token %d is not the most probable one", (int) token);
+
+        rwkv_state_free(device_state);
+    }
+
+    // ---
+
+    rwkv_set_print_errors(ctx, false);
+
+    params = rwkv_sampling_params_default();
+    params.top_p = 2.0F;
+
+    ASSERT(!rwkv_eval_and_sample(ctx, 'w', NULL, NULL, &params, &token), "Invalid top-p was accepted");
+    ASSERT(rwkv_get_last_error(ctx) & RWKV_ERROR_ARGS, "Unexpected error flags");
+
+    ASSERT(!rwkv_sample_from_logits(ctx, NULL, &params, &token), "NULL logits were accepted");
+    ASSERT(rwkv_get_last_error(ctx) & RWKV_ERROR_ARGS, "Unexpected error flags");
+
+    rwkv_free(ctx);
+
+    free(expected_state);
+    free(expected_logits);
+    free(state);
+}
+
+int main(void) {
+    test_model("tiny-rwkv-4v0-660K-FP32.bin");
+    test_model("tiny-rwkv-5v2-730K-FP32.bin");
+    test_model("tiny-rwkv-6v0-3m-FP32.bin");
+    test_model("tiny-rwkv-7v0-834K-FP32.bin");
+
+    return 0;
+}
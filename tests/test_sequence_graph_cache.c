@@ -0,0 +1,69 @@
+// Tests that cached sequence graphs give results equivalent to serial eval when switching between sequence lengths.
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <rwkv.h>
+
+#include "assertions.inc"
+
+int main(void) {
+    struct rwkv_context * ctx = rwkv_init_from_file("tiny-rwkv-5v2-730K-FP32.bin", 2, 0);
+
+    ASSERT(ctx != NULL, "Unexpected error 0x%.8X", rwkv_get_last_error(NULL));
+
+    const size_t state_len = rwkv_get_state_len(ctx);
+
+    ASSERT(rwkv_get_sequence_graph_cache_capacity(ctx) > 0, "Default cache capacity is 0");
+
+    rwkv_set_print_errors(ctx, false);
+    ASSERT(!rwkv_set_sequence_graph_cache_capacity(ctx, 0), "Cache capacity of 0 was accepted");
+    ASSERT(rwkv_get_last_error(ctx) & RWKV_ERROR_ARGS, "Unexpected error flags");
+    rwkv_set_print_errors(ctx, true);
+
+    ASSERT(rwkv_set_sequence_graph_cache_capacity(ctx, 2), "Failed to set cache capacity");
+    ASSERT(rwkv_get_sequence_graph_cache_capacity(ctx) == 2, "Cache capacity was not set");
+
+    const size_t prewarm_lengths[2] = {4, 7};
+
+    ASSERT(rwkv_prewarm_sequence_graphs(ctx, prewarm_lengths, 2), "Failed to prewarm graphs");
+
+    const uint8_t prompt[12] = "hello world";
+
+    uint32_t tokens[11];
+
+    for (size_t i = 0; i < 11; i++) {
+        tokens[i] = prompt[i];
+    }
+
+    float * expected_state = calloc(state_len, sizeof(float));
+    float * state = calloc(state_len, sizeof(float));
+
+    ASSERT(expected_state != NULL && state != NULL, "Failed to allocate state");
+
+    // Lengths are chosen so that some graphs are reused and some are evicted.
+    const size_t lengths[7] = {4, 7, 4, 9, 7, 4, 11};
+
+    for (size_t i = 0; i < 7; i++) {
+        const size_t length = lengths[i];
+
+        fprintf(stderr, "Testing sequence_len = %zd\n", length);
+
+        rwkv_eval(ctx, tokens[0], NULL, expected_state, NULL);
+
+        for (size_t j = 1; j < length; j++) {
+            rwkv_eval(ctx, tokens[j], expected_state, expected_state, NULL);
+        }
+
+        ASSERT(rwkv_eval_sequence(ctx, tokens, length, NULL, state, NULL), "Sequence eval failed");
+
+        ASSERT(memcmp(expected_state, state, state_len * sizeof(float)) == 0, "Results are not identical");
+    }
+
+    rwkv_free(ctx);
+
+    free(state);
+    free(expected_state);
+
+    return 0;
+}
@@ -0,0 +1,178 @@
+// Tests that sequence eval with all logits or all states gives the logits and states of serial eval after every token,
+// and that greedy speculative decoding gives the tokens of greedy decoding with the target model.
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include <rwkv.h>
+
+#include "assertions.inc"
+
+#define PROMPT_LENGTH 12
+#define GENERATED_LENGTH 32
+#define DRAFT_LENGTH 4
+
+// Matrix multiplication for all tokens may accumulate in a different order than matrix-vector multiplication.
+#define MAX_DIFFERENCE 0.0001F
+
+float max_difference(const float * a, const float * b, const size_t length) {
+    float result = 0.0F;
+
+    for (size_t i = 0; i < length; i++) {
+        float difference = fabsf(a[i] - b[i]);
+
+        if (difference > result) {
+            result = difference;
+        }
+    }
+
+    return result;
+}
+
+uint32_t most_probable(const float * logits, const size_t n_vocab) {
+    uint32_t token = 0;
+
+    for (size_t i = 1; i < n_vocab; i++) {
+        if (logits[i] > logits[token]) {
+            token = (uint32_t) i;
+        }
+    }
+
+    return token;
+}
+
+void test_all_logits(const char * model_path) {
+    fprintf(stderr, "Testing %s\n", model_path);
+
+    struct rwkv_context * ctx = rwkv_init_from_file(model_path, 2, 0);
+
+    ASSERT(ctx != NULL, "Unexpected error 0x%.8X", rwkv_get_last_error(NULL));
+
+    const size_t state_len = rwkv_get_state_len(ctx);
+    const size_t logits_len = rwkv_get_logits_len(ctx);
+
+    const char * prompt = "Hello world!";
+    uint32_t tokens[PROMPT_LENGTH];
+
+    for (size_t i = 0; i < PROMPT_LENGTH; i++) {
+        tokens[i] = (uint32_t) (unsigned char) prompt[i];
+    }
+
+    float * expected_state = calloc(state_len, sizeof(float));
+    float * state = calloc(state_len, sizeof(float));
+    float * expected_logits = calloc(logits_len, sizeof(float));
+    float * states = calloc(state_len * PROMPT_LENGTH, sizeof(float));
+    float * logits = calloc(logits_len * PROMPT_LENGTH, sizeof(float));
+    float * all_states_logits = calloc(logits_len * PROMPT_LENGTH, sizeof(float));
+
+    ASSERT(expected_state != NULL && state != NULL && states != NULL, "Failed to allocate state");
+    ASSERT(expected_logits != NULL && logits != NULL && all_states_logits != NULL, "Failed to allocate logits");
+
+    ASSERT(rwkv_eval_sequence_with_all_logits(ctx, tokens, PROMPT_LENGTH, NULL, state, logits), "Sequence eval with all logits failed");
+    ASSERT(rwkv_eval_sequence_with_all_states(ctx, tokens, PROMPT_LENGTH, NULL, states, all_states_logits), "Sequence eval with all states failed");
+
+    rwkv_init_state(ctx, expected_state);
+
+    for (size_t i = 0; i < PROMPT_LENGTH; i++) {
+        ASSERT(rwkv_eval(ctx, tokens[i], expected_state, expected_state, expected_logits), "Serial eval failed");
+        ASSERT(max_difference(expected_logits, &logits[i * logits_len], logits_len) <= MAX_DIFFERENCE, "Logits after token %zd are not equivalent", i);
+        ASSERT(max_difference(expected_logits, &all_states_logits[i * logits_len], logits_len) <= MAX_DIFFERENCE, "Logits with all states after token %zd are not equivalent", i);
+        ASSERT(max_difference(expected_state, &states[i * state_len], state_len) <= MAX_DIFFERENCE, "States after token %zd are not equivalent", i);
+    }
+
+    ASSERT(max_difference(expected_state, state, state_len) <= MAX_DIFFERENCE, "States are not equivalent");
+
+    rwkv_free(ctx);
+
+    free(expected_state);
+    free(state);
+    free(states);
+    free(expected_logits);
+    free(logits);
+    free(all_states_logits);
+}
+
+void test_speculative_decoding(const char * target_path, const char * draft_path) {
+    fprintf(stderr, "Testing %s drafted by %s\n", target_path, draft_path);
+
+    struct rwkv_context * target = rwkv_init_from_file(target_path, 2, 0);
+    struct rwkv_context * draft = rwkv_init_from_file(draft_path, 2, 0);
+
+    ASSERT(target != NULL && draft != NULL, "Unexpected error 0x%.8X", rwkv_get_last_error(NULL));
+
+    const size_t logits_len = rwkv_get_logits_len(target);
+
+    float * expected_state = calloc(rwkv_get_state_len(target), sizeof(float));
+    float * target_state = calloc(rwkv_get_state_len(target), sizeof(float));
+    float * draft_state = calloc(rwkv_get_state_len(draft), sizeof(float));
+    float * logits = calloc(logits_len, sizeof(float));
+
+    ASSERT(expected_state != NULL && target_state != NULL && draft_state != NULL, "Failed to allocate state");
+    ASSERT(logits != NULL, "Failed to allocate logits");
+
+    const uint32_t prompt[5] = { 'H', 'e', 'l', 'l', 'o' };
+
+    // Both models evaluate the prompt but its last token, which is the token of the first call.
+    ASSERT(rwkv_eval_sequence(target, prompt, 4, NULL, target_state, NULL), "Target prompt eval failed");
+    ASSERT(rwkv_eval_sequence(draft, prompt, 4, NULL, draft_state, NULL), "Draft prompt eval failed");
+
+    uint32_t expected_tokens[GENERATED_LENGTH];
+    uint32_t token = prompt[4];
+
+    memcpy(expected_state, target_state, rwkv_get_state_len(target) * sizeof(float));
+
+    for (size_t i = 0; i < GENERATED_LENGTH; i++) {
+        ASSERT(rwkv_eval(target, token, expected_state, expected_state, logits), "Serial eval failed");
+
+        token = most_probable(logits, logits_len);
+        expected_tokens[i] = token;
+    }
+
+    struct rwkv_sampling_params params = rwkv_sampling_params_default();
+    params.temperature = 0.0F;
+
+    uint32_t tokens[GENERATED_LENGTH + DRAFT_LENGTH + 1];
+    size_t count = 0;
+
+    token = prompt[4];
+
+    while (count < GENERATED_LENGTH) {
+        size_t generated;
+
+        ASSERT(
+            rwkv_speculative_decode(target, draft, token, target_state, draft_state, DRAFT_LENGTH, &params, &tokens[count], &generated),
+            "Speculative decoding failed"
+        );
+        ASSERT(generated >= 1 && generated <= DRAFT_LENGTH + 1, "Unexpected count of generated tokens %zd", generated);
+
+        count += generated;
+        token = tokens[count - 1];
+    }
+
+    for (size_t i = 0; i < GENERATED_LENGTH; i++) {
+        ASSERT(tokens[i] == expected_tokens[i], "Token %zd is %d, expected %d", i, (int) tokens[i], (int) expected_tokens[i]);
+    }
+
+    rwkv_free(draft);
+    rwkv_free(target);
+
+    free(expected_state);
+    free(target_state);
+    free(draft_state);
+    free(logits);
+}
+
+int main(void) {
+    test_all_logits("tiny-rwkv-4v0-660K-FP32.bin");
+    test_all_logits("tiny-rwkv-5v2-730K-FP32.bin");
+    test_all_logits("tiny-rwkv-6v0-3m-FP32.bin");
+    test_all_logits("tiny-rwkv-7v0-834K-FP32.bin");
+
+    // A draft of the same model accepts all tokens, a quantized one also rejects some.
+    test_speculative_decoding("tiny-rwkv-5v2-730K-FP32.bin", "tiny-rwkv-5v2-730K-FP32.bin");
+    test_speculative_decoding("tiny-rwkv-5v2-730K-FP32.bin", "tiny-rwkv-5v2-730K-Q5_1.bin");
+    test_speculative_decoding("tiny-rwkv-7v0-834K-FP32.bin", "tiny-rwkv-4v0-660K-FP32.bin");
+
+    return 0;
+}
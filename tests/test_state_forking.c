@@ -0,0 +1,151 @@
+// Tests that forks of device-resident states keep the values of their parent, and that batched eval of forks
+// gives results equivalent to serial eval of each branch.
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include <rwkv.h>
+
+#include "assertions.inc"
+
+#define BRANCH_COUNT 3
+
+// Batched matrix multiplication may accumulate in a different order than matrix-vector multiplication.
+#define MAX_DIFFERENCE 0.0001F
+
+float max_difference(const float * a, const float * b, const size_t length) {
+    float result = 0.0F;
+
+    for (size_t i = 0; i < length; i++) {
+        float difference = fabsf(a[i] - b[i]);
+
+        if (difference > result) {
+            result = difference;
+        }
+    }
+
+    return result;
+}
+
+void test_model(const char * model_path) {
+    fprintf(stderr, "Testing %s\n", model_path);
+
+    struct rwkv_context * ctx = rwkv_init_from_file(model_path, 2, 0);
+
+    ASSERT(ctx != NULL, "Unexpected error 0x%.8X", rwkv_get_last_error(NULL));
+
+    const size_t state_len = rwkv_get_state_len(ctx);
+    const size_t logits_len = rwkv_get_logits_len(ctx);
+
+    float * prompt_state = calloc(state_len, sizeof(float));
+    float * expected_state = calloc(state_len, sizeof(float));
+    float * state = calloc(state_len, sizeof(float));
+    float * expected_logits = calloc(logits_len, sizeof(float));
+    float * logits[BRANCH_COUNT];
+
+    ASSERT(prompt_state != NULL && expected_state != NULL && state != NULL, "Failed to allocate state");
+    ASSERT(expected_logits != NULL, "Failed to allocate logits");
+
+    for (size_t b = 0; b < BRANCH_COUNT; b++) {
+        logits[b] = calloc(logits_len, sizeof(float));
+
+        ASSERT(logits[b] != NULL, "Failed to allocate logits");
+    }
+
+    const uint32_t prompt[6] = { 'h', 'e', 'l', 'l', 'o', ' ' };
+
+    struct rwkv_state * parent = rwkv_state_init(ctx);
+
+    ASSERT(parent != NULL, "Unexpected error 0x%.8X", rwkv_get_last_error(ctx));
+    ASSERT(rwkv_eval_sequence(ctx, prompt, 6, NULL, prompt_state, NULL), "Sequence eval failed");
+    ASSERT(rwkv_eval_sequence_with_state(ctx, prompt, 6, parent, NULL), "Sequence eval with state failed");
+
+    // A fork has the values of its parent.
+    struct rwkv_state * branches[BRANCH_COUNT];
+
+    for (size_t b = 0; b < BRANCH_COUNT; b++) {
+        branches[b] = rwkv_state_fork(ctx, parent);
+
+        ASSERT(branches[b] != NULL, "Unexpected error 0x%.8X", rwkv_get_last_error(ctx));
+        ASSERT(rwkv_state_download(ctx, branches[b], state), "Failed to download state");
+        ASSERT(memcmp(prompt_state, state, state_len * sizeof(float)) == 0, "Fork %zd does not have the values of its parent", b);
+    }
+
+    // Branches continue with different tokens in one batch.
+    const uint32_t tokens[BRANCH_COUNT] = { 'w', 'a', 't' };
+
+    for (size_t i = 0; i < 3; i++) {
+        ASSERT(rwkv_eval_batch_with_states(ctx, tokens, BRANCH_COUNT, branches, logits), "Batch eval with states failed");
+    }
+
+    for (size_t b = 0; b < BRANCH_COUNT; b++) {
+        memcpy(expected_state, prompt_state, state_len * sizeof(float));
+
+        for (size_t i = 0; i < 3; i++) {
+            ASSERT(rwkv_eval(ctx, tokens[b], expected_state, expected_state, expected_logits), "Serial eval failed");
+        }
+
+        ASSERT(max_difference(expected_logits, logits[b], logits_len) <= MAX_DIFFERENCE, "Logits of branch %zd are not equivalent", b);
+
+        ASSERT(rwkv_state_download(ctx, branches[b], state), "Failed to download state");
+        ASSERT(max_difference(expected_state, state, state_len) <= MAX_DIFFERENCE, "State of branch %zd is not equivalent", b);
+    }
+
+    // Writing to forks does not change their parent, and writing to the parent does not change its forks.
+    ASSERT(rwkv_state_download(ctx, parent, state), "Failed to download state");
+    ASSERT(memcmp(prompt_state, state, state_len * sizeof(float)) == 0, "Parent was changed by its forks");
+
+    struct rwkv_state * fork = rwkv_state_fork(ctx, parent);
+
+    ASSERT(fork != NULL, "Unexpected error 0x%.8X", rwkv_get_last_error(ctx));
+    ASSERT(rwkv_eval_with_state(ctx, '!', parent, NULL), "Eval with state failed");
+    ASSERT(rwkv_state_download(ctx, fork, state), "Failed to download state");
+    ASSERT(memcmp(prompt_state, state, state_len * sizeof(float)) == 0, "Fork was changed by its parent");
+
+    // A freed parent leaves its forks intact.
+    rwkv_state_free(parent);
+
+    ASSERT(rwkv_state_download(ctx, fork, state), "Failed to download state");
+    ASSERT(memcmp(prompt_state, state, state_len * sizeof(float)) == 0, "Fork was changed when its parent was freed");
+
+    // Mixing a state with itself gives the same state, even written over one of the inputs.
+    const float * mixed[2] = { prompt_state, state };
+    const float weights[2] = { 0.5F, 0.5F };
+
+    memcpy(state, prompt_state, state_len * sizeof(float));
+
+    ASSERT(rwkv_mix_states(ctx, mixed, weights, 2, state), "Failed to mix states");
+    ASSERT(memcmp(prompt_state, state, state_len * sizeof(float)) == 0, "Mixed state differs from its inputs");
+
+    // The same state can not get the outputs of two sequences.
+    struct rwkv_state * repeated[2] = { fork, fork };
+    const uint32_t repeated_tokens[2] = { 'a', 'b' };
+
+    rwkv_set_print_errors(ctx, false);
+    ASSERT(!rwkv_eval_batch_with_states(ctx, repeated_tokens, 2, repeated, NULL), "Repeated state was accepted");
+    ASSERT(rwkv_get_last_error(ctx) & RWKV_ERROR_ARGS, "Unexpected error flags");
+
+    rwkv_state_free(fork);
+
+    for (size_t b = 0; b < BRANCH_COUNT; b++) {
+        rwkv_state_free(branches[b]);
+        free(logits[b]);
+    }
+
+    rwkv_free(ctx);
+
+    free(prompt_state);
+    free(expected_state);
+    free(state);
+    free(expected_logits);
+}
+
+int main(void) {
+    test_model("tiny-rwkv-4v0-660K-FP32.bin");
+    test_model("tiny-rwkv-5v2-730K-FP32.bin");
+    test_model("tiny-rwkv-6v0-3m-FP32.bin");
+    test_model("tiny-rwkv-7v0-834K-FP32.bin");
+
+    return 0;
+}
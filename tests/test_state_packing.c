@@ -0,0 +1,125 @@
+// Tests that states packed into reduced-precision formats can be unpacked and used to continue evaluation.
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include <rwkv.h>
+
+#include "assertions.inc"
+
+#define FORMAT_COUNT 4
+
+float max_difference(const float * a, const float * b, const size_t length) {
+    float result = 0.0F;
+
+    for (size_t i = 0; i < length; i++) {
+        float difference = fabsf(a[i] - b[i]);
+
+        if (difference > result) {
+            result = difference;
+        }
+    }
+
+    return result;
+}
+
+void test_model(const char * model_path) {
+    fprintf(stderr, "Testing %s\n", model_path);
+
+    struct rwkv_context * ctx = rwkv_init_from_file(model_path, 2, 0);
+
+    ASSERT(ctx != NULL, "Unexpected error 0x%.8X", rwkv_get_last_error(NULL));
+
+    const size_t state_len = rwkv_get_state_len(ctx);
+    const size_t logits_len = rwkv_get_logits_len(ctx);
+
+    float * state = calloc(state_len, sizeof(float));
+    float * unpacked_state = calloc(state_len, sizeof(float));
+    float * expected_logits = calloc(logits_len, sizeof(float));
+    float * logits = calloc(logits_len, sizeof(float));
+
+    ASSERT(state != NULL && unpacked_state != NULL, "Failed to allocate state");
+    ASSERT(expected_logits != NULL && logits != NULL, "Failed to allocate logits");
+
+    const uint32_t prompt[8] = { 'T', 'h', 'i', 's', ' ', 'i', 's', ' ' };
+
+    ASSERT(rwkv_eval_sequence(ctx, prompt, 8, NULL, state, NULL), "Sequence eval failed");
+    ASSERT(rwkv_eval(ctx, 'a', state, NULL, expected_logits), "Eval failed");
+
+    const enum rwkv_state_format formats[FORMAT_COUNT] = {
+        RWKV_STATE_FORMAT_FP32,
+        RWKV_STATE_FORMAT_FP16,
+        RWKV_STATE_FORMAT_BF16,
+        RWKV_STATE_FORMAT_Q8
+    };
+
+    // Maximum difference of logits after continuing from an unpacked state.
+    const float max_logits_differences[FORMAT_COUNT] = { 0.0F, 0.05F, 0.25F, 1.0F };
+
+    const size_t fp32_size = rwkv_get_packed_state_size(ctx, RWKV_STATE_FORMAT_FP32, RWKV_STATE_FORMAT_FP32);
+
+    ASSERT(fp32_size > state_len * sizeof(float), "Packed FP32 state is too small");
+
+    // Uses uint32_t to get a buffer aligned to 4 bytes.
+    uint32_t * buffer = calloc(fp32_size / sizeof(uint32_t), sizeof(uint32_t));
+
+    ASSERT(buffer != NULL, "Failed to allocate buffer");
+
+    for (int v = 0; v < FORMAT_COUNT; v++) {
+        // Heads are always at least as precise as vectors, which is the only useful combination.
+        for (int h = 0; h <= v; h++) {
+            const size_t size = rwkv_get_packed_state_size(ctx, formats[v], formats[h]);
+
+            ASSERT(size > 0 && size <= fp32_size, "Unexpected packed state size %zd", size);
+
+            ASSERT(rwkv_pack_state(ctx, state, formats[v], formats[h], buffer, size), "Failed to pack state");
+            ASSERT(rwkv_unpack_state(ctx, buffer, size, unpacked_state), "Failed to unpack state");
+
+            ASSERT(rwkv_eval(ctx, 'a', unpacked_state, NULL, logits), "Eval failed");
+
+            const float logits_difference = max_difference(expected_logits, logits, logits_len);
+
+            fprintf(stderr, "Formats %d/%d: %zd bytes, logits difference %f\n", v, h, size, (double) logits_difference);
+
+            ASSERT(logits_difference <= max_logits_differences[v], "Too big logits difference %f", (double) logits_difference);
+
+            if (v == 0) {
+                ASSERT(memcmp(state, unpacked_state, state_len * sizeof(float)) == 0, "FP32 state is not identical");
+            }
+        }
+    }
+
+    // ---
+
+    rwkv_set_print_errors(ctx, false);
+
+    ASSERT(!rwkv_pack_state(ctx, state, RWKV_STATE_FORMAT_FP16, RWKV_STATE_FORMAT_FP16, buffer, 16), "Small buffer was accepted");
+    ASSERT(rwkv_get_last_error(ctx) & RWKV_ERROR_ARGS, "Unexpected error flags");
+
+    ASSERT(rwkv_pack_state(ctx, state, RWKV_STATE_FORMAT_FP16, RWKV_STATE_FORMAT_FP16, buffer, fp32_size), "Failed to pack state");
+
+    buffer[0] ^= 1;
+
+    ASSERT(!rwkv_unpack_state(ctx, buffer, fp32_size, unpacked_state), "Invalid magic was accepted");
+    ASSERT(rwkv_get_last_error(ctx) == (RWKV_ERROR_ARGS | RWKV_ERROR_DATA), "Unexpected error flags");
+
+    rwkv_set_print_errors(ctx, true);
+
+    rwkv_free(ctx);
+
+    free(buffer);
+    free(state);
+    free(unpacked_state);
+    free(expected_logits);
+    free(logits);
+}
+
+int main(void) {
+    test_model("tiny-rwkv-4v0-660K-FP32.bin");
+    test_model("tiny-rwkv-5v2-730K-FP32.bin");
+    test_model("tiny-rwkv-6v0-3m-FP32.bin");
+    test_model("tiny-rwkv-7v0-834K-FP32.bin");
+
+    return 0;
+}
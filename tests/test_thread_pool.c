@@ -0,0 +1,145 @@
+// Tests that contexts computing on a shared thread pool give results identical to contexts with their own threads.
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <rwkv.h>
+
+#include "assertions.inc"
+
+#define N_THREADS 2
+
+void eval_prompt(struct rwkv_context * ctx, float * state, float * logits) {
+    const uint32_t prompt[8] = { 'T', 'h', 'i', 's', ' ', 'i', 's', ' ' };
+
+    ASSERT(rwkv_eval_sequence(ctx, prompt, 8, NULL, state, NULL), "Sequence eval failed");
+    ASSERT(rwkv_eval(ctx, 'a', state, state, logits), "Eval failed");
+}
+
+void test_context(struct rwkv_context * ctx, const float * expected_state, const float * expected_logits, float * state, float * logits) {
+    const size_t state_len = rwkv_get_state_len(ctx);
+    const size_t logits_len = rwkv_get_logits_len(ctx);
+
+    eval_prompt(ctx, state, logits);
+
+    ASSERT(memcmp(expected_state, state, state_len * sizeof(float)) == 0, "States are not identical");
+    ASSERT(memcmp(expected_logits, logits, logits_len * sizeof(float)) == 0, "Logits are not identical");
+}
+
+int main(void) {
+    struct rwkv_thread_pool_params pool_params = rwkv_thread_pool_params_default();
+    pool_params.n_threads = N_THREADS;
+
+    struct rwkv_thread_pool * pool = rwkv_thread_pool_init(&pool_params);
+
+    ASSERT(pool != NULL, "Unexpected error 0x%.8X", rwkv_get_last_error(NULL));
+    ASSERT(rwkv_thread_pool_get_n_threads(pool) == N_THREADS, "Unexpected thread count");
+
+    struct rwkv_context * reference_ctx = rwkv_init_from_file("tiny-rwkv-5v2-730K-FP32.bin", N_THREADS, 0);
+
+    ASSERT(reference_ctx != NULL, "Unexpected error 0x%.8X", rwkv_get_last_error(NULL));
+
+    struct rwkv_init_params params = rwkv_init_params_default();
+    params.thread_pool = pool;
+
+    struct rwkv_context * ctx = rwkv_init_from_file_with_params("tiny-rwkv-5v2-730K-FP32.bin", &params);
+
+    ASSERT(ctx != NULL, "Unexpected error 0x%.8X", rwkv_get_last_error(NULL));
+
+    const size_t state_len = rwkv_get_state_len(ctx);
+    const size_t logits_len = rwkv_get_logits_len(ctx);
+
+    float * expected_state = calloc(state_len, sizeof(float));
+    float * expected_logits = calloc(logits_len, sizeof(float));
+    float * state = calloc(state_len, sizeof(float));
+    float * logits = calloc(logits_len, sizeof(float));
+
+    ASSERT(expected_state != NULL && state != NULL, "Failed to allocate state");
+    ASSERT(expected_logits != NULL && logits != NULL, "Failed to allocate logits");
+
+    eval_prompt(reference_ctx, expected_state, expected_logits);
+
+    test_context(ctx, expected_state, expected_logits, state, logits);
+
+    // A clone shares the pool.
+    struct rwkv_context * pool_clone = rwkv_clone_context_with_thread_pool(ctx, pool);
+
+    ASSERT(pool_clone != NULL, "Unexpected error 0x%.8X", rwkv_get_last_error(NULL));
+
+    test_context(pool_clone, expected_state, expected_logits, state, logits);
+
+    // A clone with its own threads does not use the pool of the context it was cloned from.
+    struct rwkv_context * clone = rwkv_clone_context(ctx, N_THREADS);
+
+    ASSERT(clone != NULL, "Unexpected error 0x%.8X", rwkv_get_last_error(NULL));
+
+    test_context(clone, expected_state, expected_logits, state, logits);
+
+    // Contexts can move between their own threads and a pool.
+    ASSERT(rwkv_set_thread_pool(clone, pool), "Failed to set thread pool");
+    test_context(clone, expected_state, expected_logits, state, logits);
+
+    ASSERT(rwkv_set_thread_pool(ctx, NULL), "Failed to detach thread pool");
+    test_context(ctx, expected_state, expected_logits, state, logits);
+
+    // The context from which the pool was detached does not stop other contexts using it.
+    test_context(pool_clone, expected_state, expected_logits, state, logits);
+
+    // Without a pool, the clone gets its own threads.
+    struct rwkv_context * threads_clone = rwkv_clone_context_with_thread_pool(ctx, NULL);
+
+    ASSERT(threads_clone != NULL, "Unexpected error 0x%.8X", rwkv_get_last_error(NULL));
+
+    test_context(threads_clone, expected_state, expected_logits, state, logits);
+
+    rwkv_free(threads_clone);
+    rwkv_free(clone);
+    rwkv_free(pool_clone);
+
+    rwkv_thread_pool_free(pool);
+
+    // Pinned pools.
+    {
+        pool_params.first_cpu = 0;
+        pool_params.n_threads = 1;
+
+        pool = rwkv_thread_pool_init(&pool_params);
+
+        ASSERT(pool != NULL, "Unexpected error 0x%.8X", rwkv_get_last_error(NULL));
+        ASSERT(rwkv_set_thread_pool(ctx, pool), "Failed to set thread pool");
+
+        test_context(ctx, expected_state, expected_logits, state, logits);
+
+        ASSERT(rwkv_set_thread_pool(ctx, NULL), "Failed to detach thread pool");
+
+        rwkv_thread_pool_free(pool);
+    }
+
+    // ---
+
+    rwkv_set_print_errors(NULL, false);
+
+    pool_params = rwkv_thread_pool_params_default();
+    pool_params.n_threads = 0;
+
+    ASSERT(rwkv_thread_pool_init(&pool_params) == NULL, "Pool without threads was created");
+    ASSERT(rwkv_get_last_error(NULL) & RWKV_ERROR_ARGS, "Unexpected error flags");
+
+    pool_params = rwkv_thread_pool_params_default();
+    pool_params.first_cpu = 1 << 20;
+
+    ASSERT(rwkv_thread_pool_init(&pool_params) == NULL, "Pool pinned to missing CPUs was created");
+    ASSERT(rwkv_get_last_error(NULL) & RWKV_ERROR_ARGS, "Unexpected error flags");
+
+    rwkv_set_print_errors(NULL, true);
+
+    rwkv_free(ctx);
+    rwkv_free(reference_ctx);
+
+    free(expected_state);
+    free(expected_logits);
+    free(state);
+    free(logits);
+
+    return 0;
+}